@@ -0,0 +1,273 @@
+#include "biome_grid.h"
+#include "image_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GRID_MAGIC      "BGRD"
+#define GRID_VERSION    1
+#define GRID_NONE       255     // stored ID of none (-1)
+
+enum {
+    ROW_RAW,
+    ROW_RLE,
+};
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    int32_t mc;
+    uint32_t flags;
+    int32_t dim;
+    uint32_t reserved2;
+    uint64_t seed;
+    int32_t scale, x, z, sx, sz, y, sy;
+    uint32_t rowCount;
+} GridHeader;   // followed by rowCount+1 row offsets (uint32) and the rows
+
+static uint32_t readOffset(const unsigned char *table, size_t i) {
+    uint32_t v;
+    memcpy(&v, table + 4 * i, 4);
+    return v;
+}
+
+unsigned char *encodeBiomeGrid(const BiomeGridInfo *info, const int *ids, size_t *size) {
+    const Range *r = &info->r;
+    int sy = r->sy > 0 ? r->sy : 1;
+    size_t rows = (size_t)sy * r->sz;
+    size_t tableSize = 4 * (rows + 1);
+    size_t cap = sizeof(GridHeader) + tableSize + rows * (1 + (size_t)r->sx);
+
+    if (r->sx <= 0 || r->sz <= 0)
+        return NULL;
+    unsigned char *buf = (unsigned char *)malloc(cap);
+    if (!buf) {
+        fprintf(stderr, "Error allocating memory for the biome grid\n");
+        return NULL;
+    }
+
+    GridHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, GRID_MAGIC, 4);
+    h.version = GRID_VERSION;
+    h.mc = info->mc;
+    h.flags = info->flags;
+    h.dim = info->dim;
+    h.seed = info->seed;
+    h.scale = r->scale;
+    h.x = r->x;
+    h.z = r->z;
+    h.sx = r->sx;
+    h.sz = r->sz;
+    h.y = r->y;
+    h.sy = sy;
+    h.rowCount = rows;
+    memcpy(buf, &h, sizeof(h));
+
+    unsigned char *table = buf + sizeof(h);
+    unsigned char *rowData = table + tableSize;
+    uint32_t pos = 0;
+
+    for (size_t j = 0; j < rows; j++) {
+        const int *src = ids + j * r->sx;
+        memcpy(table + 4 * j, &pos, 4);
+
+        // check the IDs and count the runs, which are at most 255 long
+        size_t runs = 0;
+        for (int i = 0; i < r->sx; ) {
+            int id = src[i];
+            if (id < -1 || id >= GRID_NONE) {
+                fprintf(stderr, "Biome %d does not fit in a biome grid\n", id);
+                free(buf);
+                return NULL;
+            }
+            int n = 1;
+            while (i + n < r->sx && n < 255 && src[i + n] == id)
+                n++;
+            i += n;
+            runs++;
+        }
+
+        unsigned char *out = rowData + pos;
+        if (2 * runs < (size_t)r->sx) {
+            *out++ = ROW_RLE;
+            for (int i = 0; i < r->sx; ) {
+                int id = src[i];
+                int n = 1;
+                while (i + n < r->sx && n < 255 && src[i + n] == id)
+                    n++;
+                *out++ = (unsigned char)n;
+                *out++ = (unsigned char)(id < 0 ? GRID_NONE : id);
+                i += n;
+            }
+        } else {
+            *out++ = ROW_RAW;
+            for (int i = 0; i < r->sx; i++)
+                *out++ = (unsigned char)(src[i] < 0 ? GRID_NONE : src[i]);
+        }
+        pos = out - rowData;
+    }
+    memcpy(table + 4 * rows, &pos, 4);
+
+    *size = sizeof(h) + tableSize + pos;
+    unsigned char *p = (unsigned char *)realloc(buf, *size);
+    return p ? p : buf;
+}
+
+int saveBiomeGrid(const char *path, const BiomeGridInfo *info, const int *ids) {
+    size_t size;
+    unsigned char *data = encodeBiomeGrid(info, ids, &size);
+    if (!data)
+        return -1;
+
+    FILE *fp = fopen(path, "wb");
+    int err = -1;
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing %s: %s\n", path, strerror(errno));
+    } else {
+        err = fwrite(data, 1, size, fp) == size ? 0 : -1;
+        if (fclose(fp) != 0)
+            err = -1;
+    }
+    free(data);
+    return err;
+}
+
+int initBiomeGrid(BiomeGrid *bg, const void *data, size_t size) {
+    GridHeader h;
+    memset(bg, 0, sizeof(*bg));
+    if (size < sizeof(h))
+        return -1;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, GRID_MAGIC, 4) != 0 || h.version != GRID_VERSION ||
+            h.sx <= 0 || h.sz <= 0 || h.sy <= 0 ||
+            h.rowCount != (uint64_t)h.sy * h.sz)
+        return -1;
+
+    size_t tableSize = 4 * ((size_t)h.rowCount + 1);
+    if (size < sizeof(h) + tableSize)
+        return -1;
+    const unsigned char *table = (const unsigned char *)data + sizeof(h);
+    if (readOffset(table, h.rowCount) != size - sizeof(h) - tableSize)
+        return -1;
+
+    bg->info.mc = h.mc;
+    bg->info.flags = h.flags;
+    bg->info.dim = h.dim;
+    bg->info.seed = h.seed;
+    bg->info.r.scale = h.scale;
+    bg->info.r.x = h.x;
+    bg->info.r.z = h.z;
+    bg->info.r.sx = h.sx;
+    bg->info.r.sz = h.sz;
+    bg->info.r.y = h.y;
+    bg->info.r.sy = h.sy;
+    bg->data = (const unsigned char *)data;
+    bg->size = size;
+    return 0;
+}
+
+int mapBiomeGrid(BiomeGrid *bg, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED || initBiomeGrid(bg, map, st.st_size) != 0) {
+        fprintf(stderr, "Not a biome grid: %s\n", path);
+        if (map != MAP_FAILED)
+            munmap(map, st.st_size);
+        return -1;
+    }
+    bg->map = map;
+    bg->mapSize = st.st_size;
+    return 0;
+}
+
+void unmapBiomeGrid(BiomeGrid *bg) {
+    if (bg->map)
+        munmap(bg->map, bg->mapSize);
+    memset(bg, 0, sizeof(*bg));
+}
+
+int decodeBiomeGridRow(const BiomeGrid *bg, int row, int *ids) {
+    int sx = bg->info.r.sx;
+    size_t rows = (size_t)bg->info.r.sy * bg->info.r.sz;
+    if (row < 0 || (size_t)row >= rows)
+        return -1;
+
+    const unsigned char *table = bg->data + sizeof(GridHeader);
+    const unsigned char *rowData = table + 4 * (rows + 1);
+    uint32_t start = readOffset(table, row);
+    uint32_t end = readOffset(table, row + 1);
+    if (start >= end || end > bg->size - (rowData - bg->data))
+        return -1;
+
+    const unsigned char *p = rowData + start;
+    const unsigned char *pend = rowData + end;
+    int i = 0;
+
+    if (*p == ROW_RAW) {
+        if (pend - p != 1 + sx)
+            return -1;
+        for (p++; i < sx; i++, p++)
+            ids[i] = *p == GRID_NONE ? -1 : *p;
+        return 0;
+    }
+    if (*p != ROW_RLE)
+        return -1;
+    for (p++; p + 2 <= pend; p += 2) {
+        int n = p[0];
+        int id = p[1] == GRID_NONE ? -1 : p[1];
+        if (i + n > sx)
+            return -1;
+        while (n--)
+            ids[i++] = id;
+    }
+    return (i == sx && p == pend) ? 0 : -1;
+}
+
+int decodeBiomeGrid(const BiomeGrid *bg, int *ids) {
+    int rows = bg->info.r.sy * bg->info.r.sz;
+    for (int j = 0; j < rows; j++) {
+        if (decodeBiomeGridRow(bg, j, ids + (size_t)j * bg->info.r.sx) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int recolorBiomeGrid(const BiomeGrid *bg, const char *pngPath, int pixscale,
+        unsigned char biomeColors[256][3]) {
+    const Range *r = &bg->info.r;
+    int *ids = (int *)malloc((size_t)r->sx * r->sz * sizeof(int));
+    int err;
+    if (!ids) {
+        fprintf(stderr, "Error allocating memory for biomes\n");
+        return -1;
+    }
+
+    // the first layer are the first r.sz rows
+    for (int j = 0; j < r->sz; j++) {
+        if (decodeBiomeGridRow(bg, j, ids + (size_t)j * r->sx) != 0) {
+            fprintf(stderr, "Invalid row %d in the biome grid\n", j);
+            free(ids);
+            return -1;
+        }
+    }
+    err = savePNGIndexed(pngPath, ids, r->sx, r->sz, pixscale, biomeColors);
+
+    free(ids);
+    return err;
+}
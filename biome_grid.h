@@ -0,0 +1,76 @@
+#ifndef BIOME_GRID_H
+#define BIOME_GRID_H
+
+#include "generator.h"
+#include <stddef.h>
+
+// Compact storage for the biome grids of genBiomes(), so that tiles can be
+// redrawn (e.g. with other colors) without generating the biomes again.
+//
+// An encoded grid consists of a header with the generator settings and the
+// Range, a table with the offset of each row, and the rows of 8-bit biome IDs
+// (none is stored as 255). Each row is either run-length encoded as pairs of
+// (length, id) or stored raw, whichever is smaller. The encoding is in host
+// byte order.
+
+typedef struct {
+    int mc;
+    uint32_t flags;
+    int dim;
+    uint64_t seed;
+    Range r;
+} BiomeGridInfo;
+
+// A read-only view of an encoded grid, e.g. in a mapped file
+typedef struct {
+    BiomeGridInfo info;
+    const unsigned char *data;  // the encoded grid
+    size_t size;
+    void *map;                  // mapping of mapBiomeGrid()
+    size_t mapSize;
+} BiomeGrid;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Encodes the biomes 'ids' (with the layout of genBiomes() for 'info->r') and
+ * returns a malloc'd buffer of '*size' bytes, or NULL if an ID does not fit
+ * in 8 bits.
+ */
+unsigned char *encodeBiomeGrid(const BiomeGridInfo *info, const int *ids, size_t *size);
+int saveBiomeGrid(const char *path, const BiomeGridInfo *info, const int *ids);
+
+/**
+ * Creates a view of an encoded grid in memory, without copying it. The data
+ * has to remain valid while the view is used. Returns zero upon success.
+ */
+int initBiomeGrid(BiomeGrid *bg, const void *data, size_t size);
+
+/**
+ * Maps a grid file as a view. Returns zero upon success.
+ */
+int mapBiomeGrid(BiomeGrid *bg, const char *path);
+void unmapBiomeGrid(BiomeGrid *bg);
+
+/**
+ * Decodes row 'row' = y*r.sz + z into 'ids' (r.sx entries), or the entire
+ * grid in the layout of genBiomes(). Returns zero upon success.
+ */
+int decodeBiomeGridRow(const BiomeGrid *bg, int row, int *ids);
+int decodeBiomeGrid(const BiomeGrid *bg, int *ids);
+
+/**
+ * Draws the first layer of the grid as a palette-indexed PNG in the style of
+ * savePNGIndexed(). Returns zero upon success.
+ */
+int recolorBiomeGrid(const BiomeGrid *bg, const char *pngPath, int pixscale,
+        unsigned char biomeColors[256][3]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BIOME_GRID_H
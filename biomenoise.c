@@ -5,6 +5,11 @@
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
+#include <time.h>
+
+#if USE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 
 //==============================================================================
@@ -367,7 +372,10 @@ int mapEndBiome(const EndNoise *en, int *out, int x, int z, int w, int h)
     int64_t i, j;
     int64_t hw = w + 26;
     int64_t hh = h + 26;
-    uint16_t *hmap = (uint16_t*) malloc(sizeof(*hmap) * hw * hh);
+    uint16_t hbuf[32*32]; // small areas and single points
+    uint16_t *hmap = hbuf;
+    if (hw * hh > 32*32)
+        hmap = (uint16_t*) malloc(sizeof(*hmap) * hw * hh);
 
     for (j = 0; j < hh; j++)
     {
@@ -415,7 +423,8 @@ int mapEndBiome(const EndNoise *en, int *out, int x, int z, int w, int h)
         }
     }
 
-    free(hmap);
+    if (hmap != hbuf)
+        free(hmap);
     return 0;
 }
 
@@ -426,7 +435,10 @@ int mapEnd(const EndNoise *en, int *out, int x, int z, int w, int h)
     int64_t cw = ((x+w) >> 2) + 1 - cx;
     int64_t ch = ((z+h) >> 2) + 1 - cz;
 
-    int *buf = (int*) malloc(sizeof(int) * cw * ch);
+    int cbuf[16];
+    int *buf = cbuf;
+    if (cw * ch > 16)
+        buf = (int*) malloc(sizeof(int) * cw * ch);
     mapEndBiome(en, buf, cx, cz, cw, ch);
 
     int i, j;
@@ -442,7 +454,8 @@ int mapEnd(const EndNoise *en, int *out, int x, int z, int w, int h)
         }
     }
 
-    free(buf);
+    if (buf != cbuf)
+        free(buf);
     return 0;
 }
 
@@ -941,9 +954,8 @@ float getSpline(const Spline *sp, const float *vals)
     return r;
 }
 
-void initBiomeNoise(BiomeNoise *bn, int mc)
+static Spline *createTerrainSpline(SplineStack *ss)
 {
-    SplineStack *ss = &bn->ss;
     memset(ss, 0, sizeof(*ss));
     Spline *sp = &ss->stack[ss->len++];
     sp->typ = SP_CONTINENTALNESS;
@@ -963,12 +975,146 @@ void initBiomeNoise(BiomeNoise *bn, int mc)
     addSplineVal(sp, -0.10F, sp2, 0.0F);
     addSplineVal(sp,  0.25F, sp3, 0.0F);
     addSplineVal(sp,  1.00F, sp4, 0.0F);
+    return sp;
+}
+
+static FlatSpline g_fspline;
+static SplineStack g_fspline_ss;
+static int g_fspline_state; // 0: not built, 1: building, 2: ready
+
+/* Adds a spline to the flat table after its children and returns its node
+ * index. Splines that are identical to an existing node share that node.
+ */
+static int flattenSpline(FlatSpline *fs, const Spline *sp)
+{
+    int16_t child[12];
+    float val[12];
+    int i, j, n = sp->len;
+    for (i = 0; i < n; i++)
+    {
+        const Spline *v = sp->val[i];
+        if (v->len == 1)
+        {
+            val[i] = ((const FixSpline*)v)->val;
+            child[i] = -1;
+        }
+        else
+        {
+            val[i] = 0;
+            child[i] = (int16_t) flattenSpline(fs, v);
+        }
+    }
+    for (i = 0; i < fs->len; i++)
+    {
+        const FlatSplineNode *node = &fs->node[i];
+        if (node->typ != sp->typ || node->len != n)
+            continue;
+        for (j = 0; j < n; j++)
+        {
+            if (node->loc[j] != sp->loc[j] || node->der[j] != sp->der[j] ||
+                node->val[j] != val[j] || node->child[j] != child[j])
+                break;
+        }
+        if (j == n)
+            return i;
+    }
+    FlatSplineNode *node = &fs->node[fs->len];
+    node->typ = sp->typ;
+    node->len = n;
+    for (j = 0; j < n; j++)
+    {
+        node->loc[j] = sp->loc[j];
+        node->der[j] = sp->der[j];
+        node->val[j] = val[j];
+        node->child[j] = child[j];
+    }
+    return fs->len++;
+}
+
+/* Compiles the terrain spline tree into a flat table. The fixed splines are
+ * inlined as values of their parents, and duplicate splines are merged, so
+ * that the evaluation can skip one of two identical neighbours. The table is
+ * static and built by the first caller, while any others wait for it.
+ */
+const FlatSpline *getFlatSpline(void)
+{
+    int expected = 0;
+    if (ATOMIC_LOAD(&g_fspline_state) == 2)
+        return &g_fspline;
+    if (ATOMIC_CAS(&g_fspline_state, &expected, 1))
+    {
+        g_fspline.root = flattenSpline(&g_fspline,
+            createTerrainSpline(&g_fspline_ss));
+        ATOMIC_STORE(&g_fspline_state, 2);
+    }
+    while (ATOMIC_LOAD(&g_fspline_state) != 2)
+        ;
+    return &g_fspline;
+}
 
-    bn->sp = sp;
+/* Evaluates a flattened spline node. The floating point operations are the
+ * same as in getSpline(), so the results are identical.
+ */
+static float getFlatSplineNode(const FlatSpline *fs, int idx, const float *vals)
+{
+    const FlatSplineNode *node = &fs->node[idx];
+    const float *loc = node->loc;
+    const float *der = node->der;
+    const float *val = node->val;
+    const int16_t *child = node->child;
+    float f = vals[node->typ];
+    int i, len = node->len;
+
+    for (i = 0; i < len; i++)
+        if (loc[i] >= f)
+            break;
+
+    if (i == 0 || i == len)
+    {
+        if (i) i--;
+        float v = child[i] < 0 ? val[i] : getFlatSplineNode(fs, child[i], vals);
+        return v + der[i] * (f - loc[i]);
+    }
+    float g = loc[i-1];
+    float h = loc[i];
+    float k = (f - g) / (h - g);
+    float l = der[i-1];
+    float m = der[i];
+    float n, o;
+    if (child[i] < 0)
+        o = val[i];
+    else
+        o = getFlatSplineNode(fs, child[i], vals);
+    if (child[i-1] < 0)
+        n = val[i-1];
+    else if (child[i-1] == child[i])
+        n = o;
+    else
+        n = getFlatSplineNode(fs, child[i-1], vals);
+    float p = l * (h - g) - (o - n);
+    float q = -m * (h - g) + (o - n);
+    float r = lerp(k, n, o) + k * (1.0F - k) * lerp(k, p, q);
+    return r;
+}
+
+float getFlatSplineValue(const FlatSpline *fs, const float *vals)
+{
+    return getFlatSplineNode(fs, fs->root, vals);
+}
+
+void initBiomeNoise(BiomeNoise *bn, int mc)
+{
+    bn->sp = getFlatSpline();
     bn->mc = mc;
+    bn->lowprec = 0;
+    bn->coarse = 0;
 }
 
 
+static int mapClimateNoise(const BiomeNoise *bn, int64_t *np, int y,
+    float t, float h, float c, float e, float w, const float *spl,
+    uint64_t *dat, uint32_t sample_flags);
+
 /// Biome sampler for MC 1.18
 int sampleBiomeNoise(const BiomeNoise *bn, int64_t *np, int x, int y, int z,
     uint64_t *dat, uint32_t sample_flags)
@@ -981,7 +1127,7 @@ int sampleBiomeNoise(const BiomeNoise *bn, int64_t *np, int x, int y, int z,
         return (int) id;
     }
 
-    float t = 0, h = 0, c = 0, e = 0, d = 0, w = 0;
+    float t = 0, h = 0, c = 0, e = 0, w = 0;
     double px = x, pz = z;
     if (!(sample_flags & SAMPLE_NO_SHIFT))
     {
@@ -992,21 +1138,40 @@ int sampleBiomeNoise(const BiomeNoise *bn, int64_t *np, int x, int y, int z,
     c = sampleDoublePerlin(&bn->climate[NP_CONTINENTALNESS], px, 0, pz);
     e = sampleDoublePerlin(&bn->climate[NP_EROSION], px, 0, pz);
     w = sampleDoublePerlin(&bn->climate[NP_WEIRDNESS], px, 0, pz);
+    t = sampleDoublePerlin(&bn->climate[NP_TEMPERATURE], px, 0, pz);
+    h = sampleDoublePerlin(&bn->climate[NP_HUMIDITY], px, 0, pz);
+
+    return mapClimateNoise(bn, np, y, t, h, c, e, w, NULL, dat, sample_flags);
+}
 
+/* Maps the sampled climate noise at height 'y' to a biome, the way
+ * sampleBiomeNoise() does, including the depth from the terrain splines.
+ * The spline value can be supplied with 'spl' if it is already known.
+ */
+static int mapClimateNoise(const BiomeNoise *bn, int64_t *np, int y,
+    float t, float h, float c, float e, float w, const float *spl,
+    uint64_t *dat, uint32_t sample_flags)
+{
+    float d = 0;
     if (!(sample_flags & SAMPLE_NO_DEPTH))
     {
-        float np_param[] = {
-            c, e, -3.0F * ( fabsf( fabsf(w) - 0.6666667F ) - 0.33333334F ), w,
-        };
-        double off = getSpline(bn->sp, np_param) + 0.015F;
+        double off;
+        if (spl)
+        {
+            off = *spl + 0.015F;
+        }
+        else
+        {
+            float np_param[] = {
+                c, e, -3.0F * ( fabsf( fabsf(w) - 0.6666667F ) - 0.33333334F ), w,
+            };
+            off = getFlatSplineValue(bn->sp, np_param) + 0.015F;
+        }
 
         //double py = y + sampleDoublePerlin(&bn->shift, y, z, x) * 4.0;
         d = 1.0 - (y * 4) / 128.0 - 83.0/160.0 + off;
     }
 
-    t = sampleDoublePerlin(&bn->climate[NP_TEMPERATURE], px, 0, pz);
-    h = sampleDoublePerlin(&bn->climate[NP_HUMIDITY], px, 0, pz);
-
     int64_t l_np[6];
     int64_t *p_np = np ? np : l_np;
     p_np[0] = (int64_t)(10000.0F*t);
@@ -1249,6 +1414,8 @@ int get_resulting_node(const uint64_t np[6], const BiomeTree *bt, int idx,
             uint64_t ds_leaf2;
             if (inner == leaf2)
                 ds_leaf2 = ds_inner;
+            else if (leaf2 < 0) // no alternative leaf
+                ds_leaf2 = -1;
             else
                 ds_leaf2 = get_np_dist(np, bt, leaf2);
             if (ds_leaf2 < ds)
@@ -1266,6 +1433,124 @@ int get_resulting_node(const uint64_t np[6], const BiomeTree *bt, int idx,
     return leaf;
 }
 
+#if USE_X86_SIMD
+/* The distance of a noise point to the parameter box of a node, with the six
+ * dimensions processed in 32-bit lanes. The differences are exact as long as
+ * the noise point and the parameters are within +/-2^30, and their squares
+ * are formed as 64-bit products, so the result equals get_np_dist().
+ */
+ATTR_TARGET("avx2")
+static inline uint64_t get_np_dist_avx2(__m256i p, const BiomeTree *bt, int idx)
+{
+    const __m256i m6 = _mm256_setr_epi32(-1, -1, -1, -1, -1, -1, 0, 0);
+    uint64_t node = bt->nodes[idx];
+    __m256i pi = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(node));
+    pi = _mm256_slli_epi32(_mm256_and_si256(pi, m6), 1);
+    __m256i lo = _mm256_i32gather_epi32(bt->param + 0, pi, 4);
+    __m256i hi = _mm256_i32gather_epi32(bt->param + 1, pi, 4);
+    __m256i d = _mm256_max_epi32(_mm256_sub_epi32(p, hi), _mm256_sub_epi32(lo, p));
+    d = _mm256_and_si256(_mm256_max_epi32(d, _mm256_setzero_si256()), m6);
+    __m256i dh = _mm256_srli_epi64(d, 32);
+    __m256i sq = _mm256_add_epi64(_mm256_mul_epu32(d, d), _mm256_mul_epu32(dh, dh));
+    __m128i s2 = _mm_add_epi64(_mm256_castsi256_si128(sq), _mm256_extracti128_si256(sq, 1));
+    return _mm_cvtsi128_si64(_mm_add_epi64(s2, _mm_unpackhi_epi64(s2, s2)));
+}
+
+/* Same search as get_resulting_node(), but the distances of all the children
+ * are determined up front with the vectorized kernel.
+ */
+ATTR_TARGET("avx2")
+static int get_resulting_node_avx2(__m256i p, const BiomeTree *bt, int idx,
+    int alt, uint64_t ds, int depth)
+{
+    if (bt->steps[depth] == 0)
+        return idx;
+    uint32_t step;
+    do
+    {
+        step = bt->steps[depth];
+        depth++;
+    }
+    while (idx+step >= bt->len);
+
+    uint64_t node = bt->nodes[idx];
+    uint32_t inner = (uint16_t) (node >> 48);
+    uint64_t ds_child[16];
+    uint32_t i, n;
+
+    for (n = 1; n < bt->order && inner + n*step < bt->len; n++);
+    for (i = 0; i < n; i++)
+        ds_child[i] = get_np_dist_avx2(p, bt, inner + i*step);
+
+    int leaf = alt;
+    for (i = 0; i < n; i++, inner += step)
+    {
+        uint64_t ds_inner = ds_child[i];
+        if (ds_inner < ds)
+        {
+            int leaf2 = get_resulting_node_avx2(p, bt, inner, leaf, ds, depth);
+            uint64_t ds_leaf2;
+            if ((int) inner == leaf2)
+                ds_leaf2 = ds_inner;
+            else if (leaf2 < 0)
+                ds_leaf2 = -1;
+            else
+                ds_leaf2 = get_np_dist_avx2(p, bt, leaf2);
+            if (ds_leaf2 < ds)
+            {
+                ds = ds_leaf2;
+                leaf = leaf2;
+            }
+        }
+    }
+
+    return leaf;
+}
+
+ATTR_TARGET("avx2")
+static int get_nearest_leaf_avx2(const BiomeTree *bt, const int32_t p32[8],
+    int alt, uint64_t ds)
+{
+    __m256i p = _mm256_loadu_si256((const __m256i*) p32);
+    return get_resulting_node_avx2(p, bt, 0, alt, ds, 0);
+}
+
+ATTR_TARGET("avx2")
+static int climateToBiomeBatch_avx2(const BiomeTree *bt,
+    const int64_t (*np)[6], int *ids, uint64_t *dat, int n)
+{
+    const int64_t lim = 1 << 30;
+    int i, j;
+    for (i = 0; i < n; i++)
+    {
+        const uint64_t *p = (const uint64_t*) np[i];
+        int32_t p32[8] = {0};
+        for (j = 0; j < 6; j++)
+        {
+            if (np[i][j] <= -lim || np[i][j] >= lim)
+                break;
+            p32[j] = (int32_t) np[i][j];
+        }
+        if (j < 6)
+            return i; // leave the remainder to the scalar search
+
+        __m256i pv = _mm256_loadu_si256((const __m256i*) p32);
+        int alt = 0, idx;
+        uint64_t ds = -1;
+        if (dat)
+        {
+            alt = (int) *dat;
+            ds = get_np_dist(p, bt, alt);
+        }
+        idx = get_resulting_node_avx2(pv, bt, 0, alt, ds, 0);
+        if (dat)
+            *dat = (uint64_t) idx;
+        ids[i] = (bt->nodes[idx] >> 48) & 0xFF;
+    }
+    return n;
+}
+#endif // USE_X86_SIMD
+
 int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
 {
     if (mc < MC_1_18 || mc > MC_NEWEST)
@@ -1292,6 +1577,359 @@ int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat)
 }
 
 
+
+//==============================================================================
+// Climate Index
+//==============================================================================
+
+enum {
+    CELL_SPLIT_MIN = 8,     // cells with more candidates are split further
+    CELL_LIST_MAX = 16,     // larger lists only provide a hint to the search
+    CELL_DEPTH_MAX = 14,
+};
+
+static ClimateIndex *g_cindex[MC_NEWEST - MC_1_18 + 1];
+
+STRUCT(ClimateIndexBuilder)
+{
+    const BiomeTree *bt;
+    int32_t (*box)[6][2];   // parameter ranges of the tree leaves
+    uint16_t *leaf;         // node index of the tree leaves
+    int nleaf;
+    uint16_t *lists;        // candidate lists for each depth
+    int64_t *dmin;
+    ClimateIndex *ci;
+    uint32_t capcells, capcand;
+};
+
+static void collect_leaves(ClimateIndexBuilder *b, int idx, int depth)
+{
+    const BiomeTree *bt = b->bt;
+    if (bt->steps[depth] == 0)
+    {
+        uint64_t node = bt->nodes[idx];
+        int i;
+        for (i = 0; i < 6; i++)
+        {
+            int p = (node >> 8*i) & 0xFF;
+            b->box[b->nleaf][i][0] = bt->param[2*p + 0];
+            b->box[b->nleaf][i][1] = bt->param[2*p + 1];
+        }
+        b->leaf[b->nleaf++] = idx;
+        return;
+    }
+    uint32_t step, i, inner;
+    do
+    {
+        step = bt->steps[depth];
+        depth++;
+    }
+    while (idx+step >= bt->len);
+
+    inner = (uint16_t) (bt->nodes[idx] >> 48);
+    for (i = 0; i < bt->order; i++)
+    {
+        collect_leaves(b, inner, depth);
+        inner += step;
+        if (inner >= bt->len)
+            break;
+    }
+}
+
+static int push_cell(ClimateIndexBuilder *b)
+{
+    ClimateIndex *ci = b->ci;
+    if (ci->ncells == b->capcells)
+    {
+        b->capcells *= 2;
+        ci->cells = (ClimateCell*) realloc(ci->cells, b->capcells * sizeof(ClimateCell));
+    }
+    memset(&ci->cells[ci->ncells], 0, sizeof(ClimateCell));
+    return ci->ncells++;
+}
+
+/* Divides the cell with the bounds [lo, hi] until the leaves that can be the
+ * closest to a point inside the cell are few enough. A leaf whose minimum
+ * distance to the cell exceeds the maximum distance of another leaf can never
+ * be the nearest, and is removed from the candidates. The candidates remain
+ * in the order of the tree, which decides between equally close leaves.
+ */
+static void build_cell(ClimateIndexBuilder *b, int cell, int64_t lo[6],
+    int64_t hi[6], const uint16_t *list, int n, int depth)
+{
+    uint16_t *surv = b->lists + (depth+1) * b->nleaf;
+    int64_t bound = INT64_MAX;
+    int i, j, cnt = 0, best = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        int32_t (*box)[2] = b->box[list[i]];
+        int64_t smin = 0, smax = 0;
+        for (j = 0; j < 6; j++)
+        {
+            int64_t a = box[j][0], c = box[j][1], d;
+            d = lo[j] - c > a - hi[j] ? lo[j] - c : a - hi[j];
+            if (d > 0)
+                smin += d * d;
+            d = a - lo[j] > hi[j] - c ? a - lo[j] : hi[j] - c;
+            if (d > 0)
+                smax += d * d;
+        }
+        b->dmin[i] = smin;
+        if (smax < bound)
+        {
+            bound = smax;
+            best = list[i];
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        if (b->dmin[i] <= bound)
+            surv[cnt++] = list[i];
+    }
+
+    int dim = 0;
+    for (j = 1; j < 6; j++)
+    {
+        if (hi[j] - lo[j] > hi[dim] - lo[dim])
+            dim = j;
+    }
+
+    if (cnt <= CELL_SPLIT_MIN || depth >= CELL_DEPTH_MAX || hi[dim] == lo[dim])
+    {
+        ClimateIndex *ci = b->ci;
+        if (cnt > CELL_LIST_MAX)
+        {   // keep the leaf with the best worst-case distance as a hint
+            surv[0] = best;
+            cnt = 0;
+        }
+        if (ci->ncand + CELL_LIST_MAX > b->capcand)
+        {
+            b->capcand *= 2;
+            ci->cand = (uint16_t*) realloc(ci->cand, b->capcand * sizeof(uint16_t));
+        }
+        ClimateCell *c = &ci->cells[cell];
+        c->dim = CELL_LEAF;
+        c->cnt = cnt;
+        c->next = ci->ncand;
+        for (i = 0; i < (cnt ? cnt : 1); i++)
+            ci->cand[ci->ncand++] = b->leaf[surv[i]];
+        return;
+    }
+
+    int64_t mid = lo[dim] + (hi[dim] - lo[dim]) / 2;
+    int child = push_cell(b);
+    push_cell(b);
+    ClimateCell *c = &b->ci->cells[cell];
+    c->dim = dim;
+    c->split = (int32_t) mid;
+    c->next = child;
+
+    int64_t sub[6];
+    memcpy(sub, hi, sizeof(sub));
+    sub[dim] = mid;
+    build_cell(b, child, lo, sub, surv, cnt, depth+1);
+    memcpy(sub, lo, sizeof(sub));
+    sub[dim] = mid + 1;
+    build_cell(b, child+1, sub, hi, surv, cnt, depth+1);
+}
+
+static ClimateIndex *buildClimateIndex(int mc)
+{
+    clock_t t0 = clock();
+    ClimateIndexBuilder b;
+    const BiomeTree *bt = &g_btree[mc - MC_1_18];
+    ClimateIndex *ci = (ClimateIndex*) calloc(1, sizeof(ClimateIndex));
+    int64_t lo[6], hi[6];
+    int i, j;
+
+    memset(&b, 0, sizeof(b));
+    b.bt = bt;
+    b.box = (int32_t (*)[6][2]) malloc(bt->len * sizeof(*b.box));
+    b.leaf = (uint16_t*) malloc(bt->len * sizeof(*b.leaf));
+    collect_leaves(&b, 0, 0);
+    b.lists = (uint16_t*) malloc((CELL_DEPTH_MAX+2) * b.nleaf * sizeof(uint16_t));
+    b.dmin = (int64_t*) malloc(b.nleaf * sizeof(int64_t));
+    b.ci = ci;
+    b.capcells = 1024;
+    b.capcand = 4096;
+    ci->mc = mc;
+    ci->cells = (ClimateCell*) malloc(b.capcells * sizeof(ClimateCell));
+    ci->cand = (uint16_t*) malloc(b.capcand * sizeof(uint16_t));
+
+    // the index covers the parameter ranges of the leaves
+    for (j = 0; j < 6; j++)
+    {
+        lo[j] = INT32_MAX;
+        hi[j] = INT32_MIN;
+        for (i = 0; i < b.nleaf; i++)
+        {
+            if (b.box[i][j][0] < lo[j]) lo[j] = b.box[i][j][0];
+            if (b.box[i][j][1] > hi[j]) hi[j] = b.box[i][j][1];
+        }
+        ci->lo[j] = (int32_t) lo[j];
+        ci->hi[j] = (int32_t) hi[j];
+    }
+    for (i = 0; i < b.nleaf; i++)
+        b.lists[i] = i;
+
+    push_cell(&b);
+    build_cell(&b, 0, lo, hi, b.lists, b.nleaf, 0);
+
+    free(b.box);
+    free(b.leaf);
+    free(b.lists);
+    free(b.dmin);
+    ci->cells = (ClimateCell*) realloc(ci->cells, ci->ncells * sizeof(ClimateCell));
+    ci->cand = (uint16_t*) realloc(ci->cand, ci->ncand * sizeof(uint16_t));
+    ci->bytes = sizeof(*ci) + ci->ncells * sizeof(ClimateCell)
+        + ci->ncand * sizeof(uint16_t);
+    ci->buildms = 1e3 * (clock() - t0) / CLOCKS_PER_SEC;
+    return ci;
+}
+
+const ClimateIndex *getClimateIndex(int mc)
+{
+    if (mc < MC_1_18 || mc > MC_NEWEST)
+        return NULL;
+    ClimateIndex **slot = &g_cindex[mc - MC_1_18];
+    ClimateIndex *ci = ATOMIC_LOAD(slot);
+    if (ci)
+        return ci;
+    ClimateIndex *expected = NULL;
+    ci = buildClimateIndex(mc);
+    if (!ATOMIC_CAS(slot, &expected, ci))
+    {   // another thread was faster
+        free(ci->cells);
+        free(ci->cand);
+        free(ci);
+        ci = expected;
+    }
+    return ci;
+}
+
+/* Looks up the nearest leaf to a noise point, i.e. the result of the tree
+ * search without a 'dat' hint, which is the first of the closest leaves in the
+ * order of the tree. If the cell of the point is ambiguous, the return value
+ * is -1 and 'hint' is set to a leaf that is likely to be close.
+ */
+static int lookupClimateIndex(const ClimateIndex *ci, const BiomeTree *bt,
+    const uint64_t np[6], int *hint)
+{
+    const ClimateCell *c = ci->cells;
+    int i, inside = 1;
+    for (i = 0; i < 6; i++)
+        inside &= (int64_t)np[i] >= ci->lo[i] && (int64_t)np[i] <= ci->hi[i];
+    while (c->dim != CELL_LEAF)
+        c = &ci->cells[c->next + ((int64_t)np[c->dim] > c->split)];
+
+    const uint16_t *cand = ci->cand + c->next;
+    if (c->cnt == 0 || !inside)
+    {
+        *hint = cand[0];
+        return -1;
+    }
+    int leaf = cand[0];
+    if (c->cnt > 1)
+    {
+        uint64_t ds = get_np_dist(np, bt, leaf);
+        for (i = 1; i < c->cnt; i++)
+        {
+            uint64_t d = get_np_dist(np, bt, cand[i]);
+            if (d < ds)
+            {
+                ds = d;
+                leaf = cand[i];
+            }
+        }
+    }
+    return leaf;
+}
+
+/* Maps a noise point with the help of the index. Starting the tree search
+ * with a bound just above the distance of a known leaf (and without an
+ * alternative leaf) still finds the first of the nearest leaves, but prunes
+ * most of the tree.
+ */
+static int climateToBiomeIndexed_(const ClimateIndex *ci, const BiomeTree *bt,
+    const uint64_t np[6], uint64_t *dat, int simd)
+{
+    const int64_t lim = 1 << 30;
+    int32_t p32[8] = {0};
+    int i, hint, leaf;
+
+    for (i = 0; i < 6; i++)
+    {
+        if ((int64_t)np[i] <= -lim || (int64_t)np[i] >= lim)
+            return climateToBiome(ci->mc, np, dat);
+        p32[i] = (int32_t) np[i];
+    }
+
+    leaf = lookupClimateIndex(ci, bt, np, &hint);
+    if (leaf < 0)
+    {
+        uint64_t ds = get_np_dist(np, bt, hint) + 1;
+#if USE_X86_SIMD
+        if (simd)
+            leaf = get_nearest_leaf_avx2(bt, p32, -1, ds);
+        else
+#endif
+            leaf = get_resulting_node(np, bt, 0, -1, ds, 0);
+    }
+    (void) simd;
+
+    if (dat)
+    {   // the tree search keeps the previous leaf, unless it finds a closer one
+        int alt = (int) *dat;
+        if (alt != leaf && !(get_np_dist(np, bt, leaf) < get_np_dist(np, bt, alt)))
+            leaf = alt;
+        *dat = (uint64_t) leaf;
+    }
+    return (bt->nodes[leaf] >> 48) & 0xFF;
+}
+
+int climateToBiomeIndexed(const ClimateIndex *ci, const uint64_t np[6],
+    uint64_t *dat)
+{
+    return climateToBiomeIndexed_(ci, &g_btree[ci->mc - MC_1_18], np, dat,
+        getSimdLevel() >= SIMD_AVX2);
+}
+
+int climateToBiomeBatch(int mc, const int64_t (*np)[6], int *ids,
+    uint64_t *dat, int n)
+{
+    if (mc < MC_1_18 || mc > MC_NEWEST)
+        return -1;
+
+    const BiomeTree *bt = &g_btree[mc - MC_1_18];
+    const ClimateIndex *ci = ATOMIC_LOAD(&g_cindex[mc - MC_1_18]);
+    int simd = getSimdLevel() >= SIMD_AVX2;
+    int i = 0;
+    if (ci)
+    {
+        for (i = 0; i < n; i++)
+            ids[i] = climateToBiomeIndexed_(ci, bt, (const uint64_t*) np[i], dat, simd);
+        return 0;
+    }
+#if USE_X86_SIMD
+    if (simd)
+    {
+        while (i < n)
+        {
+            i += climateToBiomeBatch_avx2(bt, np+i, ids+i, dat, n-i);
+            if (i < n)
+            {   // point out of range for the 32-bit kernel
+                ids[i] = climateToBiome(mc, (const uint64_t*) np[i], dat);
+                i++;
+            }
+        }
+    }
+#endif
+    for (; i < n; i++)
+        ids[i] = climateToBiome(mc, (const uint64_t*) np[i], dat);
+    return 0;
+}
+
 void setClimateParaSeed(BiomeNoise *bn, uint64_t seed, int large, int nptype, int nmax)
 {
     Xoroshiro pxr;
@@ -1327,7 +1965,7 @@ double sampleClimatePara(const BiomeNoise *bn, int64_t *np, double x, double z)
         float np_param[] = {
             c, e, -3.0F * ( fabsf( fabsf(w) - 0.6666667F ) - 0.33333334F ), w,
         };
-        double off = getSpline(bn->sp, np_param) + 0.015F;
+        double off = getFlatSplineValue(bn->sp, np_param) + 0.015F;
         int y = 0;
         float d = 1.0 - (y * 4) / 128.0 - 83.0/160.0 + off;
         if (np)
@@ -1368,12 +2006,125 @@ void genBiomeNoiseChunkSection(const BiomeNoise *bn, int out[4][4][4],
     }
 }
 
+/* Maps a row of up to 64 climate samples to biomes at height 'y', the same
+ * way as mapClimateNoise(), with the depth splines evaluated up front.
+ */
+static void mapClimateRow(const BiomeNoise *bn, int *out, int n, int y,
+    const double *t, const double *h, const double *c, const double *e,
+    const double *w, uint64_t *dat, uint32_t sample_flags)
+{
+    enum { ROW_LEN = 64 };
+    float spl[ROW_LEN];
+    int64_t np[ROW_LEN][6];
+    int i;
+
+    if (!(sample_flags & SAMPLE_NO_DEPTH))
+    {
+        for (i = 0; i < n; i++)
+        {
+            float fw = w[i];
+            float vals[] = {
+                (float) c[i], (float) e[i],
+                -3.0F * ( fabsf( fabsf(fw) - 0.6666667F ) - 0.33333334F ), fw
+            };
+            spl[i] = getFlatSplineValue(bn->sp, vals);
+        }
+    }
+    for (i = 0; i < n; i++)
+    {
+        out[i] = mapClimateNoise(bn, np[i], y, t[i], h[i], c[i], e[i],
+            w[i], spl+i, dat, sample_flags | SAMPLE_NO_BIOME);
+    }
+    if (!(sample_flags & SAMPLE_NO_BIOME))
+        climateToBiomeBatch(bn->mc, (const int64_t (*)[6]) np, out, dat, n);
+}
+
+/* Samples a row of 'n' biomes, at the positions x = x0 + i*dx, which is
+ * equivalent to calling sampleBiomeNoise() for each of them in order, but
+ * evaluates the climate noise and the biome mapping in batches.
+ */
+static void sampleBiomeNoiseRow(const BiomeNoise *bn, int *out,
+    int x0, int dx, int n, int y, int z, uint64_t *dat, uint32_t sample_flags)
+{
+    enum { ROW_LEN = 64 };
+    double xs[ROW_LEN], zs[ROW_LEN], zero[ROW_LEN];
+    double px[ROW_LEN], pz[ROW_LEN], sh[ROW_LEN];
+    double t[ROW_LEN], h[ROW_LEN], c[ROW_LEN], e[ROW_LEN], w[ROW_LEN];
+    float v[ROW_LEN];
+    int i, j, k, m;
+
+    if (bn->nptype >= 0)
+    {
+        for (i = 0; i < n; i++)
+            out[i] = sampleBiomeNoise(bn, NULL, x0+i*dx, y, z, dat, sample_flags);
+        return;
+    }
+
+    for (i = 0; i < ROW_LEN; i++)
+    {
+        zero[i] = 0;
+        zs[i] = z;
+    }
+
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < ROW_LEN ? n - k : ROW_LEN;
+
+        if ((sample_flags & SAMPLE_NO_SHIFT) && bn->lowprec)
+        {
+            const DoublePerlinNoise *cl = bn->climate;
+            double xk = x0 + k*dx;
+            double *dst[] = { c, e, w, t, h };
+            int np[] = { NP_CONTINENTALNESS, NP_EROSION, NP_WEIRDNESS,
+                NP_TEMPERATURE, NP_HUMIDITY };
+            for (j = 0; j < 5; j++)
+            {
+                sampleDoublePerlinRowFloat(&cl[np[j]], v, xk, dx, m, 0, z);
+                for (i = 0; i < m; i++)
+                    dst[j][i] = v[i];
+            }
+        }
+        else if (sample_flags & SAMPLE_NO_SHIFT)
+        {   // regular row: sweep along x reusing the lattice state
+            const DoublePerlinNoise *cl = bn->climate;
+            double xk = x0 + k*dx;
+            sampleDoublePerlinRow(&cl[NP_CONTINENTALNESS], c, xk, dx, m, 0, z);
+            sampleDoublePerlinRow(&cl[NP_EROSION], e, xk, dx, m, 0, z);
+            sampleDoublePerlinRow(&cl[NP_WEIRDNESS], w, xk, dx, m, 0, z);
+            sampleDoublePerlinRow(&cl[NP_TEMPERATURE], t, xk, dx, m, 0, z);
+            sampleDoublePerlinRow(&cl[NP_HUMIDITY], h, xk, dx, m, 0, z);
+        }
+        else
+        {
+            const DoublePerlinNoise *cl = bn->climate;
+            for (i = 0; i < m; i++)
+                xs[i] = px[i] = x0 + (k+i)*dx;
+            for (i = 0; i < m; i++)
+                pz[i] = z;
+            sampleDoublePerlinBatch(&cl[NP_SHIFT], xs, zero, zs, sh, m);
+            for (i = 0; i < m; i++)
+                px[i] += sh[i] * 4.0;
+            sampleDoublePerlinBatch(&cl[NP_SHIFT], zs, xs, zero, sh, m);
+            for (i = 0; i < m; i++)
+                pz[i] += sh[i] * 4.0;
+
+            sampleDoublePerlinBatch(&cl[NP_CONTINENTALNESS], px, zero, pz, c, m);
+            sampleDoublePerlinBatch(&cl[NP_EROSION], px, zero, pz, e, m);
+            sampleDoublePerlinBatch(&cl[NP_WEIRDNESS], px, zero, pz, w, m);
+            sampleDoublePerlinBatch(&cl[NP_TEMPERATURE], px, zero, pz, t, m);
+            sampleDoublePerlinBatch(&cl[NP_HUMIDITY], px, zero, pz, h, m);
+        }
+
+        mapClimateRow(bn, out+k, m, y, t, h, c, e, w, dat, sample_flags);
+    }
+}
+
 static void genBiomeNoise3D(const BiomeNoise *bn, int *out, Range r, int opt)
 {
     uint64_t dat = 0;
     uint64_t *p_dat = opt ? &dat : NULL;
     uint32_t flags = opt ? SAMPLE_NO_SHIFT : 0;
-    int i, j, k;
+    int j, k;
     int *p = out;
     int scale = r.scale > 4 ? r.scale / 4 : 1;
     int mid = scale / 2;
@@ -1383,14 +2134,71 @@ static void genBiomeNoise3D(const BiomeNoise *bn, int *out, Range r, int opt)
         for (j = 0; j < r.sz; j++)
         {
             int zj = (r.z+j)*scale + mid;
-            for (i = 0; i < r.sx; i++)
+            int x0 = r.x*scale + mid;
+            sampleBiomeNoiseRow(bn, p, x0, scale, r.sx, yk, zj, p_dat, flags);
+            p += r.sx;
+        }
+    }
+}
+
+/* Approximate generation for previews, where the climate is only sampled on
+ * a lattice of 'step' cells and interpolated bilinearly in between.
+ */
+static void genBiomeNoiseCoarse(const BiomeNoise *bn, int *out, Range r,
+    int step)
+{
+    enum { ROW_LEN = 64 };
+    static const int cl_id[] = {
+        NP_TEMPERATURE, NP_HUMIDITY, NP_CONTINENTALNESS, NP_EROSION,
+        NP_WEIRDNESS,
+    };
+    double v[5][ROW_LEN];
+    uint64_t dat = 0;
+    int scale = r.scale / 4;
+    int mid = scale / 2;
+    int nx = (r.sx - 1) / step + 2;
+    int nz = (r.sz - 1) / step + 2;
+    int i, j, k, l, m, n;
+
+    double *lat = (double*) malloc(sizeof(double) * 5 * nx * nz);
+    for (l = 0; l < 5; l++)
+    {
+        const DoublePerlinNoise *dpn = &bn->climate[cl_id[l]];
+        for (j = 0; j < nz; j++)
+        {
+            int z = (r.z + j*step)*scale + mid;
+            sampleDoublePerlinRow(dpn, lat + (l*nz + j)*nx, r.x*scale + mid,
+                scale*step, nx, 0, z);
+        }
+    }
+
+    for (j = 0; j < r.sz; j++)
+    {
+        int jz = j / step;
+        double fz = (j % step) / (double) step;
+        for (i = 0; i < r.sx; i += n)
+        {
+            n = r.sx - i < ROW_LEN ? r.sx - i : ROW_LEN;
+            for (l = 0; l < 5; l++)
             {
-                int xi = (r.x+i)*scale + mid;
-                *p = sampleBiomeNoise(bn, NULL, xi, yk, zj, p_dat, flags);
-                p++;
+                const double *p0 = lat + (l*nz + jz)*nx;
+                const double *p1 = p0 + nx;
+                for (m = 0; m < n; m++)
+                {
+                    int ix = (i+m) / step;
+                    double fx = ((i+m) % step) / (double) step;
+                    v[l][m] = lerp2(fx, fz, p0[ix], p0[ix+1], p1[ix], p1[ix+1]);
+                }
+            }
+            for (k = 0; k < r.sy; k++)
+            {
+                int *p = out + (int64_t)k*r.sx*r.sz + (int64_t)j*r.sx + i;
+                mapClimateRow(bn, p, n, r.y+k, v[0], v[1], v[2], v[3], v[4],
+                    &dat, SAMPLE_NO_SHIFT);
             }
         }
     }
+    free(lat);
 }
 
 int genBiomeNoiseScaled(const BiomeNoise *bn, int *out, Range r, uint64_t sha)
@@ -1445,7 +2253,10 @@ int genBiomeNoiseScaled(const BiomeNoise *bn, int *out, Range r, uint64_t sha)
         // than 1:4, the accuracy becomes questionable anyway. Furthermore
         // situations that want to use a higher scale are usually better off
         // with a faster, if imperfect, result.
-        genBiomeNoise3D(bn, out, r, r.scale > 4);
+        if (bn->coarse > 1 && r.scale >= 16)
+            genBiomeNoiseCoarse(bn, out, r, bn->coarse);
+        else
+            genBiomeNoise3D(bn, out, r, r.scale > 4);
     }
     return 0;
 }
@@ -114,6 +114,22 @@ STRUCT(SplineStack)
     int len, flen;
 };
 
+STRUCT(FlatSplineNode)
+{
+    uint8_t typ, len;
+    int16_t child[12];  // index of the child node, or -1 for a fixed value
+    float loc[12];
+    float der[12];
+    float val[12];
+};
+
+// Flattened terrain spline tree with the fixed splines inlined as values
+STRUCT(FlatSpline)
+{
+    FlatSplineNode node[42];
+    int len, root;
+};
+
 
 enum
 {
@@ -125,15 +141,25 @@ enum
     NP_WEIRDNESS        = 5,
     NP_MAX
 };
+STRUCT(BiomeTree)
+{
+    const uint32_t *steps;
+    const int32_t  *param;
+    const uint64_t *nodes;
+    uint32_t order;
+    uint32_t len;
+};
+
 // Overworld biome generator for 1.18+
 STRUCT(BiomeNoise)
 {
     DoublePerlinNoise climate[NP_MAX];
     PerlinNoise oct[2*23]; // buffer for octaves in double perlin noise
-    Spline *sp;
-    SplineStack ss;
+    const FlatSpline *sp; // shared terrain splines for the depth
     int nptype;
     int mc;
+    int lowprec; // sample the climate in single precision (not exact)
+    int coarse; // climate lattice step in cells at 1:16+, interpolated (not exact)
 };
 // Overworld biome generator for pre-Beta 1.8
 STRUCT(BiomeNoiseBeta)
@@ -145,15 +171,28 @@ STRUCT(BiomeNoiseBeta)
 };
 
 
-STRUCT(BiomeTree)
+// Acceleration structure for the climate to biome mapping (see below)
+STRUCT(ClimateCell)
 {
-    const uint32_t *steps;
-    const int32_t  *param;
-    const uint64_t *nodes;
-    uint32_t order;
-    uint32_t len;
+    int32_t split;  // inner cell: upper bound of the lower child
+    uint32_t next;  // inner cell: index of the lower child, else candidates
+    uint8_t dim;    // split dimension, or CELL_LEAF
+    uint8_t cnt;    // number of candidate leaves, zero if ambiguous
 };
 
+STRUCT(ClimateIndex)
+{
+    int mc;
+    int32_t lo[6], hi[6];   // bounds of the indexed climate space
+    ClimateCell *cells;
+    uint16_t *cand;         // candidate leaf nodes of the cells
+    uint32_t ncells, ncand;
+    double buildms;         // build time in milliseconds
+    size_t bytes;           // memory footprint
+};
+
+enum { CELL_LEAF = 0xff };
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -266,6 +305,40 @@ int getOldBetaBiome(float t, float h);
  * (i.e. climate) to the corresponding overworld biome.
  */
 int climateToBiome(int mc, const uint64_t np[6], uint64_t *dat);
+/**
+ * Maps 'n' noise points to biomes, equivalent to calling climateToBiome() for
+ * each of them in order, with 'dat' (nullable) carried from one point to the
+ * next. The distances to the child nodes are evaluated with SIMD if available.
+ * Returns zero upon success.
+ */
+int climateToBiomeBatch(int mc, const int64_t (*np)[6], int *ids,
+    uint64_t *dat, int n);
+
+/**
+ * Optional acceleration structure for climateToBiome(). The climate space of
+ * a version is divided into a k-d tree of cells, which hold either a definite
+ * leaf of the biome tree, or a short list of candidate leaves. Noise points
+ * that cannot be decided from their cell (because of ties or ambiguous cells)
+ * fall back to the exact tree search, so the results are always identical.
+ *
+ * getClimateIndex() builds the index for a version on first use and returns
+ * the shared read-only instance, which is safe to use from multiple threads.
+ * Once built, climateToBiomeBatch() also uses it. Returns NULL for versions
+ * without a biome tree.
+ */
+const ClimateIndex *getClimateIndex(int mc);
+int climateToBiomeIndexed(const ClimateIndex *ci, const uint64_t np[6],
+    uint64_t *dat);
+
+/**
+ * The terrain splines, which determine the depth for the overworld biomes,
+ * are the same for all seeds and versions. getFlatSpline() compiles them once
+ * into a contiguous table that is shared (read-only) between all BiomeNoise
+ * instances. getFlatSplineValue() evaluates the table for the spline
+ * parameters {continentalness, erosion, peaks & valleys, weirdness}.
+ */
+const FlatSpline *getFlatSpline(void);
+float getFlatSplineValue(const FlatSpline *fs, const float *vals);
 
 /**
  * Initialize BiomeNoise for only a single climate parameter.
@@ -293,6 +366,13 @@ void genBiomeNoiseChunkSection(const BiomeNoise *bn, int out[4][4][4],
  * The scaled biome noise generation applies for the Overworld version 1.18+.
  * The 'sha' hash of the seed is only required for voronoi at scale 1:1.
  * A scale of zero is interpreted as the default 1:4 scale.
+ * If 'bn->lowprec' is set, the scales 1:16 and above sample the climate in
+ * single precision, which is faster but can differ in a few positions.
+ * If 'bn->coarse' is larger than one, the scales 1:16 and above sample the
+ * climate only on a lattice of that many cells and interpolate in between.
+ * This is intended for previews and overviews. The lattice grows with the
+ * scale, so the biomes differ more at higher scales: with every second cell
+ * about 2% at 1:16, 17% at 1:64 and 47% at 1:256, for 1.25x to 1.4x the speed.
  */
 int genBiomeNoiseScaled(const BiomeNoise *bn, int *out, Range r, uint64_t sha);
 
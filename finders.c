@@ -3837,7 +3837,7 @@ L_has_proto_mushroom:
         mem1x1 = getMinLayerCacheSize(entry, 1, 1);
         if (mem1x1 * 2 < memsiz)
         {
-            setLayerSeed(entry, seed);
+            updateLayerSeed(entry, seed);
             err = testExclusion(entry, ids, x+w/2, z+h/2, filter);
         }
         if (mem1x1 * 5 < memsiz)
@@ -3867,7 +3867,7 @@ L_has_proto_mushroom:
     swapMap(fd+8, filter, l+L_SPECIAL_1024,   mapFilterSpecial);
 
     ret = 0;
-    setLayerSeed(entry, seed);
+    updateLayerSeed(entry, seed);
     err = entry->getMap(entry, ids, x, z, w, h);
     if (err == 0)
     {
@@ -3947,7 +3947,7 @@ int checkForTemps(LayerStack *g, uint64_t seed, int x, int z, int w, int h, cons
     int *area = (int*) calloc(getMinLayerCacheSize(l, w, h), sizeof(int));
     int ret = 1;
 
-    setLayerSeed(l, seed);
+    updateLayerSeed(l, seed);
     genArea(l, area, x, z, w, h);
 
     for (i = 0; i < w*h; i++)
@@ -4088,7 +4088,16 @@ int getBiomeCenters(Pos *pos, int *siz, int nmax, Generator *g, Range r,
                     DoublePerlinNoise *dpn = &g->bn.climate[para[k]];
                     double px = (r.x+i) * r.scale / 4.0;
                     double pz = (r.z+j) * r.scale / 4.0;
-                    int p = 10000 * sampleDoublePerlin(dpn, px, 0, pz);
+                    // the truncated value can only be within the limits if
+                    // the noise is within one unit of them
+                    double v, lo = (plim[0] - 1.0) / 10000.0;
+                    double hi = (plim[1] + 1.0) / 10000.0;
+                    if (sampleDoublePerlinBounded(dpn, px, 0, pz, lo, hi, &v))
+                    {
+                        ids[j*r.sx + i] = -2;
+                        break;
+                    }
+                    int p = 10000 * v;
                     if (p < plim[0] || p > plim[1])
                     {
                         ids[j*r.sx + i] = -2;
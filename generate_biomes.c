@@ -7,20 +7,6 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <errno.h>
-#include <pthread.h>
-
-#define NUM_THREADS 4 // Adjust this based on the number of CPU cores
-
-typedef struct {
-    unsigned char *rgb;
-    unsigned char (*biomeColors)[3];
-    int *biomeIds;
-    int startRow;
-    int endRow;
-    int pix4cell;
-    int sx;
-    int sz;
-} BiomeToImageArgs;
 
 // Function to recursively create directories
 int createDir(const char *path) {
@@ -43,27 +29,6 @@ int createDir(const char *path) {
     return 0;
 }
 
-// Function to convert biomes to image (parallelized)
-void* biomesToImageParallel(void *args) {
-    BiomeToImageArgs *data = (BiomeToImageArgs *)args;
-    int i, j, k;
-    for (i = data->startRow; i < data->endRow; i++) {
-        for (j = 0; j < data->sx; j++) {
-            int biomeId = data->biomeIds[i * data->sx + j];
-            for (k = 0; k < data->pix4cell; k++) {
-                int pixIdx = (i * data->pix4cell + k) * (data->sx * data->pix4cell) + (j * data->pix4cell);
-                for (int m = 0; m < data->pix4cell; m++) {
-                    int idx = 3 * (pixIdx + m);
-                    data->rgb[idx] = data->biomeColors[biomeId][0];
-                    data->rgb[idx + 1] = data->biomeColors[biomeId][1];
-                    data->rgb[idx + 2] = data->biomeColors[biomeId][2];
-                }
-            }
-        }
-    }
-    pthread_exit(NULL);
-}
-
 int main(int argc, char *argv[]) {
     if (argc != 2) {
         fprintf(stderr, "Usage: %s <seed>\n", argv[0]);
@@ -90,27 +55,9 @@ int main(int argc, char *argv[]) {
 
     unsigned char *rgb = (unsigned char *)malloc(3 * imgWidth * imgHeight);
 
-    // Parallelize biomesToImage using pthreads
-    pthread_t threads[NUM_THREADS];
-    BiomeToImageArgs threadArgs[NUM_THREADS];
-    int rowsPerThread = r.sz / NUM_THREADS;
-
-    for (int i = 0; i < NUM_THREADS; i++) {
-        threadArgs[i].rgb = rgb;
-        threadArgs[i].biomeColors = biomeColors;
-        threadArgs[i].biomeIds = biomeIds;
-        threadArgs[i].startRow = i * rowsPerThread;
-        threadArgs[i].endRow = (i == NUM_THREADS - 1) ? r.sz : (i + 1) * rowsPerThread;
-        threadArgs[i].pix4cell = pix4cell;
-        threadArgs[i].sx = r.sx;
-        threadArgs[i].sz = r.sz;
-        pthread_create(&threads[i], NULL, biomesToImageParallel, (void *)&threadArgs[i]);
-    }
-
-    // Wait for all threads to complete
-    for (int i = 0; i < NUM_THREADS; i++) {
-        pthread_join(threads[i], NULL);
-    }
+    // Draw the image with a thread per CPU
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    biomesToImageParallel(rgb, biomeColors, biomeIds, r.sx, r.sz, pix4cell, 1, numThreads);
 
     const char *dirUrl = "/var/www/production/gme-backend/storage/app/public/images/seeds";
 
@@ -1,6 +1,8 @@
 #include "generator.h"
 #include "util.h"
 #include "image_utils.h"
+#include "tile_pack.h"
+#include "biome_grid.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -11,11 +13,24 @@
 #include <time.h>
 #include <pthread.h>
 
+// Renders the map tiles of the zoom levels of a seed, as PNG files or into a
+// tile pack. The tiles are generated by a pool of workers (one per online CPU,
+// or TILE_WORKERS) that steal each other's jobs, with the centre tiles first.
+// The scaling of the pool was only tested on a single core. On many cores the
+// parts that are serialized between the workers may limit it (see
+// runTileJobs()).
+
 int totalTiles = 0;
 int completedTiles = 0;
 time_t startTime;
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+Generator generator;     // seeded once, then only read by the workers
+unsigned char biomeColors[256][3];
+TilePack tilePack;       // replaces the tile directories if TILE_PACK is set
+int usePack = 0;
+TilePack gridPack;       // keeps the biome grids of the tiles if GRID_PACK is set
+int useGridPack = 0;
 
 // Define the batch size
 #define BATCH_SIZE 100
@@ -53,10 +68,8 @@ int createDir(const char *path) {
     return 0;
 }
 
-void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSize, const char *outputDir, int zoomLevel, int scale) {
-    setupGenerator(g, MC_1_18, LARGE_BIOMES);
-    applySeed(g, DIM_OVERWORLD, seed);
-
+// Generates the biomes of a tile into a new buffer (NULL on failure).
+int *generateTileBiomes(const Generator *g, int tileX, int tileY, int tileSize, int scale) {
     Range r = {
         .scale = scale,
         .x = tileX * tileSize,
@@ -70,32 +83,31 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     int *biomeIds = allocCache(g, r);
     if (!biomeIds) {
         fprintf(stderr, "Error allocating memory for biomes\n");
-        return;
+        return NULL;
     }
 
     genBiomes(g, biomeIds, r);
+    return biomeIds;
+}
 
+void saveTile(const int *biomeIds, uint64_t seed, int tileX, int tileY, int tileSize, const char *outputDir, int zoomLevel) {
     int pix4cell = 4;
-    int imgWidth = pix4cell * r.sx;
-    int imgHeight = pix4cell * r.sz;
-
-    unsigned char *rgb = (unsigned char *)malloc(3 * imgWidth * imgHeight);
-    if (!rgb) {
-        fprintf(stderr, "Error allocating memory for image\n");
-        free(biomeIds); // Ensure biomeIds is freed
-        return;
-    }
-
-    unsigned char biomeColors[256][3];
-    initBiomeColors(biomeColors);
-
-    biomesToImage(rgb, biomeColors, biomeIds, r.sx, r.sz, pix4cell, 2);
 
     char tileDir[4096], outputFile[8192];
-    snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, seed, zoomLevel, tileX);
-    snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, tileY);
+    int err;
+    if (usePack) {
+        size_t size;
+        unsigned char *png = encodePNGIndexed(biomeIds, tileSize, tileSize, pix4cell, biomeColors, &size);
+        err = !png || tilePackPut(&tilePack, seed, zoomLevel, tileX, tileY, png, size) != 0;
+        free(png);
+        snprintf(outputFile, sizeof(outputFile), "%s:%lu/%d/%d/%d", tilePack.path, seed, zoomLevel, tileX, tileY);
+    } else {
+        snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, seed, zoomLevel, tileX);
+        snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, tileY);
+        err = createDir(tileDir) != 0 || savePNGIndexed(outputFile, biomeIds, tileSize, tileSize, pix4cell, biomeColors) != 0;
+    }
 
-    if (createDir(tileDir) != 0 || savePNG(outputFile, rgb, imgWidth, imgHeight) != 0) {
+    if (err) {
         fprintf(stderr, "Error saving image file for tile %d_%d at zoom level %d\n", tileX, tileY, zoomLevel);
     } else {
         pthread_mutex_lock(&mutex);
@@ -106,37 +118,72 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
                 completedTiles, totalTiles, outputFile, estimatedTotalTime - elapsedSeconds);
         pthread_mutex_unlock(&mutex);
     }
-
-    // Free allocated memory
-    free(biomeIds);
-    free(rgb);
 }
 
-typedef struct {
+// Pyramid modes: the finest zoom level is generated, and the coarser levels
+// are derived from the biome grid of the next finer level where it covers
+// them (each coarse cell from a 2x2 block of fine cells). All of them are
+// approximate: a coarse cell samples the climate at a point that none of its
+// fine cells sample, so no mode can reproduce the direct generation exactly.
+// PYRAMID_CHECK=1 compares the derived tiles against the direct generation.
+enum {
+    PYRAMID_OFF,        // generate every zoom level from scratch
+    PYRAMID_MAJORITY,   // most frequent biome of the block
+    PYRAMID_NEAREST,    // biome of the fine cell nearest to the coarse sample
+    PYRAMID_RESAMPLE,   // uniform blocks are kept, all others are resampled
+};
+
+int pyramidMode = PYRAMID_OFF;
+int tilesDerived = 0;
+int pyramidCheck = 0;
+long cellsChecked = 0, cellsDiffer = 0;
+
+typedef struct ZoomLevelParams {
     uint64_t seed;
     const char *outputDir;
     int zoomLevel;
     int scale;
     int base_tile_size;
     int tile_count;
+    const struct ZoomLevelParams *finer; // level to derive tiles from (pyramid)
+    int *grid;          // biomes of the whole level, kept for a coarser level
 } ZoomLevelParams;
 
-void *generateTilesForZoomLevel(void *arg) {
-    ZoomLevelParams *params = (ZoomLevelParams *)arg;
-    int tileSize = params->base_tile_size;
-    Generator g;
+typedef struct {
+    const ZoomLevelParams *params;
+    int x, y;
+    int rank; // position in the spiral of its zoom level
+} TileJob;
+
+// Deque of tile jobs owned by one worker. The owner takes jobs from the head,
+// where the centre tiles are, while idle workers steal from the tail.
+typedef struct {
+    TileJob *jobs;
+    int head, tail;
+    pthread_mutex_t lock;
+} TileDeque;
+
+typedef struct {
+    int id;
+    int numWorkers;
+    TileDeque *deques;
+} WorkerParams;
 
-    // Initialize spiral parameters
+// Lists the tiles of a zoom level in spiral order, starting at the centre.
+int spiralOrder(const ZoomLevelParams *params, TileJob *jobs) {
     int x = params->tile_count / 2;
     int y = x;
     int dx = 0, dy = -1;
     int segmentLength = 1, segmentPassed = 0, turnsMade = 0;
-
-    setupGenerator(&g, MC_1_18, LARGE_BIOMES);
+    int n = 0;
 
     for (int i = 0; i < params->tile_count * params->tile_count; ++i) {
         if (x >= 0 && x < params->tile_count && y >= 0 && y < params->tile_count) {
-            generateTile(&g, params->seed, x, y, tileSize, params->outputDir, params->zoomLevel, params->scale);
+            jobs[n].params = params;
+            jobs[n].x = x;
+            jobs[n].y = y;
+            jobs[n].rank = n;
+            n++;
         }
 
         // Spiral logic
@@ -150,24 +197,268 @@ void *generateTilesForZoomLevel(void *arg) {
             segmentPassed = 0;
             if (++turnsMade % 2 == 0) segmentLength++;
         }
+    }
+    return n;
+}
+
+int compareTileJobs(const void *a, const void *b) {
+    const TileJob *ja = (const TileJob *)a, *jb = (const TileJob *)b;
+    if (ja->rank != jb->rank)
+        return ja->rank < jb->rank ? -1 : 1;
+    return ja->params->zoomLevel - jb->params->zoomLevel;
+}
+
+int takeJob(TileDeque *dq, TileJob *job, int steal) {
+    int ok = 0;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->head < dq->tail) {
+        *job = steal ? dq->jobs[--dq->tail] : dq->jobs[dq->head++];
+        ok = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return ok;
+}
+
+// Derives a tile from the 2x2 tiles below it in the finer zoom level.
+void downsampleTile(const Generator *g, const ZoomLevelParams *params, int tileX, int tileY, int *biomeIds) {
+    const ZoomLevelParams *fine = params->finer;
+    int tileSize = params->base_tile_size;
+    int w = fine->tile_count * fine->base_tile_size;
+
+    for (int j = 0; j < tileSize; j++) {
+        int z = tileY * tileSize + j;
+        for (int i = 0; i < tileSize; i++) {
+            int x = tileX * tileSize + i;
+            const int *f = &fine->grid[(size_t)(2 * z) * w + 2 * x];
+            int c[4] = { f[w + 1], f[0], f[1], f[w] }; // nearest sample first
+            int id = c[0];
+
+            if (pyramidMode == PYRAMID_MAJORITY) {
+                int best = 0;
+                for (int k = 0; k < 4; k++) {
+                    int cnt = (c[0] == c[k]) + (c[1] == c[k]) + (c[2] == c[k]) + (c[3] == c[k]);
+                    if (cnt > best) {
+                        best = cnt;
+                        id = c[k];
+                    }
+                }
+            } else if (pyramidMode == PYRAMID_RESAMPLE) {
+                if (c[1] != id || c[2] != id || c[3] != id)
+                    id = getBiomeAt(g, params->scale, x, 15, z);
+            }
+            biomeIds[j * tileSize + i] = id;
+        }
+    }
+}
+
+int canDownsample(const ZoomLevelParams *params, int tileX, int tileY) {
+    const ZoomLevelParams *fine = params->finer;
+    return fine && fine->grid && fine->scale * 2 == params->scale &&
+        fine->base_tile_size == params->base_tile_size &&
+        2 * (tileX + 1) <= fine->tile_count && 2 * (tileY + 1) <= fine->tile_count;
+}
+
+// Stores the biomes of a tile, so that it can be redrawn by recolor_tiles.
+void saveTileGrid(const int *biomeIds, const ZoomLevelParams *params, int tileX, int tileY) {
+    int tileSize = params->base_tile_size;
+    BiomeGridInfo info = {
+        .mc = MC_1_18,
+        .flags = LARGE_BIOMES,
+        .dim = DIM_OVERWORLD,
+        .seed = params->seed,
+        .r = {
+            .scale = params->scale,
+            .x = tileX * tileSize,
+            .z = tileY * tileSize,
+            .sx = tileSize,
+            .sz = tileSize,
+            .y = 15,
+            .sy = 1
+        }
+    };
+    size_t size;
+    unsigned char *data = encodeBiomeGrid(&info, biomeIds, &size);
+    if (!data || tilePackPut(&gridPack, params->seed, params->zoomLevel, tileX, tileY, data, size) != 0)
+        fprintf(stderr, "Error saving the biome grid of tile %d_%d at zoom level %d\n", tileX, tileY, params->zoomLevel);
+    free(data);
+}
+
+void processTile(const Generator *g, const TileJob *job) {
+    const ZoomLevelParams *params = job->params;
+    int tileSize = params->base_tile_size;
+    int *biomeIds;
+
+    if (canDownsample(params, job->x, job->y)) {
+        biomeIds = (int *)malloc(tileSize * tileSize * sizeof(int));
+        if (!biomeIds) {
+            fprintf(stderr, "Error allocating memory for biomes\n");
+            return;
+        }
+        downsampleTile(g, params, job->x, job->y, biomeIds);
+        int differ = 0;
+        if (pyramidCheck) {
+            int *direct = generateTileBiomes(g, job->x, job->y, tileSize, params->scale);
+            for (int i = 0; direct && i < tileSize * tileSize; i++)
+                differ += biomeIds[i] != direct[i];
+            free(direct);
+        }
+        pthread_mutex_lock(&mutex);
+        tilesDerived++;
+        cellsChecked += pyramidCheck ? tileSize * tileSize : 0;
+        cellsDiffer += differ;
+        pthread_mutex_unlock(&mutex);
+    } else {
+        biomeIds = generateTileBiomes(g, job->x, job->y, tileSize, params->scale);
+        if (!biomeIds)
+            return;
+    }
+
+    if (params->grid) {
+        int w = params->tile_count * tileSize;
+        for (int j = 0; j < tileSize; j++) {
+            memcpy(&params->grid[(size_t)(job->y * tileSize + j) * w + job->x * tileSize],
+                    &biomeIds[j * tileSize], tileSize * sizeof(int));
+        }
+    }
+
+    saveTile(biomeIds, params->seed, job->x, job->y, tileSize, params->outputDir, params->zoomLevel);
+    if (useGridPack)
+        saveTileGrid(biomeIds, params, job->x, job->y);
+    free(biomeIds);
+}
+
+void *tileWorker(void *arg) {
+    WorkerParams *wp = (WorkerParams *)arg;
+    TileDeque *own = &wp->deques[wp->id];
+    TileJob job;
+    int processed = 0;
+
+    for (;;) {
+        if (!takeJob(own, &job, 0)) {
+            // no jobs are added after the start, so we are done once every
+            // deque is empty
+            int found = 0;
+            for (int v = 1; v < wp->numWorkers && !found; v++)
+                found = takeJob(&wp->deques[(wp->id + v) % wp->numWorkers], &job, 1);
+            if (!found)
+                break;
+        }
+
+        processTile(&generator, &job);
 
         // Handle batching
-        if ((i + 1) % BATCH_SIZE == 0) {
+        if (++processed % BATCH_SIZE == 0) {
             pthread_mutex_lock(&mutex);
-            printf("Processed batch of %d tiles for zoom level %d\n", BATCH_SIZE, params->zoomLevel);
+            printf("Worker %d processed a batch of %d tiles\n", wp->id, BATCH_SIZE);
             pthread_mutex_unlock(&mutex);
         }
     }
 
-    pthread_exit(NULL);
+    return NULL;
+}
+
+// Runs the tile jobs, which should be ordered by priority, on a pool of workers.
+// The workers share the seeded generator read-only. They only serialize on the
+// mutex of the progress output and, with TILE_PACK/GRID_PACK, the mutex of the
+// pack that appends the tiles, once per tile. The scaling beyond a single core
+// has not been measured yet. TILE_WORKERS sets the number of workers to
+// compare against.
+void runTileJobs(const TileJob *jobs, int numJobs) {
+    const char *workers = getenv("TILE_WORKERS");
+    int numWorkers = workers ? atoi(workers) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numWorkers < 1)
+        numWorkers = 1;
+    if (numWorkers > numJobs)
+        numWorkers = numJobs > 0 ? numJobs : 1;
+
+    // Deal the jobs out in priority order, so every deque starts at the centre
+    int perWorker = (numJobs + numWorkers - 1) / numWorkers;
+    TileDeque *deques = (TileDeque *)calloc(numWorkers, sizeof(TileDeque));
+    TileJob *slots = (TileJob *)malloc((size_t)numWorkers * perWorker * sizeof(TileJob));
+    for (int w = 0; w < numWorkers; w++) {
+        deques[w].jobs = slots + (size_t)w * perWorker;
+        pthread_mutex_init(&deques[w].lock, NULL);
+    }
+    for (int i = 0; i < numJobs; i++) {
+        TileDeque *dq = &deques[i % numWorkers];
+        dq->jobs[dq->tail++] = jobs[i];
+    }
+
+    pthread_t threads[numWorkers];
+    WorkerParams params[numWorkers];
+    int started = 0;
+    for (int i = 0; i < numWorkers; i++) {
+        params[i].id = i;
+        params[i].numWorkers = numWorkers;
+        params[i].deques = deques;
+        if (pthread_create(&threads[i], NULL, tileWorker, (void *)&params[i]) != 0) {
+            // the running workers steal the jobs of this one
+            fprintf(stderr, "Error creating worker thread %d\n", i);
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        params[0].id = 0;
+        tileWorker(&params[0]);
+    }
+
+    // Join threads to ensure they complete before exiting the function
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int w = 0; w < numWorkers; w++) {
+        pthread_mutex_destroy(&deques[w].lock);
+    }
+    free(slots);
+    free(deques);
+}
+
+int compareZoomLevelScale(const void *a, const void *b) {
+    return ((const ZoomLevelParams *)a)->scale - ((const ZoomLevelParams *)b)->scale;
+}
+
+// Generates the zoom levels from the finest to the coarsest, deriving each
+// level from the one below where possible.
+void generatePyramid(ZoomLevelParams *zoomLevels, int numZoomLevels, TileJob *jobs) {
+    qsort(zoomLevels, numZoomLevels, sizeof(ZoomLevelParams), compareZoomLevelScale);
+
+    for (int i = 0; i < numZoomLevels; i++) {
+        for (int j = 0; j < i; j++) {
+            ZoomLevelParams *fine = &zoomLevels[j];
+            if (fine->scale * 2 == zoomLevels[i].scale && fine->base_tile_size == zoomLevels[i].base_tile_size) {
+                zoomLevels[i].finer = fine;
+                size_t w = (size_t)fine->tile_count * fine->base_tile_size;
+                fine->grid = (int *)calloc(w * w, sizeof(int));
+                if (!fine->grid)
+                    fprintf(stderr, "Error allocating the grid of zoom level %d\n", fine->zoomLevel);
+            }
+        }
+    }
+
+    for (int i = 0; i < numZoomLevels; i++) {
+        int numJobs = spiralOrder(&zoomLevels[i], jobs);
+        runTileJobs(jobs, numJobs);
+
+        // the finer grid is no longer needed once this level is done
+        if (zoomLevels[i].finer) {
+            ZoomLevelParams *fine = (ZoomLevelParams *)zoomLevels[i].finer;
+            free(fine->grid);
+            fine->grid = NULL;
+        }
+    }
+    for (int i = 0; i < numZoomLevels; i++) {
+        free(zoomLevels[i].grid);
+    }
 }
 
 void generateTilesForZoomLevels(uint64_t seed, const char *outputDir) {
     ZoomLevelParams zoomLevels[] = {
-        {seed, outputDir, 3, 96, 128, 8},
-        {seed, outputDir, 4, 48, 128, 16},
-        {seed, outputDir, 5, 24, 128, 32},
-        {seed, outputDir, 6, 12, 128, 32},
+        {seed, outputDir, 3, 96, 128, 8, NULL, NULL},
+        {seed, outputDir, 4, 48, 128, 16, NULL, NULL},
+        {seed, outputDir, 5, 24, 128, 32, NULL, NULL},
+        {seed, outputDir, 6, 12, 128, 32, NULL, NULL},
     };
     int numZoomLevels = sizeof(zoomLevels) / sizeof(zoomLevels[0]);
 
@@ -175,30 +466,50 @@ void generateTilesForZoomLevels(uint64_t seed, const char *outputDir) {
     for (int i = 0; i < numZoomLevels; i++) {
         totalTiles += zoomLevels[i].tile_count * zoomLevels[i].tile_count;
     }
+    TileJob *jobs = (TileJob *)malloc(totalTiles * sizeof(TileJob));
 
-    pthread_t threads[numZoomLevels];
-    for (int i = 0; i < numZoomLevels; i++) {
-        if (pthread_create(&threads[i], NULL, generateTilesForZoomLevel, (void *)&zoomLevels[i]) != 0) {
-            fprintf(stderr, "Error creating thread for zoom level %d\n", zoomLevels[i].zoomLevel);
-            // Optionally, clean up already created threads here
-            for (int j = 0; j < i; j++) {
-                pthread_join(threads[j], NULL);
-            }
-            return; // Exit if thread creation fails
-        }
+    if (pyramidMode != PYRAMID_OFF) {
+        generatePyramid(zoomLevels, numZoomLevels, jobs);
+        free(jobs);
+        return;
     }
 
-    // Join threads to ensure they complete before exiting the function
+    // Order the tiles of all zoom levels by their spiral position, so that
+    // the centre tiles are generated first
+    int numJobs = 0;
     for (int i = 0; i < numZoomLevels; i++) {
-        pthread_join(threads[i], NULL);
+        numJobs += spiralOrder(&zoomLevels[i], jobs + numJobs);
     }
+    qsort(jobs, numJobs, sizeof(TileJob), compareTileJobs);
+
+    runTileJobs(jobs, numJobs);
+    free(jobs);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <seed>\n", argv[0]);
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <seed> [majority|nearest|resample]\n", argv[0]);
+        fprintf(stderr, "Set TILE_PACK=<file> to write the tiles to a tile pack, and GRID_PACK=<file>\n"
+                "to keep their biomes for recolor_tiles. TILE_WORKERS=<n> overrides the number\n"
+                "of worker threads (default: one per online CPU). PYRAMID_CHECK=1 counts the\n"
+                "cells of the derived tiles that differ from the direct generation.\n");
         return 1;
     }
+    if (argc > 2) {
+        if (!strcmp(argv[2], "majority")) {
+            pyramidMode = PYRAMID_MAJORITY;
+        } else if (!strcmp(argv[2], "nearest")) {
+            pyramidMode = PYRAMID_NEAREST;
+        } else if (!strcmp(argv[2], "resample")) {
+            pyramidMode = PYRAMID_RESAMPLE;
+        } else {
+            fprintf(stderr, "Unknown pyramid mode: %s\n", argv[2]);
+            return 1;
+        }
+    }
+
+    const char *check = getenv("PYRAMID_CHECK");
+    pyramidCheck = check && atoi(check) != 0;
 
     uint64_t seed = strtoull(argv[1], NULL, 10);
     startTime = time(NULL);
@@ -206,11 +517,37 @@ int main(int argc, char *argv[]) {
     char outputDir[2048];
     snprintf(outputDir, sizeof(outputDir), "/var/www/production/gme-backend/storage/app/public/tiles");
 
-    if (createDir(outputDir) != 0) {
+    // Write the tiles to a single pack file instead of a directory tree
+    const char *packPath = getenv("TILE_PACK");
+    if (packPath) {
+        if (tilePackOpen(&tilePack, packPath, 1) != 0)
+            return 1;
+        usePack = 1;
+    } else if (createDir(outputDir) != 0) {
         return 1;
     }
 
+    const char *gridPath = getenv("GRID_PACK");
+    if (gridPath) {
+        if (tilePackOpen(&gridPack, gridPath, 1) != 0)
+            return 1;
+        useGridPack = 1;
+    }
+
+    setupGenerator(&generator, MC_1_18, LARGE_BIOMES);
+    applySeed(&generator, DIM_OVERWORLD, seed);
+    initBiomeColors(biomeColors);
+
     generateTilesForZoomLevels(seed, outputDir);
+    if (pyramidMode != PYRAMID_OFF)
+        printf("Pyramid: %d of %d tiles derived from finer zoom levels\n", tilesDerived, totalTiles);
+    if (pyramidCheck && cellsChecked)
+        printf("Pyramid check: %ld of %ld derived cells (%.3f%%) differ from direct generation\n",
+                cellsDiffer, cellsChecked, 100.0 * cellsDiffer / cellsChecked);
+    if (usePack && tilePackClose(&tilePack) != 0)
+        return 1;
+    if (useGridPack && tilePackClose(&gridPack) != 0)
+        return 1;
 
     printf("All tiles generated. Total time taken: %.2f seconds\n", difftime(time(NULL), startTime));
     return 0;
@@ -1,6 +1,7 @@
 #include "generator.h"
 #include "util.h"
 #include "image_utils.h"
+#include "tile_pack.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -12,6 +13,9 @@
 
 const int tileSize = 32; // Fixed tile size (32x32 blocks)
 const int numTiles = 100; // Number of tiles to generate
+GeneratorCache genCache; // seeded generators, shared by all tiles
+TilePack tilePack;       // replaces the tile directories if TILE_PACK is set
+int usePack = 0;
 
 // Function to calculate the number of tiles needed based on viewport size and tile size
 void calculateTileDimensions(int viewportWidth, int viewportHeight, int tileSize, int *tilesX, int *tilesY) {
@@ -55,8 +59,7 @@ int createDir(const char *path) {
 }
 
 void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSize, const char *outputDir) {
-    setupGenerator(g, MC_1_18, LARGE_BIOMES);
-    applySeed(g, DIM_OVERWORLD, seed);
+    acquireGenerator(&genCache, g, MC_1_18, LARGE_BIOMES, DIM_OVERWORLD, seed);
 
     Range r;
     r.scale = 4;
@@ -71,21 +74,24 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     genBiomes(g, biomeIds, r);
 
     int pix4cell = 4;
-    int imgWidth = pix4cell * r.sx;
-    int imgHeight = pix4cell * r.sz;
 
     unsigned char biomeColors[256][3];
     initBiomeColors(biomeColors);
 
-    unsigned char *rgb = (unsigned char *)malloc(3 * imgWidth * imgHeight);
-    if (rgb == NULL) {
-        fprintf(stderr, "Error allocating memory for image\n");
+    if (usePack) {
+        // these tiles have no zoom level, which is stored as -1
+        size_t size;
+        unsigned char *png = encodePNGIndexed(biomeIds, r.sx, r.sz, pix4cell, biomeColors, &size);
+        if (!png || tilePackPut(&tilePack, seed, -1, tileX, tileY, png, size) != 0) {
+            fprintf(stderr, "Error saving image file for tile %d_%d\n", tileX, tileY);
+        } else {
+            printf("Tile map generated and saved to %s:%lu/%d_%d\n", tilePack.path, seed, tileX, tileY);
+        }
+        free(png);
         free(biomeIds);
         return;
     }
 
-    biomesToImage(rgb, biomeColors, biomeIds, r.sx, r.sz, pix4cell, 2);
-
     // Construct the directory path
     char tileDir[4096];
     snprintf(tileDir, sizeof(tileDir), "%s/%lu", outputDir, seed);
@@ -95,7 +101,6 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     // Create the tile directory if it does not exist
     if (createDir(tileDir) != 0) {
         free(biomeIds);
-        free(rgb);
         return;
     }
 
@@ -105,19 +110,17 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
 
     printf("Saving file to: %s\n", outputFile);
 
-    if (savePNG(outputFile, rgb, imgWidth, imgHeight) != 0) {
+    if (savePNGIndexed(outputFile, biomeIds, r.sx, r.sz, pix4cell, biomeColors) != 0) {
         fprintf(stderr, "Error saving image file for tile %d_%d\n", tileX, tileY);
     } else {
         printf("Tile map generated and saved to %s\n", outputFile);
     }
 
     free(biomeIds);
-    free(rgb);
 }
 
 void generateTiles(uint64_t seed, const char *outputDir) {
     Generator g;
-    setupGenerator(&g, MC_1_18, LARGE_BIOMES);
 
     // Example coordinates for generating tiles in all four quadrants
     int startX = -5; // Start generating from -5 to 5 (example)
@@ -144,11 +147,27 @@ int main(int argc, char *argv[]) {
     // snprintf(outputDir, sizeof(outputDir), "/var/www/storage/app/public/tiles");
     snprintf(outputDir, sizeof(outputDir), "/var/www/gme-backend/storage/app/public/tiles");
 
-    if (createDir(outputDir) != 0) {
+    // Write the tiles to a single pack file instead of a directory tree
+    const char *packPath = getenv("TILE_PACK");
+    if (packPath) {
+        if (tilePackOpen(&tilePack, packPath, 1) != 0)
+            return 1;
+        usePack = 1;
+    } else if (createDir(outputDir) != 0) {
+        return 1;
+    }
+
+    if (initGeneratorCache(&genCache, 4) != 0) {
+        fprintf(stderr, "Error allocating the generator cache\n");
         return 1;
     }
 
     generateTiles(seed, outputDir);
+    printf("Generator cache: %lu hits, %lu misses\n",
+            (unsigned long)genCache.hits, (unsigned long)genCache.misses);
+    freeGeneratorCache(&genCache);
+    if (usePack && tilePackClose(&tilePack) != 0)
+        return 1;
 
     return 0;
 }
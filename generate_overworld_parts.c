@@ -1,17 +1,25 @@
 #include "generator.h"
 #include "util.h"
 #include "image_utils.h"
+#include "tile_pack.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 
 const int chunk_size = 16; // Minecraft chunk size (16x16 blocks)
 const int MAX_TILES = 200; // Number of tiles to generate
+GeneratorCache genCache; // seeded generators, shared by all tiles
+TilePack tilePack;       // replaces the tile directories if TILE_PACK is set
+int usePack = 0;
+
+#define LOOKAHEAD 2 // pan steps ahead of the new viewport that are prefetched
 
 // Function to determine tile size based on zoom level
 int getTileSize(int zoomLevel) {
@@ -64,7 +72,7 @@ int createDir(const char *path) {
     return 0;
 }
 
-void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSize, int viewportWidth, int viewportHeight, const char *outputDir, int zoomLevel) {
+void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSize, int viewportWidth, int viewportHeight, const char *outputDir, int zoomLevel, int checkExists) {
     // Construct the directory path including zoom level
     char zoomDir[2048];
     snprintf(zoomDir, sizeof(zoomDir), "%s/%lu/%d", outputDir, seed, zoomLevel);
@@ -77,14 +85,16 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     char outputFile[8096];
     snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, tileY);
 
+    if (usePack)
+        snprintf(outputFile, sizeof(outputFile), "%s:%lu/%d/%d/%d", tilePack.path, seed, zoomLevel, tileX, tileY);
+
     // Check if the tile file already exists
-    if (fileExists(outputFile)) {
+    if (checkExists && (usePack ? tilePackFind(&tilePack, seed, zoomLevel, tileX, tileY) != NULL : fileExists(outputFile))) {
         printf("Tile file already exists: %s\n", outputFile);
         return;
     }
 
-    setupGenerator(g, MC_1_18, LARGE_BIOMES);
-    applySeed(g, DIM_OVERWORLD, seed);
+    acquireGenerator(&genCache, g, MC_1_18, LARGE_BIOMES, DIM_OVERWORLD, seed);
 
     Range r;
     r.scale = 4;
@@ -99,27 +109,28 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     genBiomes(g, biomeIds, r);
 
     int pix4cell = 4;
-    int imgWidth = pix4cell * r.sx;
-    int imgHeight = pix4cell * r.sz;
 
     unsigned char biomeColors[256][3];
     initBiomeColors(biomeColors);
 
-    unsigned char *rgb = (unsigned char *)malloc(3 * imgWidth * imgHeight);
-    if (rgb == NULL) {
-        fprintf(stderr, "Error allocating memory for image\n");
+    if (usePack) {
+        size_t size;
+        unsigned char *png = encodePNGIndexed(biomeIds, r.sx, r.sz, pix4cell, biomeColors, &size);
+        if (!png || tilePackPut(&tilePack, seed, zoomLevel, tileX, tileY, png, size) != 0) {
+            fprintf(stderr, "Error saving image file for tile %d_%d at zoom level %d\n", tileX, tileY, zoomLevel);
+        } else {
+            printf("Tile map generated and saved to %s\n", outputFile);
+        }
+        free(png);
         free(biomeIds);
         return;
     }
 
-    biomesToImage(rgb, biomeColors, biomeIds, r.sx, r.sz, pix4cell, 2);
-
     printf("Creating directory: %s\n", zoomDir);
 
     // Create the directory if it does not exist
     if (createDir(zoomDir) != 0) {
         free(biomeIds);
-        free(rgb);
         return;
     }
 
@@ -128,25 +139,196 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     // Create the tile directory if it does not exist
     if (createDir(tileDir) != 0) {
         free(biomeIds);
-        free(rgb);
         return;
     }
 
     printf("Saving file to: %s\n", outputFile);
 
-    if (savePNG(outputFile, rgb, imgWidth, imgHeight) != 0) {
+    if (savePNGIndexed(outputFile, biomeIds, r.sx, r.sz, pix4cell, biomeColors) != 0) {
         fprintf(stderr, "Error saving image file for tile %d_%d at zoom level %d\n", tileX, tileY, zoomLevel);
     } else {
         printf("Tile map generated and saved to %s\n", outputFile);
     }
 
     free(biomeIds);
-    free(rgb);
+}
+
+// Prefetching: after a pan from the previous to the new viewport, only the
+// tiles that were not visible before are rendered, together with the tiles
+// that the pan velocity is expected to expose in the next LOOKAHEAD steps.
+typedef struct {
+    int x, y;
+    int steps;  // pan steps until the tile becomes visible (0 = visible now)
+    int dist;   // squared distance to the centre of that viewport
+} PrefetchTile;
+
+typedef struct {
+    const PrefetchTile *tiles;
+    int numTiles;
+    int next;
+    uint64_t seed;
+    int tileSize;
+    int viewportWidth, viewportHeight;
+    const char *outputDir;
+    int zoomLevel;
+} PrefetchQueue;
+
+pthread_mutex_t queueMutex = PTHREAD_MUTEX_INITIALIZER;
+
+int inViewport(int x, int y, int panX, int panY, int tilesX, int tilesY) {
+    int startX = panX - tilesX / 2;
+    int startY = panY - tilesY / 2;
+    return x >= startX && x < startX + tilesX && y >= startY && y < startY + tilesY;
+}
+
+int comparePrefetchTiles(const void *a, const void *b) {
+    const PrefetchTile *ta = (const PrefetchTile *)a;
+    const PrefetchTile *tb = (const PrefetchTile *)b;
+    if (ta->steps != tb->steps)
+        return ta->steps - tb->steps;
+    return ta->dist - tb->dist;
+}
+
+// Collects the newly exposed tiles into a new buffer, in the order in which
+// they are expected to become visible.
+PrefetchTile *exposedTiles(int prevX, int prevY, int panX, int panY, int velX, int velY,
+        int tilesX, int tilesY, int *numTiles) {
+    int minX = panX, maxX = panX, minY = panY, maxY = panY;
+    for (int k = 0; k <= LOOKAHEAD; k++) {
+        int cx = panX + k * velX, cy = panY + k * velY;
+        if (cx < minX) minX = cx;
+        if (cx > maxX) maxX = cx;
+        if (cy < minY) minY = cy;
+        if (cy > maxY) maxY = cy;
+    }
+    minX -= tilesX / 2;
+    minY -= tilesY / 2;
+    maxX += tilesX - tilesX / 2;
+    maxY += tilesY - tilesY / 2;
+
+    PrefetchTile *tiles = (PrefetchTile *)malloc((size_t)(maxX - minX) * (maxY - minY) * sizeof(PrefetchTile));
+    int n = 0;
+    for (int x = minX; tiles && x < maxX; x++) {
+        for (int y = minY; y < maxY; y++) {
+            if (inViewport(x, y, prevX, prevY, tilesX, tilesY))
+                continue;
+            for (int k = 0; k <= LOOKAHEAD; k++) {
+                int cx = panX + k * velX, cy = panY + k * velY;
+                if (inViewport(x, y, cx, cy, tilesX, tilesY)) {
+                    PrefetchTile t = { x, y, k, (x - cx) * (x - cx) + (y - cy) * (y - cy) };
+                    tiles[n++] = t;
+                    break;
+                }
+            }
+        }
+    }
+    qsort(tiles, n, sizeof(PrefetchTile), comparePrefetchTiles);
+    *numTiles = n;
+    return tiles;
+}
+
+// Removes the tiles that exist already. Instead of a stat per tile, each
+// column directory of the tile tree is scanned once.
+int removeExistingTiles(PrefetchTile *tiles, int n, uint64_t seed, const char *outputDir, int zoomLevel) {
+    if (n == 0)
+        return 0;
+
+    int minX = tiles[0].x, maxX = tiles[0].x, minY = tiles[0].y, maxY = tiles[0].y;
+    for (int i = 1; i < n; i++) {
+        if (tiles[i].x < minX) minX = tiles[i].x;
+        if (tiles[i].x > maxX) maxX = tiles[i].x;
+        if (tiles[i].y < minY) minY = tiles[i].y;
+        if (tiles[i].y > maxY) maxY = tiles[i].y;
+    }
+    int w = maxX - minX + 1, h = maxY - minY + 1;
+    char *exists = (char *)calloc((size_t)w * h, 1);
+    char *scanned = (char *)calloc(w, 1);
+    if (!exists || !scanned) {
+        free(exists);
+        free(scanned);
+        return n;
+    }
+
+    for (int i = 0; i < n; i++) {
+        int x = tiles[i].x;
+        if (usePack) {
+            exists[(size_t)(x - minX) * h + tiles[i].y - minY] =
+                tilePackFind(&tilePack, seed, zoomLevel, x, tiles[i].y) != NULL;
+            continue;
+        }
+        if (scanned[x - minX])
+            continue;
+        scanned[x - minX] = 1;
+
+        char tileDir[4096];
+        snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, seed, zoomLevel, x);
+        DIR *dir = opendir(tileDir);
+        if (!dir)
+            continue;
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            int y;
+            char ext[8];
+            if (sscanf(ent->d_name, "%d.%7s", &y, ext) == 2 && !strcmp(ext, "png") && y >= minY && y <= maxY)
+                exists[(size_t)(x - minX) * h + y - minY] = 1;
+        }
+        closedir(dir);
+    }
+
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (!exists[(size_t)(tiles[i].x - minX) * h + tiles[i].y - minY])
+            tiles[m++] = tiles[i];
+    }
+    free(exists);
+    free(scanned);
+    return m;
+}
+
+void *prefetchWorker(void *arg) {
+    PrefetchQueue *q = (PrefetchQueue *)arg;
+    Generator g;
+
+    for (;;) {
+        pthread_mutex_lock(&queueMutex);
+        int i = q->next++;
+        pthread_mutex_unlock(&queueMutex);
+        if (i >= q->numTiles)
+            break;
+        const PrefetchTile *t = &q->tiles[i];
+        generateTile(&g, q->seed, t->x, t->y, q->tileSize, q->viewportWidth, q->viewportHeight,
+                q->outputDir, q->zoomLevel, 0);
+    }
+    return NULL;
+}
+
+// Renders the tiles on a pool of threads, which take them in order.
+void prefetchTiles(PrefetchQueue *q) {
+    int numThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads < 1)
+        numThreads = 1;
+    if (numThreads > q->numTiles)
+        numThreads = q->numTiles;
+
+    pthread_t *threads = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
+    int started = 0;
+    for (; threads && started < numThreads; started++) {
+        if (pthread_create(&threads[started], NULL, prefetchWorker, q) != 0)
+            break;
+    }
+    if (started == 0)
+        prefetchWorker(q);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 5) {
+    if (argc != 5 && argc != 7 && argc != 9) {
         fprintf(stderr, "Usage: %s <seed> <zoom_level> <pan_x> <pan_y>\n", argv[0]);
+        fprintf(stderr, "       %s <seed> <zoom_level> <pan_x> <pan_y> <prev_pan_x> <prev_pan_y> [<vel_x> <vel_y>]\n", argv[0]);
+        fprintf(stderr, "The second form prefetches the tiles exposed by a pan from the previous\n"
+                "viewport, with a velocity in tiles per pan (default: the last pan).\n");
         return 1;
     }
 
@@ -175,20 +357,56 @@ int main(int argc, char *argv[]) {
     char outputDir[2048];
     snprintf(outputDir, sizeof(outputDir), "/var/www/storage/app/public/tiles");
 
-    if (createDir(outputDir) != 0) {
+    // Write the tiles to a single pack file instead of a directory tree
+    const char *packPath = getenv("TILE_PACK");
+    if (packPath) {
+        if (tilePackOpen(&tilePack, packPath, 1) != 0)
+            return 1;
+        usePack = 1;
+    } else if (createDir(outputDir) != 0) {
         return 1;
     }
 
-    Generator g;
-    setupGenerator(&g, MC_1_18, LARGE_BIOMES);
+    if (initGeneratorCache(&genCache, 4) != 0) {
+        fprintf(stderr, "Error allocating the generator cache\n");
+        return 1;
+    }
 
-    int tileCounter = 0;
-    for (int x = startX; tileCounter < MAX_TILES && x < startX + tilesX; ++x) {
-        for (int y = startY; tileCounter < MAX_TILES && y < startY + tilesY; ++y) {
-            generateTile(&g, seed, x, y, tileSize, viewportWidth, viewportHeight, outputDir, zoomLevel);
-            tileCounter++;
+    if (argc > 5) {
+        int prevX = atoi(argv[5]);
+        int prevY = atoi(argv[6]);
+        int velX = argc > 7 ? atoi(argv[7]) : pan_x - prevX;
+        int velY = argc > 7 ? atoi(argv[8]) : pan_y - prevY;
+
+        PrefetchQueue q = { NULL, 0, 0, seed, tileSize, viewportWidth, viewportHeight, outputDir, zoomLevel };
+        int numExposed;
+        PrefetchTile *tiles = exposedTiles(prevX, prevY, pan_x, pan_y, velX, velY, tilesX, tilesY, &numExposed);
+        if (!tiles) {
+            fprintf(stderr, "Error allocating memory for tiles\n");
+            return 1;
+        }
+        q.tiles = tiles;
+        q.numTiles = removeExistingTiles(tiles, numExposed, seed, outputDir, zoomLevel);
+        if (q.numTiles > MAX_TILES)
+            q.numTiles = MAX_TILES;
+        printf("Prefetching %d of %d newly exposed tiles\n", q.numTiles, numExposed);
+        prefetchTiles(&q);
+        free(tiles);
+    } else {
+        Generator g;
+        int tileCounter = 0;
+        for (int x = startX; tileCounter < MAX_TILES && x < startX + tilesX; ++x) {
+            for (int y = startY; tileCounter < MAX_TILES && y < startY + tilesY; ++y) {
+                generateTile(&g, seed, x, y, tileSize, viewportWidth, viewportHeight, outputDir, zoomLevel, 1);
+                tileCounter++;
+            }
         }
     }
 
+    printf("Generator cache: %lu hits, %lu misses\n",
+            (unsigned long)genCache.hits, (unsigned long)genCache.misses);
+    freeGeneratorCache(&genCache);
+    if (usePack && tilePackClose(&tilePack) != 0)
+        return 1;
     return 0;
 }
@@ -1,6 +1,7 @@
 #include "generator.h"
 #include "util.h"
 #include "image_utils.h"
+#include "tile_pack.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -10,6 +11,10 @@
 #include <string.h>
 #include <time.h>
 
+GeneratorCache genCache; // seeded generators, shared by all tiles
+TilePack tilePack;       // replaces the tile directories if TILE_PACK is set
+int usePack = 0;
+
 // Function to create directories as needed
 int createDir(const char *path) {
     char tmp[2048];
@@ -46,8 +51,7 @@ int createDir(const char *path) {
 
 // Function to generate a single tile based on OpenLayers request parameters
 void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSize, const char *outputDir, int zoomLevel, int scale) {
-    setupGenerator(g, MC_1_18, LARGE_BIOMES);
-    applySeed(g, DIM_OVERWORLD, seed);
+    acquireGenerator(&genCache, g, MC_1_18, LARGE_BIOMES, DIM_OVERWORLD, seed);
 
     Range r = {
         .scale = scale,
@@ -68,26 +72,25 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
     genBiomes(g, biomeIds, r);
 
     int pix4cell = 4;
-    int imgWidth = pix4cell * r.sx;
-    int imgHeight = pix4cell * r.sz;
-
-    unsigned char *rgb = (unsigned char *)malloc(3 * imgWidth * imgHeight);
-    if (!rgb) {
-        fprintf(stderr, "Error allocating memory for image\n");
-        free(biomeIds); // Ensure biomeIds is freed
-        return;
-    }
 
     unsigned char biomeColors[256][3];
     initBiomeColors(biomeColors);
 
-    biomesToImage(rgb, biomeColors, biomeIds, r.sx, r.sz, pix4cell, 2);
-
     char tileDir[4096], outputFile[8192];
-    snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, seed, zoomLevel, tileX);
-    snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, tileY);
+    int err;
+    if (usePack) {
+        size_t size;
+        unsigned char *png = encodePNGIndexed(biomeIds, r.sx, r.sz, pix4cell, biomeColors, &size);
+        err = !png || tilePackPut(&tilePack, seed, zoomLevel, tileX, tileY, png, size) != 0;
+        free(png);
+        snprintf(outputFile, sizeof(outputFile), "%s:%lu/%d/%d/%d", tilePack.path, seed, zoomLevel, tileX, tileY);
+    } else {
+        snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, seed, zoomLevel, tileX);
+        snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, tileY);
+        err = createDir(tileDir) != 0 || savePNGIndexed(outputFile, biomeIds, r.sx, r.sz, pix4cell, biomeColors) != 0;
+    }
 
-    if (createDir(tileDir) != 0 || savePNG(outputFile, rgb, imgWidth, imgHeight) != 0) {
+    if (err) {
         fprintf(stderr, "Error saving image file for tile %d_%d at zoom level %d\n", tileX, tileY, zoomLevel);
     } else {
         printf("Tile %d_%d at zoom level %d generated and saved to %s\n", tileX, tileY, zoomLevel, outputFile);
@@ -95,7 +98,6 @@ void generateTile(Generator *g, uint64_t seed, int tileX, int tileY, int tileSiz
 
     // Free allocated memory
     free(biomeIds);
-    free(rgb);
 }
 
 int main(int argc, char *argv[]) {
@@ -117,13 +119,27 @@ int main(int argc, char *argv[]) {
     char outputDir[2048];
     snprintf(outputDir, sizeof(outputDir), "/var/www/staging/gme-backend/storage/app/public/tiles");
 
-    if (createDir(outputDir) != 0) {
+    // Write the tiles to a single pack file instead of a directory tree
+    const char *packPath = getenv("TILE_PACK");
+    if (packPath) {
+        if (tilePackOpen(&tilePack, packPath, 1) != 0)
+            return 1;
+        usePack = 1;
+    } else if (createDir(outputDir) != 0) {
+        return 1;
+    }
+
+    if (initGeneratorCache(&genCache, 4) != 0) {
+        fprintf(stderr, "Error allocating the generator cache\n");
         return 1;
     }
 
     Generator g;
     generateTile(&g, seed, tileX, tileY, tileSize, outputDir, zoomLevel, scale);
 
+    freeGeneratorCache(&genCache);
+    if (usePack && tilePackClose(&tilePack) != 0)
+        return 1;
     printf("Tile generated successfully.\n");
     return 0;
 }
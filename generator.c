@@ -71,6 +71,7 @@ void setupGenerator(Generator *g, int mc, uint32_t flags)
     if (mc >= MC_B1_8 && mc <= MC_1_17)
     {
         setupLayerStack(&g->ls, mc, flags & LARGE_BIOMES);
+        memset(g->xlayer, 0, sizeof(g->xlayer));
         g->entry = NULL;
         if (flags & FORCE_OCEAN_VARIANTS && mc >= MC_1_13)
         {
@@ -90,6 +91,8 @@ void setupGenerator(Generator *g, int mc, uint32_t flags)
     else if (mc >= MC_1_18)
     {
         initBiomeNoise(&g->bn, mc);
+        g->bn.lowprec = !!(flags & FLOAT_NOISE);
+        g->bn.coarse = (flags & COARSE_CLIMATE) ? 2 : 0;
     }
     else
     {
@@ -112,7 +115,9 @@ void applySeed(Generator *g, int dim, uint64_t seed)
         }
         else if (g->mc <= MC_1_17)
         {
-            setLayerSeed(g->entry ? g->entry : g->ls.entry_1, seed);
+            // lazily seeded layers are updated upon generation
+            if (!(g->flags & LAZY_LAYER_SEED))
+                setLayerSeed(g->entry ? g->entry : g->ls.entry_1, seed);
         }
         else // if (g->mc >= MC_1_18)
         {
@@ -129,7 +134,8 @@ void applySeed(Generator *g, int dim, uint64_t seed)
     }
     if (g->mc >= MC_1_15)
     {
-        if (g->mc <= MC_1_17 && dim == DIM_OVERWORLD && !g->entry)
+        if (g->mc <= MC_1_17 && dim == DIM_OVERWORLD && !g->entry &&
+            !(g->flags & LAZY_LAYER_SEED))
             g->sha = g->ls.entry_1->startSalt;
         else
             g->sha = getVoronoiSHA(seed);
@@ -137,6 +143,168 @@ void applySeed(Generator *g, int dim, uint64_t seed)
 }
 
 
+#define RELOC(P) do { \
+        const char *_p = (const char*)(P); \
+        if (_p >= (const char*)src && _p < (const char*)(src+1)) \
+            (P) = (void*)((char*)dst + (_p - (const char*)src)); \
+    } while (0)
+
+static void relocLayer(Layer *l, Generator *dst, const Generator *src)
+{
+    RELOC(l->p);
+    RELOC(l->p2);
+    RELOC(l->noise);
+    RELOC(l->data);
+}
+
+static void relocDoublePerlin(DoublePerlinNoise *dpn,
+    Generator *dst, const Generator *src)
+{
+    RELOC(dpn->octA.octaves);
+    RELOC(dpn->octB.octaves);
+}
+
+void copyGenerator(Generator *dst, const Generator *src)
+{
+    int i;
+    memcpy(dst, src, sizeof(Generator));
+
+    if (src->mc >= MC_B1_8 && src->mc <= MC_1_17)
+    {
+        for (i = 0; i < L_NUM; i++)
+        {
+            Layer *l = &dst->ls.layers[i];
+            relocLayer(l, dst, src);
+            if (l->cache)
+            {   // the layer cache stays with the source
+                l->getMap = l->cache->map[i];
+                l->cache = NULL;
+            }
+        }
+        for (i = 0; i < 5; i++)
+            relocLayer(&dst->xlayer[i], dst, src);
+        RELOC(dst->ls.entry_1);
+        RELOC(dst->ls.entry_4);
+        RELOC(dst->ls.entry_16);
+        RELOC(dst->ls.entry_64);
+        RELOC(dst->ls.entry_256);
+        RELOC(dst->entry);
+    }
+    else if (src->mc >= MC_1_18)
+    {
+        for (i = 0; i < NP_MAX; i++)
+            relocDoublePerlin(&dst->bn.climate[i], dst, src);
+    }
+    else if (src->dim == DIM_OVERWORLD)
+    {
+        for (i = 0; i < 3; i++)
+            RELOC(dst->bnb.climate[i].octaves);
+    }
+    if (src->dim == DIM_NETHER && src->mc >= MC_1_16_1)
+    {
+        relocDoublePerlin(&dst->nn.temperature, dst, src);
+        relocDoublePerlin(&dst->nn.humidity, dst, src);
+    }
+}
+
+#undef RELOC
+
+
+int initGeneratorCache(GeneratorCache *gc, int capacity)
+{
+    memset(gc, 0, sizeof(*gc));
+    if (capacity <= 0)
+        return 1;
+    gc->gen = (Generator*) malloc(capacity * sizeof(Generator));
+    gc->used = (uint64_t*) malloc(capacity * sizeof(uint64_t));
+    if (!gc->gen || !gc->used)
+    {
+        freeGeneratorCache(gc);
+        return 1;
+    }
+    gc->cap = capacity;
+    return 0;
+}
+
+void freeGeneratorCache(GeneratorCache *gc)
+{
+    free(gc->gen);
+    free(gc->used);
+    memset(gc, 0, sizeof(*gc));
+}
+
+// The lock is only held while searching and copying entries, never while
+// seeding, so a spin lock is sufficient.
+static void lockCache(GeneratorCache *gc)
+{
+    int expected = 0;
+    while (!ATOMIC_CAS(&gc->lock, &expected, 1))
+        expected = 0;
+}
+
+static void unlockCache(GeneratorCache *gc)
+{
+    ATOMIC_STORE(&gc->lock, 0);
+}
+
+static int findCached(const GeneratorCache *gc, int mc, uint32_t flags,
+    int dim, uint64_t seed)
+{
+    int i;
+    for (i = 0; i < gc->len; i++)
+    {
+        const Generator *c = &gc->gen[i];
+        if (c->seed == seed && c->mc == mc && c->dim == dim && c->flags == flags)
+            return i;
+    }
+    return -1;
+}
+
+int acquireGenerator(GeneratorCache *gc, Generator *g, int mc, uint32_t flags,
+    int dim, uint64_t seed)
+{
+    int i;
+
+    lockCache(gc);
+    i = findCached(gc, mc, flags, dim, seed);
+    if (i >= 0)
+    {
+        copyGenerator(g, &gc->gen[i]);
+        gc->used[i] = ++gc->tick;
+        gc->hits++;
+        unlockCache(gc);
+        return 1;
+    }
+    gc->misses++;
+    unlockCache(gc);
+
+    setupGenerator(g, mc, flags);
+    applySeed(g, dim, seed);
+
+    lockCache(gc);
+    // another thread may have added the same generator in the meantime
+    i = findCached(gc, mc, flags, dim, seed);
+    if (i < 0)
+    {
+        if (gc->len < gc->cap)
+        {
+            i = gc->len++;
+        }
+        else
+        {
+            int j;
+            for (i = 0, j = 1; j < gc->len; j++)
+                if (gc->used[j] < gc->used[i])
+                    i = j;
+        }
+        copyGenerator(&gc->gen[i], g);
+    }
+    gc->used[i] = ++gc->tick;
+    unlockCache(gc);
+    return 0;
+}
+
+
 size_t getMinCacheSize(const Generator *g, int scale, int sx, int sy, int sz)
 {
     if (sy == 0)
@@ -187,6 +355,8 @@ int genBiomes(const Generator *g, int *cache, Range r)
         {
             const Layer *entry = getLayerForScale(g, r.scale);
             if (!entry) return -1;
+            if (g->flags & LAZY_LAYER_SEED)
+                updateLayerSeed((Layer*) entry, g->seed);
             err = genArea(entry, cache, r.x, r.z, r.sx, r.sz);
             if (err) return err;
             for (k = 1; k < r.sy; k++)
@@ -233,19 +403,102 @@ int genBiomes(const Generator *g, int *cache, Range r)
     return err;
 }
 
+/* Samples a single biome directly from the noise, where this is equivalent to
+ * genBiomes() for a 1x1x1 range. Returns zero if there is no such shortcut.
+ */
+static int sampleBiomePoint(const Generator *g, int scale, int x, int y, int z,
+    int *id)
+{
+    int x4, y4, z4;
+
+    if (g->dim == DIM_OVERWORLD && g->mc >= MC_1_18)
+    {
+        const BiomeNoise *bn = &g->bn;
+        if (scale == 1)
+        {
+            voronoiAccess3D(g->sha, x, y, z, &x4, &y4, &z4);
+            *id = sampleBiomeNoise(bn, NULL, x4, y4, z4, NULL, 0);
+            return 1;
+        }
+        if (scale == 0 || scale == 4)
+        {
+            *id = sampleBiomeNoise(bn, NULL, x, y, z, NULL, 0);
+            return 1;
+        }
+        if (scale >= 4 && !bn->lowprec && !(bn->coarse > 1 && scale >= 16))
+        {   // same as genBiomeNoiseScaled() at higher scales
+            uint64_t dat = 0;
+            int s = scale / 4, mid = s / 2;
+            *id = sampleBiomeNoise(bn, NULL, x*s + mid, y, z*s + mid,
+                &dat, SAMPLE_NO_SHIFT);
+            return 1;
+        }
+    }
+    else if (g->dim == DIM_NETHER)
+    {
+        if (g->mc <= MC_1_15)
+        {
+            *id = nether_wastes;
+            return 1;
+        }
+        if (scale == 1)
+        {
+            voronoiAccess3D(g->sha, x, y, z, &x4, &y4, &z4);
+            *id = getNetherBiome(&g->nn, x4, y4, z4, NULL);
+            return 1;
+        }
+        if (scale == 0 || scale >= 4)
+        {
+            int s = scale ? scale / 4 : 1;
+            *id = getNetherBiome(&g->nn, x*s, y, z*s, NULL);
+            return 1;
+        }
+    }
+    return 0;
+}
+
 int getBiomeAt(const Generator *g, int scale, int x, int y, int z)
 {
-    Range r = {scale, x, z, 1, 1, y, 1};
-    int *ids = allocCache(g, r);
-    int id = genBiomes(g, ids, r);
-    if (id == 0)
-        id = ids[0];
-    else
-        id = none;
-    free(ids);
+#ifdef THREAD_LOCAL
+    // The layer stacks need up to 8095 ints for one cell (1.15+ at 1:1).
+    // A buffer that covers all default entries is kept per thread, so only
+    // custom entries that need more are allocated.
+    enum { CACHE_LEN = 0x2000 };
+    static THREAD_LOCAL int buf[CACHE_LEN];
+#else
+    // without thread-local storage, only small buffers live on the stack
+    enum { CACHE_LEN = 0x200 };
+    int buf[CACHE_LEN];
+#endif
+    int id;
+
+    if (sampleBiomePoint(g, scale, x, y, z, &id))
+        return id;
+    if (g->mc >= MC_B1_8 && g->mc <= MC_1_17 && g->dim == DIM_OVERWORLD &&
+        !getLayerForScale(g, scale))
+        return none; // no layer for this scale
+
+    size_t len = getMinCacheSize(g, scale, 1, 1, 1);
+    int *cache = len <= CACHE_LEN ? buf : (int*) calloc(len, sizeof(int));
+    if (cache == NULL)
+        return none;
+    id = getBiomeAtBuf(g, cache, scale, x, y, z);
+    if (cache != buf)
+        free(cache);
     return id;
 }
 
+int getBiomeAtBuf(const Generator *g, int *cache, int scale, int x, int y, int z)
+{
+    int id;
+    if (sampleBiomePoint(g, scale, x, y, z, &id))
+        return id;
+    Range r = {scale, x, z, 1, 1, y, 1};
+    if (genBiomes(g, cache, r) != 0)
+        return none;
+    return cache[0];
+}
+
 const Layer *getLayerForScale(const Generator *g, int scale)
 {
     if (g->mc > MC_1_17)
@@ -279,10 +532,13 @@ Layer *setupLayer(Layer *l, mapfunc_t *map, int mc,
         l->layerSalt = getLayerSalt(saltbase);
     l->startSalt = 0;
     l->startSeed = 0;
+    l->seed = 0;
+    l->seeded = 0;
     l->noise = NULL;
     l->data = NULL;
     l->p = p;
     l->p2 = p2;
+    l->cache = NULL;
     return l;
 }
 
@@ -605,6 +861,281 @@ int genArea(const Layer *layer, int *out, int areaX, int areaZ, int areaWidth, i
 }
 
 
+static int hashBlock(const LayerCache *lc, uint64_t seed, int id, int bx, int bz)
+{
+    uint64_t h = seed ^ ((uint64_t)(uint32_t)bx << 32 | (uint32_t)bz);
+    h = (h + id) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return (int)(h & lc->mask);
+}
+
+static void unlinkUse(LayerCache *lc, int i)
+{
+    const LayerCacheBlock *b = &lc->blocks[i];
+    if (b->newer >= 0)
+        lc->blocks[b->newer].older = b->older;
+    else
+        lc->newest = b->older;
+    if (b->older >= 0)
+        lc->blocks[b->older].newer = b->newer;
+    else
+        lc->oldest = b->newer;
+}
+
+static void linkNewest(LayerCache *lc, int i)
+{
+    LayerCacheBlock *b = &lc->blocks[i];
+    b->newer = -1;
+    b->older = lc->newest;
+    if (lc->newest >= 0)
+        lc->blocks[lc->newest].newer = i;
+    else
+        lc->oldest = i;
+    lc->newest = i;
+}
+
+static void unlinkHash(LayerCache *lc, int i)
+{
+    const LayerCacheBlock *b = &lc->blocks[i];
+    int *p = &lc->bucket[hashBlock(lc, b->seed, b->id, b->bx, b->bz)];
+    while (*p != i)
+        p = &lc->blocks[*p].next;
+    *p = b->next;
+}
+
+static int findBlock(const LayerCache *lc, uint64_t seed, int id, int bx, int bz)
+{
+    int i = lc->bucket[hashBlock(lc, seed, id, bx, bz)];
+    for (; i >= 0; i = lc->blocks[i].next)
+    {
+        const LayerCacheBlock *b = &lc->blocks[i];
+        if (b->bx == bx && b->bz == bz && b->id == id && b->seed == seed)
+            break;
+    }
+    return i;
+}
+
+static void touchBlock(LayerCache *lc, int i)
+{
+    lc->blocks[i].epoch = lc->epoch;
+    if (lc->newest != i)
+    {
+        unlinkUse(lc, i);
+        linkNewest(lc, i);
+    }
+}
+
+/* Takes a slot for a new block, evicting the least recently used one.
+ * Returns -1 if all blocks are in use by the current request.
+ */
+static int insertBlock(LayerCache *lc, uint64_t seed, int id, int bx, int bz)
+{
+    int i;
+    if (lc->len < lc->cap)
+    {
+        i = lc->len++;
+    }
+    else
+    {
+        i = lc->oldest;
+        if (lc->blocks[i].epoch == lc->epoch)
+            return -1;
+        unlinkUse(lc, i);
+        unlinkHash(lc, i);
+    }
+    LayerCacheBlock *b = &lc->blocks[i];
+    int h = hashBlock(lc, seed, id, bx, bz);
+    b->seed = seed;
+    b->epoch = lc->epoch;
+    b->id = id;
+    b->bx = bx;
+    b->bz = bz;
+    b->next = lc->bucket[h];
+    lc->bucket[h] = i;
+    linkNewest(lc, i);
+    return i;
+}
+
+static int floorBlock(int x)
+{
+    enum { B = LAYER_CACHE_BLOCK };
+    return x >= 0 ? x / B : (x - B + 1) / B;
+}
+
+/* Cached areas are served from the blocks. Otherwise a large area is
+ * generated as a whole and keeps the blocks that it covers, while a small
+ * area generates the blocks around it, which the areas of neighbouring tiles
+ * will need at the coarse layers. Generating whole blocks for large areas
+ * would instead widen the parent areas by a block with every layer.
+ */
+static int mapCached(const Layer *l, int *out, int x, int z, int w, int h)
+{
+    enum { B = LAYER_CACHE_BLOCK };
+    LayerCache *lc = l->cache;
+    int id = (int)(l - lc->layers);
+    int bx0 = floorBlock(x), bx1 = floorBlock(x + w - 1);
+    int bz0 = floorBlock(z), bz1 = floorBlock(z + h - 1);
+    int bx, bz, i, i0, i1, j, j0, j1, miss = 0, err = 0;
+    const int *cells;
+
+    if (lc->depth++ == 0)
+        lc->epoch++;
+
+    for (bz = bz0; bz <= bz1; bz++)
+    {
+        for (bx = bx0; bx <= bx1; bx++)
+        {
+            i = findBlock(lc, l->seed, id, bx, bz);
+            if (i >= 0)
+            {
+                lc->hits[id]++;
+                touchBlock(lc, i);
+            }
+            else
+            {
+                lc->misses[id]++;
+                miss++;
+            }
+        }
+    }
+
+    if (miss && (w > B/2 || h > B/2))
+    {
+        err = lc->map[id](l, out, x, z, w, h);
+        if (err)
+            goto L_end;
+        for (bz = floorBlock(z + B-1); bz < floorBlock(z + h); bz++)
+        {
+            for (bx = floorBlock(x + B-1); bx < floorBlock(x + w); bx++)
+            {
+                if (findBlock(lc, l->seed, id, bx, bz) >= 0)
+                    continue;
+                i = insertBlock(lc, l->seed, id, bx, bz);
+                if (i < 0)
+                    goto L_end;
+                int *dst = lc->cells + (size_t)i * B*B;
+                for (j = 0; j < B; j++)
+                {
+                    memcpy(dst + j * B, out + (int64_t)(bz*B + j - z) * w + (bx*B - x),
+                        B * sizeof(int));
+                }
+            }
+        }
+        goto L_end;
+    }
+
+    for (bz = bz0; bz <= bz1; bz++)
+    {
+        j0 = bz * B > z ? bz * B : z;
+        j1 = bz * B + B < z + h ? bz * B + B : z + h;
+        for (bx = bx0; bx <= bx1; bx++)
+        {
+            i = findBlock(lc, l->seed, id, bx, bz);
+            if (i >= 0)
+            {
+                cells = lc->cells + (size_t)i * B*B;
+            }
+            else
+            {
+                if (!lc->scratch[id])
+                {
+                    size_t len = getMinLayerCacheSize(l, B, B);
+                    lc->scratch[id] = (int*) malloc(len * sizeof(int));
+                    if (!lc->scratch[id])
+                    {
+                        err = 1;
+                        goto L_end;
+                    }
+                }
+                err = lc->map[id](l, lc->scratch[id], bx * B, bz * B, B, B);
+                if (err)
+                    goto L_end;
+                // without a free slot the block is used only this once
+                cells = lc->scratch[id];
+                i = insertBlock(lc, l->seed, id, bx, bz);
+                if (i >= 0)
+                {
+                    int *dst = lc->cells + (size_t)i * B*B;
+                    memcpy(dst, cells, B*B * sizeof(int));
+                }
+            }
+            i0 = bx * B > x ? bx * B : x;
+            i1 = bx * B + B < x + w ? bx * B + B : x + w;
+            cells += (j0 - bz * B) * B + (i0 - bx * B);
+            for (j = j0; j < j1; j++)
+            {
+                memcpy(out + (int64_t)(j - z) * w + (i0 - x),
+                    cells + (j - j0) * B, (i1 - i0) * sizeof(int));
+            }
+        }
+    }
+L_end:
+    lc->depth--;
+    return err;
+}
+
+int initLayerCache(LayerCache *lc, Generator *g, int minScale, size_t maxBytes)
+{
+    enum { B = LAYER_CACHE_BLOCK };
+    size_t n;
+    int i, nb;
+
+    memset(lc, 0, sizeof(*lc));
+    if (g->mc < MC_B1_8 || g->mc > MC_1_17)
+        return 1;
+    n = maxBytes / (B*B * sizeof(int) + sizeof(LayerCacheBlock) + 2*sizeof(int));
+    if (n == 0 || n > INT32_MAX / 2)
+        return 1;
+    for (nb = 1; (size_t)nb < n; nb <<= 1);
+
+    lc->blocks = (LayerCacheBlock*) malloc(n * sizeof(LayerCacheBlock));
+    lc->cells = (int*) malloc(n * B*B * sizeof(int));
+    lc->bucket = (int*) malloc(nb * sizeof(int));
+    if (!lc->blocks || !lc->cells || !lc->bucket)
+    {
+        freeLayerCache(lc);
+        return 1;
+    }
+    for (i = 0; i < nb; i++)
+        lc->bucket[i] = -1;
+    lc->cap = (int) n;
+    lc->mask = nb - 1;
+    lc->newest = lc->oldest = -1;
+    lc->layers = g->ls.layers;
+
+    for (i = 0; i < L_NUM; i++)
+    {
+        Layer *l = &g->ls.layers[i];
+        if (!l->getMap || l->scale < minScale || l->cache)
+            continue;
+        lc->map[i] = l->getMap;
+        l->getMap = mapCached;
+        l->cache = lc;
+    }
+    return 0;
+}
+
+void freeLayerCache(LayerCache *lc)
+{
+    int i;
+    for (i = 0; i < L_NUM; i++)
+    {
+        if (lc->layers && lc->layers[i].cache == lc)
+        {
+            lc->layers[i].getMap = lc->map[i];
+            lc->layers[i].cache = NULL;
+        }
+        free(lc->scratch[i]);
+    }
+    free(lc->blocks);
+    free(lc->cells);
+    free(lc->bucket);
+    memset(lc, 0, sizeof(*lc));
+}
+
+
 int mapApproxHeight(float *y, int *ids, const Generator *g, const SurfaceNoise *sn,
     int x, int z, int w, int h)
 {
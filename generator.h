@@ -10,6 +10,9 @@ enum
     LARGE_BIOMES            = 0x1,
     NO_BETA_OCEAN           = 0x2,
     FORCE_OCEAN_VARIANTS    = 0x4,
+    FLOAT_NOISE             = 0x8,
+    COARSE_CLIMATE          = 0x10,
+    LAZY_LAYER_SEED         = 0x20,
 };
 
 STRUCT(Generator)
@@ -38,6 +41,18 @@ STRUCT(Generator)
     EndNoise en; // MC 1.9
 };
 
+// Cache of seeded generators (see acquireGenerator())
+STRUCT(GeneratorCache)
+{
+    Generator *gen;     // cached generators
+    uint64_t *used;     // time of last access for each entry
+    int cap, len;
+    uint64_t tick;
+    uint64_t hits;
+    uint64_t misses;
+    int lock;
+};
+
 
 #ifdef __cplusplus
 extern "C"
@@ -52,6 +67,19 @@ extern "C"
  * Sets up a biome generator for a given MC version. The 'flags' can be used to
  * control LARGE_BIOMES or to FORCE_OCEAN_VARIANTS to enable ocean variants at
  * scales higher than normal.
+ * The FLOAT_NOISE flag lets 1.18+ generators sample the climate noise in single
+ * precision at scales 1:16 and above. This is intended for quick previews, as
+ * a small fraction of the biomes can differ from the exact generation.
+ * The COARSE_CLIMATE flag interpolates the climate of 1.18+ generators from
+ * every second cell at scales 1:16 and above. Since the lattice grows with the
+ * scale, about 2% of the biomes differ at 1:16, 17% at 1:64 and 47% at 1:256,
+ * so this is only suitable for rough overviews.
+ * With LAZY_LAYER_SEED, applySeed() only records the seed for the layers of
+ * 1.17 and below, and genBiomes() seeds the layers of the requested scale
+ * upon first use (see updateLayerSeed()). Generation then modifies the
+ * generator, so it must not be shared between threads before each scale
+ * has been generated once. Layers used directly have to be updated with
+ * updateLayerSeed(layer, g->seed).
  */
 void setupGenerator(Generator *g, int mc, uint32_t flags);
 
@@ -63,6 +91,33 @@ void setupGenerator(Generator *g, int mc, uint32_t flags);
  */
 void applySeed(Generator *g, int dim, uint64_t seed);
 
+/**
+ * Copies a generator. The internal references (e.g. to the parent layers or
+ * the octaves of the noise) are pointed to the corresponding parts of 'dst',
+ * so that the copy is independent of 'src'.
+ */
+void copyGenerator(Generator *dst, const Generator *src);
+
+/**
+ * Seeding a generator can be considerably more expensive than generating a
+ * small area, because all the noise octaves have to be initialized. A
+ * GeneratorCache keeps up to 'capacity' seeded generators and evicts the least
+ * recently used one when full.
+ *
+ * acquireGenerator() writes a generator in the state of
+ *  setupGenerator(g, mc, flags); applySeed(g, dim, seed);
+ * to 'g', copied from the cache if it is present, and otherwise seeds it and
+ * adds a copy to the cache. The caller owns 'g' afterwards and the cache can
+ * be shared between threads. Returns non-zero if the generator was taken from
+ * the cache. The number of hits and misses are counted in the cache.
+ *
+ * initGeneratorCache() returns zero upon success.
+ */
+int initGeneratorCache(GeneratorCache *gc, int capacity);
+void freeGeneratorCache(GeneratorCache *gc);
+int acquireGenerator(GeneratorCache *gc, Generator *g, int mc, uint32_t flags,
+    int dim, uint64_t seed);
+
 /**
  * Calculates the buffer size (number of ints) required to generate a cuboidal
  * volume of size (sx, sy, sz). If 'sy' is zero the buffer is calculated for a
@@ -91,8 +146,18 @@ int genBiomes(const Generator *g, int *cache, Range r);
  * Gets the biome for a specified scaled position. Note that the scale should
  * be either 1 or 4, for block or biome coordinates respectively.
  * Returns none (-1) upon failure.
+ * The biome noise of 1.18+ and the Nether are sampled directly at the
+ * position, so this is suitable for tight loops. Other generators work in a
+ * buffer of 32 KiB per thread, which is enough for every default layer entry
+ * of 1.17 and below. Only custom entries that need more are allocated, as
+ * is everything above 2 KiB on compilers without thread-local storage.
+ *
+ * The variant getBiomeAtBuf() uses the provided 'cache' as the working buffer
+ * instead, which has to hold getMinCacheSize(g, scale, 1, 1, 1) ints. This is
+ * useful to avoid the size check of the layer stack for repeated calls.
  */
 int getBiomeAt(const Generator *g, int scale, int x, int y, int z);
+int getBiomeAtBuf(const Generator *g, int *cache, int scale, int x, int y, int z);
 
 /**
  * Returns the default layer that corresponds to the given scale.
@@ -127,6 +192,25 @@ Layer *setupLayer(Layer *l, mapfunc_t *map, int mc,
  */
 int genArea(const Layer *layer, int *out, int areaX, int areaZ, int areaWidth, int areaHeight);
 
+/**
+ * Attaches a cache to the layers of a 1.17- generator, which keeps the output
+ * of the layers with a scale of at least 'minScale' in blocks of
+ * LAYER_CACHE_BLOCK x LAYER_CACHE_BLOCK cells. Once 'maxBytes' worth of blocks
+ * are stored, the least recently used block is evicted. Small areas, as the
+ * coarse layers see them, generate the whole blocks around them, so that
+ * neighbouring areas (such as the tiles of a map rendered in scanline or
+ * spiral order) reuse the work of the coarse layers, whereas large areas only
+ * keep the blocks they cover. A 'minScale' of 64 or 256 suits tiles at 1:4.
+ * The hits and misses are counted per LayerId in the cache.
+ * The cached generator must not be shared between threads, and copies made
+ * with copyGenerator() do not use the cache. Layers that get replaced (such as
+ * by the biome filters in finders.h) should not be generated through a cache.
+ * freeLayerCache() detaches the cache from the generator again.
+ * initLayerCache() returns zero upon success.
+ */
+int initLayerCache(LayerCache *lc, Generator *g, int minScale, size_t maxBytes);
+void freeLayerCache(LayerCache *lc);
+
 /**
  * Map an approximation of the Overworld surface height.
  * The horizontal scaling is 1:4. If non-null, the ids are filled with the
@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <string.h>
 #include <png.h>
+#include <zlib.h>
 
 // Function to save an image in PNG format
 int savePNG(const char *filepath, unsigned char *rgb, int width, int height) {
@@ -69,3 +70,169 @@ int savePNG(const char *filepath, unsigned char *rgb, int width, int height) {
 
     return 0;
 }
+
+// Growable buffer for PNGs that are encoded in memory
+typedef struct {
+    unsigned char *data;
+    size_t size, cap;
+} PNGBuffer;
+
+static void writePNGBuffer(png_structp png, png_bytep data, png_size_t len) {
+    PNGBuffer *buf = (PNGBuffer *)png_get_io_ptr(png);
+    if (buf->size + len > buf->cap) {
+        size_t cap = buf->cap ? 2 * buf->cap : 4096;
+        while (cap < buf->size + len)
+            cap *= 2;
+        unsigned char *p = (unsigned char *)realloc(buf->data, cap);
+        if (!p)
+            png_error(png, "Error allocating memory for PNG data");
+        buf->data = p;
+        buf->cap = cap;
+    }
+    memcpy(buf->data + buf->size, data, len);
+    buf->size += len;
+}
+
+static void flushPNGBuffer(png_structp png) {
+    (void) png;
+}
+
+// Encodes a grid of biome IDs as a palette-indexed PNG, where every biome
+// becomes a square of 'pixscale' pixels, to 'fp' if it is not NULL and
+// otherwise to 'buf'. Row 0 of the grid is the top of the image (like
+// biomesToImage() with flip). Fails if the grid needs more than 256 colors.
+static int writePNGIndexed(FILE *fp, PNGBuffer *buf, const int *biomeIds,
+        int sx, int sz, int pixscale, unsigned char biomeColors[256][3]) {
+    png_color palette[256];
+    int16_t lut[256];
+    int numColors = 0;
+    int width = sx * pixscale;
+    int height = sz * pixscale;
+
+    png_bytep indices = (png_bytep)malloc((size_t)sx * sz);
+    png_bytep row = (png_bytep)malloc(width);
+    if (!indices || !row) {
+        fprintf(stderr, "Error allocating memory for PNG rows\n");
+        free(indices);
+        free(row);
+        return -1;
+    }
+
+    // Map the biomes to palette indices in order of appearance
+    memset(lut, -1, sizeof(lut));
+    for (int i = 0; i < sx * sz; i++) {
+        int id = biomeIds[i];
+        int idx = (id >= 0 && id < 256) ? lut[id] : -1;
+        if (idx < 0) {
+            unsigned int r, g, b;
+            if (id < 0 || id >= 256) {
+                // same darkened colors as biomesToImage() for invalid biomes
+                r = biomeColors[id&0x7f][0]-40; r = (r>0xff) ? 0x00 : r&0xff;
+                g = biomeColors[id&0x7f][1]-40; g = (g>0xff) ? 0x00 : g&0xff;
+                b = biomeColors[id&0x7f][2]-40; b = (b>0xff) ? 0x00 : b&0xff;
+            } else {
+                r = biomeColors[id][0];
+                g = biomeColors[id][1];
+                b = biomeColors[id][2];
+            }
+            for (idx = 0; idx < numColors; idx++) {
+                if (palette[idx].red == r && palette[idx].green == g && palette[idx].blue == b)
+                    break;
+            }
+            if (idx == numColors) {
+                if (numColors == 256) {
+                    fprintf(stderr, "Too many colors for a palette image\n");
+                    free(indices);
+                    free(row);
+                    return -1;
+                }
+                palette[idx].red = r;
+                palette[idx].green = g;
+                palette[idx].blue = b;
+                numColors++;
+            }
+            if (id >= 0 && id < 256)
+                lut[id] = idx;
+        }
+        indices[i] = (png_byte)idx;
+    }
+
+    const int paletteSize = numColors > 0 ? numColors : 1;
+
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (!info || setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, info ? &info : NULL);
+        free(indices);
+        free(row);
+        return -1;
+    }
+
+    if (fp)
+        png_init_io(png, fp);
+    else
+        png_set_write_fn(png, buf, writePNGBuffer, flushPNGBuffer);
+
+    // Biome maps consist of long runs of equal indices, and the rows of the
+    // upscale repeat, which the Up filter turns into zeros. Run-length
+    // matching then compresses better than the default at a fraction of the
+    // cost.
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_UP);
+    png_set_compression_strategy(png, Z_RLE);
+
+    png_set_IHDR(
+        png,
+        info,
+        width,
+        height,
+        8,
+        PNG_COLOR_TYPE_PALETTE,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_BASE,
+        PNG_FILTER_TYPE_BASE
+    );
+    png_set_PLTE(png, info, palette, paletteSize);
+    png_write_info(png, info);
+
+    for (int j = 0; j < sz; j++) {
+        const png_byte *src = indices + (size_t)j * sx;
+        for (int i = 0; i < sx; i++)
+            memset(row + i * pixscale, src[i], pixscale);
+        // the upscale is just the same row repeated
+        for (int m = 0; m < pixscale; m++)
+            png_write_row(png, row);
+    }
+
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    free(indices);
+    free(row);
+
+    return 0;
+}
+
+// Function to save a grid of biome IDs as a palette-indexed PNG file
+int savePNGIndexed(const char *filepath, const int *biomeIds, int sx, int sz,
+        int pixscale, unsigned char biomeColors[256][3]) {
+    FILE *fp = fopen(filepath, "wb");
+    if (!fp) {
+        fprintf(stderr, "Error opening file for writing %s: %s\n", filepath, strerror(errno));
+        return -1;
+    }
+    int err = writePNGIndexed(fp, NULL, biomeIds, sx, sz, pixscale, biomeColors);
+    if (fclose(fp) != 0)
+        err = -1;
+    return err;
+}
+
+// Function to encode a grid of biome IDs as a palette-indexed PNG in memory
+unsigned char *encodePNGIndexed(const int *biomeIds, int sx, int sz,
+        int pixscale, unsigned char biomeColors[256][3], size_t *size) {
+    PNGBuffer buf = { NULL, 0, 0 };
+    if (writePNGIndexed(NULL, &buf, biomeIds, sx, sz, pixscale, biomeColors) != 0) {
+        free(buf.data);
+        return NULL;
+    }
+    *size = buf.size;
+    return buf.data;
+}
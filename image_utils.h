@@ -2,8 +2,14 @@
 #define IMAGE_UTILS_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 int savePNG(const char *filepath, unsigned char *rgb, int width, int height);
+int savePNGIndexed(const char *filepath, const int *biomeIds, int sx, int sz,
+        int pixscale, unsigned char biomeColors[256][3]);
+// Returns a malloc'd buffer with the PNG of savePNGIndexed(), or NULL
+unsigned char *encodePNGIndexed(const int *biomeIds, int sx, int sz,
+        int pixscale, unsigned char biomeColors[256][3], size_t *size);
 
 
 #endif // IMAGE_UTILS_H
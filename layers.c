@@ -1,10 +1,14 @@
 #include "layers.h"
+#include "generator.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
 #include <float.h>
 
+#if USE_X86_SIMD
+#include <immintrin.h>
+#endif
 
 //==============================================================================
 // Essentials
@@ -462,14 +466,8 @@ int isSnowy(int id)
 // Essentials
 //==============================================================================
 
-void setLayerSeed(Layer *layer, uint64_t worldSeed)
+static void seedLayer(Layer *layer, uint64_t worldSeed)
 {
-    if (layer->p2 != NULL)
-        setLayerSeed(layer->p2, worldSeed);
-
-    if (layer->p != NULL)
-        setLayerSeed(layer->p, worldSeed);
-
     if (layer->noise != NULL)
     {
         uint64_t s;
@@ -498,6 +496,33 @@ void setLayerSeed(Layer *layer, uint64_t worldSeed)
         layer->startSalt = st;
         layer->startSeed = mcStepSeed(st, 0);
     }
+    layer->seed = worldSeed;
+    layer->seeded = 1;
+}
+
+void setLayerSeed(Layer *layer, uint64_t worldSeed)
+{
+    if (layer->p2 != NULL)
+        setLayerSeed(layer->p2, worldSeed);
+
+    if (layer->p != NULL)
+        setLayerSeed(layer->p, worldSeed);
+
+    seedLayer(layer, worldSeed);
+}
+
+void updateLayerSeed(Layer *layer, uint64_t worldSeed)
+{
+    // the parents are checked individually, as they may have been seeded
+    // separately since this layer
+    if (layer->p2 != NULL)
+        updateLayerSeed(layer->p2, worldSeed);
+
+    if (layer->p != NULL)
+        updateLayerSeed(layer->p, worldSeed);
+
+    if (!layer->seeded || layer->seed != worldSeed)
+        seedLayer(layer, worldSeed);
 }
 
 
@@ -534,6 +559,273 @@ int mapContinent(const Layer * l, int * out, int x, int z, int w, int h)
     return 0;
 }
 
+#if USE_X86_SIMD
+/* Vector kernels for the layers that dominate the generation of larger areas.
+ * A kernel processes a row in groups of adjacent cells and returns the number
+ * of cells it has done, the remainder of the row is left to the scalar loop.
+ * The lower 32 bits of a chunk seed only depend on the lower 32 bits of the
+ * start seed and coordinates, which allows for 32-bit lanes whenever the
+ * layer just looks at the bits 24 and 25 of the seed.
+ */
+
+ATTR_TARGET("avx2")
+static inline __m256i stepSeed32_avx2(__m256i cs, __m256i salt)
+{
+    const __m256i a = _mm256_set1_epi32(1284865837);
+    const __m256i b = _mm256_set1_epi32((int)4150755663U);
+    __m256i t = _mm256_add_epi32(_mm256_mullo_epi32(cs, a), b);
+    return _mm256_add_epi32(_mm256_mullo_epi32(cs, t), salt);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256i getChunkSeed32_avx2(__m256i ss, __m256i x, __m256i z)
+{
+    __m256i cs = _mm256_add_epi32(ss, x);
+    cs = stepSeed32_avx2(cs, z);
+    cs = stepSeed32_avx2(cs, x);
+    return stepSeed32_avx2(cs, z);
+}
+
+/// lanes with the given bit of the seed set
+ATTR_TARGET("avx2")
+static inline __m256i seedBit32_avx2(__m256i cs, int bit)
+{
+    return _mm256_srai_epi32(_mm256_slli_epi32(cs, 31 - bit), 31);
+}
+
+/// r = (cs >> 24) & 3  ->  r==0 ? v00 : r==1 ? v10 : r==2 ? v01 : v11
+ATTR_TARGET("avx2")
+static inline __m256i pick4_avx2(__m256i cs,
+        __m256i v00, __m256i v01, __m256i v10, __m256i v11)
+{
+    __m256i m0 = seedBit32_avx2(cs, 24);
+    __m256i lo = _mm256_blendv_epi8(v00, v10, m0);
+    __m256i hi = _mm256_blendv_epi8(v01, v11, m0);
+    return _mm256_blendv_epi8(lo, hi, seedBit32_avx2(cs, 25));
+}
+
+/// select4() with the equalities of v00 as inputs
+ATTR_TARGET("avx2")
+static inline __m256i select4_avx2(__m256i cs, __m256i st,
+        __m256i v00, __m256i v01, __m256i v10, __m256i v11,
+        __m256i e0001, __m256i e0010, __m256i e0011)
+{
+    // the comparisons yield -1 for equality, i.e. these are negative counts
+    __m256i n00 = _mm256_add_epi32(_mm256_add_epi32(e0001, e0010), e0011);
+    __m256i n10 = _mm256_add_epi32(_mm256_cmpeq_epi32(v10, v01), _mm256_cmpeq_epi32(v10, v11));
+    __m256i n01 = _mm256_cmpeq_epi32(v01, v11);
+    __m256i s00 = _mm256_and_si256(_mm256_cmpgt_epi32(n10, n00), _mm256_cmpgt_epi32(n01, n00));
+    __m256i s10 = _mm256_cmpgt_epi32(n00, n10);
+    __m256i s01 = _mm256_cmpgt_epi32(n00, n01);
+    __m256i v = v11;
+
+    if (_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(s00, s10), s01)) != -1)
+        v = pick4_avx2(stepSeed32_avx2(cs, st), v00, v01, v10, v11);
+    v = _mm256_blendv_epi8(v, v01, s01);
+    v = _mm256_blendv_epi8(v, v10, s10);
+    return _mm256_blendv_epi8(v, v00, s00);
+}
+
+/* Zooms the cells v00 with the neighbours v01, v10 and v11 for the chunk
+ * seeds cs, giving the cells to the right (vt), below (vl) and diagonal (vr).
+ */
+ATTR_TARGET("avx2")
+static inline void zoomCells_avx2(__m256i cs, __m256i salt, int fuzzy,
+        __m256i v00, __m256i v01, __m256i v10, __m256i v11,
+        __m256i e0001, __m256i e0010, __m256i e0011,
+        __m256i *vt, __m256i *vl, __m256i *vr)
+{
+    *vl = _mm256_blendv_epi8(v00, v01, seedBit32_avx2(cs, 24));
+    cs = stepSeed32_avx2(cs, salt);
+    *vt = _mm256_blendv_epi8(v00, v10, seedBit32_avx2(cs, 24));
+    if (fuzzy)
+        *vr = pick4_avx2(stepSeed32_avx2(cs, salt), v00, v01, v10, v11);
+    else
+        *vr = select4_avx2(cs, salt, v00, v01, v10, v11, e0001, e0010, e0011);
+}
+
+/// store the lanes of a and b interleaved
+ATTR_TARGET("avx2")
+static inline void storeZip32_avx2(int *p, __m256i a, __m256i b)
+{
+    __m256i lo = _mm256_unpacklo_epi32(a, b);
+    __m256i hi = _mm256_unpackhi_epi32(a, b);
+    _mm256_storeu_si256((__m256i*)(p + 0), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(p + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+/* Zooms the cells [0,n) of the parent rows v0 and v1 into the rows b0 and b1,
+ * where the cells n and the row v1 have to exist.
+ */
+ATTR_TARGET("avx2")
+static int64_t mapZoomRow_avx2(const int *v0, const int *v1, int *b0, int *b1,
+        int64_t n, int pX, int chunkZ, uint32_t ss, uint32_t st, int fuzzy)
+{
+    const __m256i lane = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i salt = _mm256_set1_epi32(st);
+    const __m256i cz = _mm256_set1_epi32(chunkZ);
+    int64_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256i v00 = _mm256_loadu_si256((const __m256i*)(v0 + i));
+        __m256i v10 = _mm256_loadu_si256((const __m256i*)(v0 + i + 1));
+        __m256i v01 = _mm256_loadu_si256((const __m256i*)(v1 + i));
+        __m256i v11 = _mm256_loadu_si256((const __m256i*)(v1 + i + 1));
+        __m256i e0001 = _mm256_cmpeq_epi32(v00, v01);
+        __m256i e0010 = _mm256_cmpeq_epi32(v00, v10);
+        __m256i e0011 = _mm256_cmpeq_epi32(v00, v11);
+        __m256i vt = v00, vl = v00, vr = v00;
+
+        // uniform neighbourhoods keep v00 without a chunk seed
+        __m256i uni = _mm256_and_si256(_mm256_and_si256(e0001, e0010), e0011);
+        if (_mm256_movemask_epi8(uni) != -1)
+        {
+            int chunkX = (uint32_t)(i + pX) * 2;
+            __m256i cx = _mm256_add_epi32(_mm256_set1_epi32(chunkX), lane);
+            __m256i cs = getChunkSeed32_avx2(_mm256_set1_epi32(ss), cx, cz);
+            zoomCells_avx2(cs, salt, fuzzy, v00, v01, v10, v11,
+                e0001, e0010, e0011, &vt, &vl, &vr);
+        }
+        storeZip32_avx2(b0 + 2*i, v00, vt);
+        storeZip32_avx2(b1 + 2*i, vl, vr);
+    }
+    return i;
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i stepSeed32_avx512(__m512i cs, __m512i salt)
+{
+    const __m512i a = _mm512_set1_epi32(1284865837);
+    const __m512i b = _mm512_set1_epi32((int)4150755663U);
+    __m512i t = _mm512_add_epi32(_mm512_mullo_epi32(cs, a), b);
+    return _mm512_add_epi32(_mm512_mullo_epi32(cs, t), salt);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i getChunkSeed32_avx512(__m512i ss, __m512i x, __m512i z)
+{
+    __m512i cs = _mm512_add_epi32(ss, x);
+    cs = stepSeed32_avx512(cs, z);
+    cs = stepSeed32_avx512(cs, x);
+    return stepSeed32_avx512(cs, z);
+}
+
+ATTR_TARGET("avx512f")
+static inline __mmask16 seedBit32_avx512(__m512i cs, int bit)
+{
+    return _mm512_test_epi32_mask(cs, _mm512_set1_epi32(1 << bit));
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i pick4_avx512(__m512i cs,
+        __m512i v00, __m512i v01, __m512i v10, __m512i v11)
+{
+    __mmask16 m0 = seedBit32_avx512(cs, 24);
+    __m512i lo = _mm512_mask_blend_epi32(m0, v00, v10);
+    __m512i hi = _mm512_mask_blend_epi32(m0, v01, v11);
+    return _mm512_mask_blend_epi32(seedBit32_avx512(cs, 25), lo, hi);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i select4_avx512(__m512i cs, __m512i st,
+        __m512i v00, __m512i v01, __m512i v10, __m512i v11,
+        __mmask16 e0001, __mmask16 e0010, __mmask16 e0011)
+{
+    const __m512i one = _mm512_set1_epi32(1);
+    __m512i cv00 = _mm512_add_epi32(_mm512_maskz_mov_epi32(e0001, one),
+        _mm512_add_epi32(_mm512_maskz_mov_epi32(e0010, one), _mm512_maskz_mov_epi32(e0011, one)));
+    __m512i cv10 = _mm512_add_epi32(
+        _mm512_maskz_mov_epi32(_mm512_cmpeq_epi32_mask(v10, v01), one),
+        _mm512_maskz_mov_epi32(_mm512_cmpeq_epi32_mask(v10, v11), one));
+    __m512i cv01 = _mm512_maskz_mov_epi32(_mm512_cmpeq_epi32_mask(v01, v11), one);
+    __mmask16 s00 = _mm512_cmpgt_epi32_mask(cv00, cv10) & _mm512_cmpgt_epi32_mask(cv00, cv01);
+    __mmask16 s10 = _mm512_cmpgt_epi32_mask(cv10, cv00);
+    __mmask16 s01 = _mm512_cmpgt_epi32_mask(cv01, cv00);
+    __m512i v = v11;
+
+    if ((__mmask16)(s00 | s10 | s01) != 0xffff)
+        v = pick4_avx512(stepSeed32_avx512(cs, st), v00, v01, v10, v11);
+    v = _mm512_mask_blend_epi32(s01, v, v01);
+    v = _mm512_mask_blend_epi32(s10, v, v10);
+    return _mm512_mask_blend_epi32(s00, v, v00);
+}
+
+ATTR_TARGET("avx512f")
+static inline void zoomCells_avx512(__m512i cs, __m512i salt, int fuzzy,
+        __m512i v00, __m512i v01, __m512i v10, __m512i v11,
+        __mmask16 e0001, __mmask16 e0010, __mmask16 e0011,
+        __m512i *vt, __m512i *vl, __m512i *vr)
+{
+    *vl = _mm512_mask_blend_epi32(seedBit32_avx512(cs, 24), v00, v01);
+    cs = stepSeed32_avx512(cs, salt);
+    *vt = _mm512_mask_blend_epi32(seedBit32_avx512(cs, 24), v00, v10);
+    if (fuzzy)
+        *vr = pick4_avx512(stepSeed32_avx512(cs, salt), v00, v01, v10, v11);
+    else
+        *vr = select4_avx512(cs, salt, v00, v01, v10, v11, e0001, e0010, e0011);
+}
+
+ATTR_TARGET("avx512f")
+static inline void storeZip32_avx512(int *p, __m512i a, __m512i b)
+{
+    const __m512i lo = _mm512_setr_epi32(
+        0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+    const __m512i hi = _mm512_add_epi32(lo, _mm512_set1_epi32(8));
+    _mm512_storeu_si512((void*)(p +  0), _mm512_permutex2var_epi32(a, lo, b));
+    _mm512_storeu_si512((void*)(p + 16), _mm512_permutex2var_epi32(a, hi, b));
+}
+
+ATTR_TARGET("avx512f")
+static int64_t mapZoomRow_avx512(const int *v0, const int *v1, int *b0, int *b1,
+        int64_t n, int pX, int chunkZ, uint32_t ss, uint32_t st, int fuzzy)
+{
+    const __m512i lane = _mm512_setr_epi32(
+        0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30);
+    const __m512i salt = _mm512_set1_epi32(st);
+    const __m512i cz = _mm512_set1_epi32(chunkZ);
+    int64_t i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m512i v00 = _mm512_loadu_si512((const void*)(v0 + i));
+        __m512i v10 = _mm512_loadu_si512((const void*)(v0 + i + 1));
+        __m512i v01 = _mm512_loadu_si512((const void*)(v1 + i));
+        __m512i v11 = _mm512_loadu_si512((const void*)(v1 + i + 1));
+        __mmask16 e0001 = _mm512_cmpeq_epi32_mask(v00, v01);
+        __mmask16 e0010 = _mm512_cmpeq_epi32_mask(v00, v10);
+        __mmask16 e0011 = _mm512_cmpeq_epi32_mask(v00, v11);
+        __m512i vt = v00, vl = v00, vr = v00;
+
+        if ((__mmask16)(e0001 & e0010 & e0011) != 0xffff)
+        {
+            int chunkX = (uint32_t)(i + pX) * 2;
+            __m512i cx = _mm512_add_epi32(_mm512_set1_epi32(chunkX), lane);
+            __m512i cs = getChunkSeed32_avx512(_mm512_set1_epi32(ss), cx, cz);
+            zoomCells_avx512(cs, salt, fuzzy, v00, v01, v10, v11,
+                e0001, e0010, e0011, &vt, &vl, &vr);
+        }
+        storeZip32_avx512(b0 + 2*i, v00, vt);
+        storeZip32_avx512(b1 + 2*i, vl, vr);
+    }
+    // finish with the narrower kernel
+    return i + mapZoomRow_avx2(v0+i, v1+i, b0+2*i, b1+2*i, n-i, pX+i, chunkZ, ss, st, fuzzy);
+}
+
+static int64_t mapZoomRow(int simd, const int *v0, const int *v1, int *b0, int *b1,
+        int64_t n, int pX, int chunkZ, uint32_t ss, uint32_t st, int fuzzy)
+{
+    switch (simd)
+    {
+    case SIMD_AVX512:
+        return mapZoomRow_avx512(v0, v1, b0, b1, n, pX, chunkZ, ss, st, fuzzy);
+    case SIMD_AVX2:
+        return mapZoomRow_avx2(v0, v1, b0, b1, n, pX, chunkZ, ss, st, fuzzy);
+    }
+    return 0;
+}
+#endif // USE_X86_SIMD
+
 int mapZoomFuzzy(const Layer * l, int * out, int x, int z, int w, int h)
 {
     int pX = x >> 1;
@@ -554,15 +846,27 @@ int mapZoomFuzzy(const Layer * l, int * out, int x, int z, int w, int h)
 
     const uint32_t st = (uint32_t)l->startSalt;
     const uint32_t ss = (uint32_t)l->startSeed;
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+#endif
 
     for (j = 0; j < pH; j++)
     {
         idx = (j * 2) * newW;
+        i = 0;
+#if USE_X86_SIMD
+        if (j < pH-1)
+        {
+            i = mapZoomRow(simd, out + j*pW, out + (j+1)*pW, buf + idx,
+                buf + idx + newW, pW-1, pX, (j + pZ) * 2, ss, st, 1);
+            idx += 2*i;
+        }
+#endif
 
-        v00 = out[(j+0)*pW];
-        v01 = out[(j+1)*pW];
+        v00 = out[i + (j+0)*pW];
+        v01 = out[i + (j+1)*pW];
 
-        for (i = 0; i < pW; i++, v00 = v10, v01 = v11)
+        for (; i < pW; i++, v00 = v10, v01 = v11)
         {
             v10 = out[i+1 + (j+0)*pW];
             v11 = out[i+1 + (j+1)*pW];
@@ -658,15 +962,27 @@ int mapZoom(const Layer * l, int * out, int x, int z, int w, int h)
 
     const uint32_t st = (uint32_t)l->startSalt;
     const uint32_t ss = (uint32_t)l->startSeed;
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+#endif
 
     for (j = 0; j < pH; j++)
     {
         idx = (j * 2) * newW;
+        i = 0;
+#if USE_X86_SIMD
+        if (j < pH-1)
+        {
+            i = mapZoomRow(simd, out + j*pW, out + (j+1)*pW, buf + idx,
+                buf + idx + newW, pW-1, pX, (j + pZ) * 2, ss, st, 0);
+            idx += 2*i;
+        }
+#endif
 
-        v00 = out[(j+0)*pW];
-        v01 = out[(j+1)*pW];
+        v00 = out[i + (j+0)*pW];
+        v01 = out[i + (j+1)*pW];
 
-        for (i = 0; i < pW; i++, v00 = v10, v01 = v11)
+        for (; i < pW; i++, v00 = v10, v01 = v11)
         {
             v10 = out[i+1 + (j+0)*pW];
             v11 = out[i+1 + (j+1)*pW];
@@ -716,6 +1032,375 @@ int mapZoom(const Layer * l, int * out, int x, int z, int w, int h)
     return 0;
 }
 
+#if USE_X86_SIMD
+/* The land layer tests the chunk seeds modulo 3 and 5, which depends on all of
+ * their 64 bits, so these kernels work on 64-bit lanes. The 40-bit results of
+ * (int64_t)cs >> 24 are exact as doubles and are divisible by a modulus iff
+ * their quotient is an integer.
+ */
+
+ATTR_TARGET("avx2")
+static inline __m256i mullo64_avx2(__m256i a, __m256i b)
+{
+    __m256i lo = _mm256_mul_epu32(a, b);
+    __m256i cross = _mm256_add_epi64(
+        _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+        _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+}
+
+ATTR_TARGET("avx2")
+static inline __m256i stepSeed64_avx2(__m256i cs, __m256i salt)
+{
+    const __m256i a = _mm256_set1_epi64x(6364136223846793005LL);
+    const __m256i b = _mm256_set1_epi64x(1442695040888963407LL);
+    __m256i t = _mm256_add_epi64(mullo64_avx2(cs, a), b);
+    return _mm256_add_epi64(mullo64_avx2(cs, t), salt);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256i getChunkSeed64_avx2(__m256i ss, __m256i x, __m256i z)
+{
+    __m256i cs = _mm256_add_epi64(ss, x);
+    cs = stepSeed64_avx2(cs, z);
+    cs = stepSeed64_avx2(cs, x);
+    return stepSeed64_avx2(cs, z);
+}
+
+/// lanes where mcFirstIsZero(cs, mod)
+ATTR_TARGET("avx2")
+static inline __m256i firstIsZero64_avx2(__m256i cs, int mod)
+{
+    if ((mod & (mod-1)) == 0)
+    {
+        __m256i m = _mm256_set1_epi64x((int64_t)(mod-1) << 24);
+        return _mm256_cmpeq_epi64(_mm256_and_si256(cs, m), _mm256_setzero_si256());
+    }
+    const __m256i magic = _mm256_set1_epi64x(0x4330000000000000LL); // 2^52
+    __m256i u = _mm256_or_si256(_mm256_srli_epi64(cs, 24), magic);
+    __m256d d = _mm256_sub_pd(_mm256_castsi256_pd(u), _mm256_set1_pd(0x1p52));
+    __m256i neg = _mm256_cmpgt_epi64(_mm256_setzero_si256(), cs);
+    d = _mm256_sub_pd(d, _mm256_and_pd(_mm256_castsi256_pd(neg), _mm256_set1_pd(0x1p40)));
+    __m256d q = _mm256_div_pd(d, _mm256_set1_pd(mod));
+    __m256d t = _mm256_round_pd(q, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    return _mm256_castpd_si256(_mm256_cmp_pd(q, t, _CMP_EQ_OQ));
+}
+
+ATTR_TARGET("avx2")
+static inline __m256i loadEpi64_avx2(const int *p)
+{
+    return _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i*)p));
+}
+
+/* The land layer for the cells v11 with the diagonal neighbours v00 to v22,
+ * at the positions (cx,cz) and with the start seeds ss.
+ */
+ATTR_TARGET("avx2")
+static inline __m256i landCells_avx2(__m256i ss, __m256i st, __m256i cx, __m256i cz,
+        __m256i v00, __m256i v20, __m256i v02, __m256i v22, __m256i v11)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    const __m256i fst = _mm256_set1_epi64x(forest);
+    __m256i n00 = _mm256_xor_si256(_mm256_cmpeq_epi64(v00, zero), ones);
+    __m256i n20 = _mm256_xor_si256(_mm256_cmpeq_epi64(v20, zero), ones);
+    __m256i n02 = _mm256_xor_si256(_mm256_cmpeq_epi64(v02, zero), ones);
+    __m256i n22 = _mm256_xor_si256(_mm256_cmpeq_epi64(v22, zero), ones);
+    __m256i o11 = _mm256_cmpeq_epi64(v11, zero);
+    __m256i land = _mm256_or_si256(_mm256_or_si256(n00, n20), _mm256_or_si256(n02, n22));
+    __m256i inland = _mm256_and_si256(_mm256_and_si256(n00, n20), _mm256_and_si256(n02, n22));
+    // ocean next to land and land (other than forest) next to ocean
+    __m256i shore = _mm256_and_si256(o11, land);
+    __m256i coast = _mm256_andnot_si256(_mm256_or_si256(o11,
+        _mm256_or_si256(inland, _mm256_cmpeq_epi64(v11, fst))), ones);
+    __m256i v = v11;
+
+    if (_mm256_testz_si256(_mm256_or_si256(shore, coast), ones))
+        return v;
+
+    __m256i cs = getChunkSeed64_avx2(ss, cx, cz);
+    __m256i m = _mm256_and_si256(coast, firstIsZero64_avx2(cs, 5));
+    v = _mm256_blendv_epi8(v, zero, m);
+
+    if (_mm256_testz_si256(shore, shore))
+        return v;
+
+    // the number of land corners so far, as a negative count
+    __m256i c0 = n00, c1, c2, t;
+    __m256i w = _mm256_blendv_epi8(_mm256_set1_epi64x(1), v00, n00);
+    cs = _mm256_blendv_epi8(cs, stepSeed64_avx2(cs, st), n00);
+
+    t = _mm256_or_si256(_mm256_xor_si256(c0, ones), firstIsZero64_avx2(cs, 2));
+    w = _mm256_blendv_epi8(w, v20, _mm256_and_si256(n20, t));
+    cs = _mm256_blendv_epi8(cs, stepSeed64_avx2(cs, st), n20);
+    c1 = _mm256_add_epi64(c0, n20);
+
+    t = _mm256_cmpeq_epi64(c1, zero);
+    t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpeq_epi64(c1, ones),
+        firstIsZero64_avx2(cs, 2)));
+    t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpeq_epi64(c1, _mm256_set1_epi64x(-2)),
+        firstIsZero64_avx2(cs, 3)));
+    w = _mm256_blendv_epi8(w, v02, _mm256_and_si256(n02, t));
+    cs = _mm256_blendv_epi8(cs, stepSeed64_avx2(cs, st), n02);
+    c2 = _mm256_add_epi64(c1, n02);
+
+    t = _mm256_cmpeq_epi64(c2, zero);
+    t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpeq_epi64(c2, ones),
+        firstIsZero64_avx2(cs, 2)));
+    t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpeq_epi64(c2, _mm256_set1_epi64x(-2)),
+        firstIsZero64_avx2(cs, 3)));
+    t = _mm256_or_si256(t, _mm256_and_si256(_mm256_cmpeq_epi64(c2, _mm256_set1_epi64x(-3)),
+        firstIsZero64_avx2(cs, 4)));
+    w = _mm256_blendv_epi8(w, v22, _mm256_and_si256(n22, t));
+    cs = _mm256_blendv_epi8(cs, stepSeed64_avx2(cs, st), n22);
+
+    t = _mm256_or_si256(_mm256_cmpeq_epi64(w, fst), firstIsZero64_avx2(cs, 3));
+    w = _mm256_blendv_epi8(zero, w, t);
+    return _mm256_blendv_epi8(v, w, shore);
+}
+
+/// pack the 64-bit lanes into 32-bit integers
+ATTR_TARGET("avx2")
+static inline __m128i packEpi64_avx2(__m256i v)
+{
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, even));
+}
+
+/* Sets the cells [0,n) of a row of mapLand, where the rows vz0, vz1 and vz2
+ * of the parent have to extend to n+2.
+ */
+ATTR_TARGET("avx2")
+static int64_t mapLandRow_avx2(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint64_t ss, uint64_t st)
+{
+    const __m256i vss = _mm256_set1_epi64x(ss);
+    const __m256i salt = _mm256_set1_epi64x(st);
+    const __m256i cz = _mm256_set1_epi64x(z);
+    int64_t i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m128i x32 = _mm_add_epi32(_mm_set1_epi32((int)(x + i)), _mm_setr_epi32(0, 1, 2, 3));
+        __m256i v = landCells_avx2(vss, salt, _mm256_cvtepi32_epi64(x32), cz,
+            loadEpi64_avx2(vz0 + i), loadEpi64_avx2(vz0 + i + 2),
+            loadEpi64_avx2(vz2 + i), loadEpi64_avx2(vz2 + i + 2),
+            loadEpi64_avx2(vz1 + i + 1));
+        _mm_storeu_si128((__m128i*)(out + i), packEpi64_avx2(v));
+    }
+    return i;
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i stepSeed64_avx512(__m512i cs, __m512i salt)
+{
+    const __m512i a = _mm512_set1_epi64(6364136223846793005LL);
+    const __m512i b = _mm512_set1_epi64(1442695040888963407LL);
+    __m512i t = _mm512_add_epi64(_mm512_mullox_epi64(cs, a), b);
+    return _mm512_add_epi64(_mm512_mullox_epi64(cs, t), salt);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i getChunkSeed64_avx512(__m512i ss, __m512i x, __m512i z)
+{
+    __m512i cs = _mm512_add_epi64(ss, x);
+    cs = stepSeed64_avx512(cs, z);
+    cs = stepSeed64_avx512(cs, x);
+    return stepSeed64_avx512(cs, z);
+}
+
+ATTR_TARGET("avx512f")
+static inline __mmask8 firstIsZero64_avx512(__m512i cs, int mod)
+{
+    if ((mod & (mod-1)) == 0)
+        return _mm512_testn_epi64_mask(cs, _mm512_set1_epi64((int64_t)(mod-1) << 24));
+    // signed integers below 2^51 in magnitude convert with a magic offset
+    const __m512i magic = _mm512_set1_epi64(0x4338000000000000LL); // 2^52 + 2^51
+    __m512i u = _mm512_add_epi64(_mm512_srai_epi64(cs, 24), magic);
+    __m512d d = _mm512_sub_pd(_mm512_castsi512_pd(u), _mm512_set1_pd(0x1.8p52));
+    __m512d q = _mm512_div_pd(d, _mm512_set1_pd(mod));
+    __m512d t = _mm512_roundscale_pd(q, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    return _mm512_cmp_pd_mask(q, t, _CMP_EQ_OQ);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i loadEpi64_avx512(const int *p)
+{
+    return _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i*)p));
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i landCells_avx512(__m512i ss, __m512i st, __m512i cx, __m512i cz,
+        __m512i v00, __m512i v20, __m512i v02, __m512i v22, __m512i v11)
+{
+    __mmask8 n00 = _mm512_test_epi64_mask(v00, v00);
+    __mmask8 n20 = _mm512_test_epi64_mask(v20, v20);
+    __mmask8 n02 = _mm512_test_epi64_mask(v02, v02);
+    __mmask8 n22 = _mm512_test_epi64_mask(v22, v22);
+    __mmask8 o11 = _mm512_testn_epi64_mask(v11, v11);
+    __mmask8 isf = _mm512_cmpeq_epi64_mask(v11, _mm512_set1_epi64(forest));
+    __mmask8 shore = o11 & (n00 | n20 | n02 | n22);
+    __mmask8 coast = (__mmask8) ~(o11 | isf | (n00 & n20 & n02 & n22));
+    __m512i v = v11;
+
+    if (!(shore | coast))
+        return v;
+
+    __m512i cs = getChunkSeed64_avx512(ss, cx, cz);
+    v = _mm512_mask_mov_epi64(v, coast & firstIsZero64_avx512(cs, 5), _mm512_setzero_si512());
+
+    if (!shore)
+        return v;
+
+    __m512i w = _mm512_mask_mov_epi64(_mm512_set1_epi64(1), n00, v00);
+    __m512i c = _mm512_maskz_mov_epi64(n00, _mm512_set1_epi64(1));
+    __mmask8 t;
+    cs = _mm512_mask_mov_epi64(cs, n00, stepSeed64_avx512(cs, st));
+
+    t = (__mmask8) ~n00 | firstIsZero64_avx512(cs, 2);
+    w = _mm512_mask_mov_epi64(w, n20 & t, v20);
+    cs = _mm512_mask_mov_epi64(cs, n20, stepSeed64_avx512(cs, st));
+    c = _mm512_mask_add_epi64(c, n20, c, _mm512_set1_epi64(1));
+
+    t = _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(0));
+    t |= _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(1)) & firstIsZero64_avx512(cs, 2);
+    t |= _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(2)) & firstIsZero64_avx512(cs, 3);
+    w = _mm512_mask_mov_epi64(w, n02 & t, v02);
+    cs = _mm512_mask_mov_epi64(cs, n02, stepSeed64_avx512(cs, st));
+    c = _mm512_mask_add_epi64(c, n02, c, _mm512_set1_epi64(1));
+
+    t = _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(0));
+    t |= _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(1)) & firstIsZero64_avx512(cs, 2);
+    t |= _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(2)) & firstIsZero64_avx512(cs, 3);
+    t |= _mm512_cmpeq_epi64_mask(c, _mm512_set1_epi64(3)) & firstIsZero64_avx512(cs, 4);
+    w = _mm512_mask_mov_epi64(w, n22 & t, v22);
+    cs = _mm512_mask_mov_epi64(cs, n22, stepSeed64_avx512(cs, st));
+
+    t = _mm512_cmpeq_epi64_mask(w, _mm512_set1_epi64(forest));
+    t |= firstIsZero64_avx512(cs, 3);
+    w = _mm512_maskz_mov_epi64(t, w);
+    return _mm512_mask_mov_epi64(v, shore, w);
+}
+
+ATTR_TARGET("avx512f")
+static int64_t mapLandRow_avx512(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint64_t ss, uint64_t st)
+{
+    const __m512i vss = _mm512_set1_epi64(ss);
+    const __m512i salt = _mm512_set1_epi64(st);
+    const __m512i cz = _mm512_set1_epi64(z);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    int64_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256i x32 = _mm256_add_epi32(_mm256_set1_epi32((int)(x + i)), lane);
+        __m512i v = landCells_avx512(vss, salt, _mm512_cvtepi32_epi64(x32), cz,
+            loadEpi64_avx512(vz0 + i), loadEpi64_avx512(vz0 + i + 2),
+            loadEpi64_avx512(vz2 + i), loadEpi64_avx512(vz2 + i + 2),
+            loadEpi64_avx512(vz1 + i + 1));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm512_cvtepi64_epi32(v));
+    }
+    return i + mapLandRow_avx2(vz0+i, vz1+i, vz2+i, out+i, n-i, (int)(x+i), z, ss, st);
+}
+
+static int64_t mapLandRow(int simd, const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint64_t ss, uint64_t st)
+{
+    switch (simd)
+    {
+    case SIMD_AVX512:
+        return mapLandRow_avx512(vz0, vz1, vz2, out, n, x, z, ss, st);
+    case SIMD_AVX2:
+        return mapLandRow_avx2(vz0, vz1, vz2, out, n, x, z, ss, st);
+    }
+    return 0;
+}
+#endif // USE_X86_SIMD
+
+/// Sets a cell of the land layer from its diagonal neighbours.
+static inline int landCell(uint64_t ss, uint64_t st, int x, int z,
+        int v00, int v20, int v02, int v22, int v11)
+{
+    uint64_t cs;
+    int v = v11;
+
+    switch (v11)
+    {
+    case ocean:
+        if (v00 || v20 || v02 || v22) // corners have non-ocean
+        {
+            /*
+            setChunkSeed(l,x+i,z+j);
+            int inc = 1;
+            if(v00 != 0 && mcNextInt(l,inc++) == 0) v = v00;
+            if(v20 != 0 && mcNextInt(l,inc++) == 0) v = v20;
+            if(v02 != 0 && mcNextInt(l,inc++) == 0) v = v02;
+            if(v22 != 0 && mcNextInt(l,inc++) == 0) v = v22;
+            if(mcNextInt(l,3) == 0) out[x + z*areaWidth] = v;
+            else if(v == 4)         out[x + z*areaWidth] = 4;
+            else                    out[x + z*areaWidth] = 0;
+            */
+
+            cs = getChunkSeed(ss, x, z);
+            int inc = 0;
+            v = 1;
+
+            if (v00 != ocean)
+            {
+                ++inc; v = v00;
+                cs = mcStepSeed(cs, st);
+            }
+            if (v20 != ocean)
+            {
+                if (++inc == 1 || mcFirstIsZero(cs, 2)) v = v20;
+                cs = mcStepSeed(cs, st);
+            }
+            if (v02 != ocean)
+            {
+                switch (++inc)
+                {
+                case 1:     v = v02; break;
+                case 2:     if (mcFirstIsZero(cs, 2)) v = v02; break;
+                default:    if (mcFirstIsZero(cs, 3)) v = v02;
+                }
+                cs = mcStepSeed(cs, st);
+            }
+            if (v22 != ocean)
+            {
+                switch (++inc)
+                {
+                case 1:     v = v22; break;
+                case 2:     if (mcFirstIsZero(cs, 2)) v = v22; break;
+                case 3:     if (mcFirstIsZero(cs, 3)) v = v22; break;
+                default:    if (mcFirstIsZero(cs, 4)) v = v22;
+                }
+                cs = mcStepSeed(cs, st);
+            }
+
+            if (v != forest)
+            {
+                if (!mcFirstIsZero(cs, 3))
+                    v = ocean;
+            }
+        }
+        break;
+
+    case forest:
+        break;
+
+    default:
+        if (v00 == 0 || v20 == 0 || v02 == 0 || v22 == 0)
+        {
+            cs = getChunkSeed(ss, x, z);
+            if (mcFirstIsZero(cs, 5))
+                v = 0;
+        }
+    }
+
+    return v;
+}
+
 /// This is the most performance crittical layer, especially for getBiomeAtPos.
 int mapLand(const Layer * l, int * out, int x, int z, int w, int h)
 {
@@ -731,7 +1416,9 @@ int mapLand(const Layer * l, int * out, int x, int z, int w, int h)
 
     uint64_t st = l->startSalt;
     uint64_t ss = l->startSeed;
-    uint64_t cs;
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+#endif
 
     for (j = 0; j < h; j++)
     {
@@ -739,90 +1426,21 @@ int mapLand(const Layer * l, int * out, int x, int z, int w, int h)
         int *vz1 = out + (j+1)*pW;
         int *vz2 = out + (j+2)*pW;
 
-        int v00 = vz0[0], vt0 = vz0[1];
-        int v02 = vz2[0], vt2 = vz2[1];
+        i = 0;
+#if USE_X86_SIMD
+        i = mapLandRow(simd, vz0, vz1, vz2, out + j*w, w, x, j+z, ss, st);
+#endif
+        int v00 = vz0[i], vt0 = vz0[i+1];
+        int v02 = vz2[i], vt2 = vz2[i+1];
         int v20, v22;
         int v11, v;
 
-        for (i = 0; i < w; i++)
+        for (; i < w; i++)
         {
             v11 = vz1[i+1];
             v20 = vz0[i+2];
             v22 = vz2[i+2];
-            v = v11;
-
-            switch (v11)
-            {
-            case ocean:
-                if (v00 || v20 || v02 || v22) // corners have non-ocean
-                {
-                    /*
-                    setChunkSeed(l,x+i,z+j);
-                    int inc = 1;
-                    if(v00 != 0 && mcNextInt(l,inc++) == 0) v = v00;
-                    if(v20 != 0 && mcNextInt(l,inc++) == 0) v = v20;
-                    if(v02 != 0 && mcNextInt(l,inc++) == 0) v = v02;
-                    if(v22 != 0 && mcNextInt(l,inc++) == 0) v = v22;
-                    if(mcNextInt(l,3) == 0) out[x + z*areaWidth] = v;
-                    else if(v == 4)         out[x + z*areaWidth] = 4;
-                    else                    out[x + z*areaWidth] = 0;
-                    */
-
-                    cs = getChunkSeed(ss, i+x, j+z);
-                    int inc = 0;
-                    v = 1;
-
-                    if (v00 != ocean)
-                    {
-                        ++inc; v = v00;
-                        cs = mcStepSeed(cs, st);
-                    }
-                    if (v20 != ocean)
-                    {
-                        if (++inc == 1 || mcFirstIsZero(cs, 2)) v = v20;
-                        cs = mcStepSeed(cs, st);
-                    }
-                    if (v02 != ocean)
-                    {
-                        switch (++inc)
-                        {
-                        case 1:     v = v02; break;
-                        case 2:     if (mcFirstIsZero(cs, 2)) v = v02; break;
-                        default:    if (mcFirstIsZero(cs, 3)) v = v02;
-                        }
-                        cs = mcStepSeed(cs, st);
-                    }
-                    if (v22 != ocean)
-                    {
-                        switch (++inc)
-                        {
-                        case 1:     v = v22; break;
-                        case 2:     if (mcFirstIsZero(cs, 2)) v = v22; break;
-                        case 3:     if (mcFirstIsZero(cs, 3)) v = v22; break;
-                        default:    if (mcFirstIsZero(cs, 4)) v = v22;
-                        }
-                        cs = mcStepSeed(cs, st);
-                    }
-
-                    if (v != forest)
-                    {
-                        if (!mcFirstIsZero(cs, 3))
-                            v = ocean;
-                    }
-                }
-                break;
-
-            case forest:
-                break;
-
-            default:
-                if (v00 == 0 || v20 == 0 || v02 == 0 || v22 == 0)
-                {
-                    cs = getChunkSeed(ss, i+x, j+z);
-                    if (mcFirstIsZero(cs, 5))
-                        v = 0;
-                }
-            }
+            v = landCell(ss, st, i+x, j+z, v00, v20, v02, v22, v11);
 
             out[i + j*w] = v;
             v00 = vt0; vt0 = v20;
@@ -1704,33 +2322,240 @@ static inline int reduceID(int id)
     return id >= 2 ? 2 + (id & 1) : id;
 }
 
-int mapRiver(const Layer * l, int * out, int x, int z, int w, int h)
+#if USE_X86_SIMD
+ATTR_TARGET("avx2")
+static inline __m256i reduceID_avx2(__m256i id)
 {
-    int pX = x - 1;
-    int pZ = z - 1;
-    int64_t pW = w + 2;
-    int64_t pH = h + 2;
-    int64_t i, j;
-
-    int err = l->p->getMap(l->p, out, pX, pZ, pW, pH);
-    if unlikely(err != 0)
-        return err;
+    __m256i r = _mm256_add_epi32(_mm256_and_si256(id, _mm256_set1_epi32(1)), _mm256_set1_epi32(2));
+    return _mm256_blendv_epi8(id, r, _mm256_cmpgt_epi32(id, _mm256_set1_epi32(1)));
+}
 
-    int mc = l->mc;
+/* Sets the cells [0,n) of a row of mapRiver, where the rows vz0, vz1 and vz2
+ * of the parent have to extend to n+2.
+ */
+ATTR_TARGET("avx2")
+static int64_t mapRiverRow_avx2(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int reduce)
+{
+    const __m256i riv = _mm256_set1_epi32(river);
+    int64_t i;
 
-    for (j = 0; j < h; j++)
+    for (i = 0; i + 8 <= n; i += 8)
     {
-        int *vz0 = out + (j+0)*pW;
-        int *vz1 = out + (j+1)*pW;
-        int *vz2 = out + (j+2)*pW;
-
-        for (i = 0; i < w; i++)
+        __m256i v01 = _mm256_loadu_si256((const __m256i*)(vz1 + i));
+        __m256i v11 = _mm256_loadu_si256((const __m256i*)(vz1 + i + 1));
+        __m256i v21 = _mm256_loadu_si256((const __m256i*)(vz1 + i + 2));
+        __m256i v10 = _mm256_loadu_si256((const __m256i*)(vz0 + i + 1));
+        __m256i v12 = _mm256_loadu_si256((const __m256i*)(vz2 + i + 1));
+        __m256i eq;
+
+        if (reduce)
         {
-            int v01 = vz1[i+0];
-            int v11 = vz1[i+1];
-            int v21 = vz1[i+2];
-            int v10 = vz0[i+1];
-            int v12 = vz2[i+1];
+            v01 = reduceID_avx2(v01);
+            v11 = reduceID_avx2(v11);
+            v21 = reduceID_avx2(v21);
+            v10 = reduceID_avx2(v10);
+            v12 = reduceID_avx2(v12);
+            eq = _mm256_set1_epi32(-1);
+        }
+        else
+        {
+            eq = _mm256_xor_si256(_mm256_cmpeq_epi32(v11, _mm256_setzero_si256()),
+                _mm256_set1_epi32(-1));
+        }
+        eq = _mm256_and_si256(eq, _mm256_cmpeq_epi32(v11, v01));
+        eq = _mm256_and_si256(eq, _mm256_cmpeq_epi32(v11, v10));
+        eq = _mm256_and_si256(eq, _mm256_cmpeq_epi32(v11, v12));
+        eq = _mm256_and_si256(eq, _mm256_cmpeq_epi32(v11, v21));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_or_si256(riv, eq));
+    }
+    return i;
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512i reduceID_avx512(__m512i id)
+{
+    __m512i r = _mm512_add_epi32(_mm512_and_si512(id, _mm512_set1_epi32(1)), _mm512_set1_epi32(2));
+    return _mm512_mask_mov_epi32(id, _mm512_cmpgt_epi32_mask(id, _mm512_set1_epi32(1)), r);
+}
+
+ATTR_TARGET("avx512f")
+static int64_t mapRiverRow_avx512(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int reduce)
+{
+    int64_t i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m512i v01 = _mm512_loadu_si512((const void*)(vz1 + i));
+        __m512i v11 = _mm512_loadu_si512((const void*)(vz1 + i + 1));
+        __m512i v21 = _mm512_loadu_si512((const void*)(vz1 + i + 2));
+        __m512i v10 = _mm512_loadu_si512((const void*)(vz0 + i + 1));
+        __m512i v12 = _mm512_loadu_si512((const void*)(vz2 + i + 1));
+        __mmask16 eq;
+
+        if (reduce)
+        {
+            v01 = reduceID_avx512(v01);
+            v11 = reduceID_avx512(v11);
+            v21 = reduceID_avx512(v21);
+            v10 = reduceID_avx512(v10);
+            v12 = reduceID_avx512(v12);
+            eq = 0xffff;
+        }
+        else
+        {
+            eq = _mm512_test_epi32_mask(v11, v11);
+        }
+        eq &= _mm512_cmpeq_epi32_mask(v11, v01) & _mm512_cmpeq_epi32_mask(v11, v10);
+        eq &= _mm512_cmpeq_epi32_mask(v11, v12) & _mm512_cmpeq_epi32_mask(v11, v21);
+        __m512i v = _mm512_mask_mov_epi32(_mm512_set1_epi32(river), eq, _mm512_set1_epi32(-1));
+        _mm512_storeu_si512((void*)(out + i), v);
+    }
+    return i + mapRiverRow_avx2(vz0+i, vz1+i, vz2+i, out+i, n-i, reduce);
+}
+
+static int64_t mapRiverRow(int simd, const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int reduce)
+{
+    switch (simd)
+    {
+    case SIMD_AVX512:
+        return mapRiverRow_avx512(vz0, vz1, vz2, out, n, reduce);
+    case SIMD_AVX2:
+        return mapRiverRow_avx2(vz0, vz1, vz2, out, n, reduce);
+    }
+    return 0;
+}
+
+/* Sets the cells [0,n) of a row of mapSmooth. Only the bit 24 of the chunk
+ * seeds is used, so the kernels work on 32-bit seeds.
+ */
+ATTR_TARGET("avx2")
+static int64_t mapSmoothRow_avx2(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint32_t ss)
+{
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i cz = _mm256_set1_epi32(z);
+    int64_t i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256i v11 = _mm256_loadu_si256((const __m256i*)(vz1 + i + 1));
+        __m256i v01 = _mm256_loadu_si256((const __m256i*)(vz1 + i));
+        __m256i v10 = _mm256_loadu_si256((const __m256i*)(vz0 + i + 1));
+        __m256i same = _mm256_and_si256(
+            _mm256_cmpeq_epi32(v11, v01), _mm256_cmpeq_epi32(v11, v10));
+
+        if (_mm256_movemask_epi8(same) != -1)
+        {
+            __m256i v21 = _mm256_loadu_si256((const __m256i*)(vz1 + i + 2));
+            __m256i v12 = _mm256_loadu_si256((const __m256i*)(vz2 + i + 1));
+            __m256i e1 = _mm256_cmpeq_epi32(v01, v21);
+            __m256i e2 = _mm256_cmpeq_epi32(v10, v12);
+            __m256i e12 = _mm256_andnot_si256(same, _mm256_and_si256(e1, e2));
+            __m256i v = _mm256_blendv_epi8(v11, v01, e1);
+            v = _mm256_blendv_epi8(v, v10, e2);
+            if (!_mm256_testz_si256(e12, e12))
+            {
+                __m256i cx = _mm256_add_epi32(_mm256_set1_epi32((int)(x + i)), lane);
+                __m256i cs = getChunkSeed32_avx2(_mm256_set1_epi32(ss), cx, cz);
+                __m256i r = _mm256_blendv_epi8(v01, v10, seedBit32_avx2(cs, 24));
+                v = _mm256_blendv_epi8(v, r, e12);
+            }
+            v11 = _mm256_blendv_epi8(v, v11, same);
+        }
+        _mm256_storeu_si256((__m256i*)(out + i), v11);
+    }
+    return i;
+}
+
+ATTR_TARGET("avx512f")
+static int64_t mapSmoothRow_avx512(const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint32_t ss)
+{
+    const __m512i lane = _mm512_setr_epi32(
+        0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i cz = _mm512_set1_epi32(z);
+    int64_t i;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m512i v11 = _mm512_loadu_si512((const void*)(vz1 + i + 1));
+        __m512i v01 = _mm512_loadu_si512((const void*)(vz1 + i));
+        __m512i v10 = _mm512_loadu_si512((const void*)(vz0 + i + 1));
+        __mmask16 diff = _mm512_cmpneq_epi32_mask(v11, v01) | _mm512_cmpneq_epi32_mask(v11, v10);
+
+        if (diff)
+        {
+            __m512i v21 = _mm512_loadu_si512((const void*)(vz1 + i + 2));
+            __m512i v12 = _mm512_loadu_si512((const void*)(vz2 + i + 1));
+            __mmask16 e1 = diff & _mm512_cmpeq_epi32_mask(v01, v21);
+            __mmask16 e2 = diff & _mm512_cmpeq_epi32_mask(v10, v12);
+            __mmask16 e12 = e1 & e2;
+            v11 = _mm512_mask_mov_epi32(v11, e1, v01);
+            v11 = _mm512_mask_mov_epi32(v11, e2, v10);
+            if (e12)
+            {
+                __m512i cx = _mm512_add_epi32(_mm512_set1_epi32((int)(x + i)), lane);
+                __m512i cs = getChunkSeed32_avx512(_mm512_set1_epi32(ss), cx, cz);
+                __mmask16 b = seedBit32_avx512(cs, 24);
+                v11 = _mm512_mask_mov_epi32(v11, e12 & ~b, v01);
+            }
+        }
+        _mm512_storeu_si512((void*)(out + i), v11);
+    }
+    return i + mapSmoothRow_avx2(vz0+i, vz1+i, vz2+i, out+i, n-i, (int)(x+i), z, ss);
+}
+
+static int64_t mapSmoothRow(int simd, const int *vz0, const int *vz1, const int *vz2,
+        int *out, int64_t n, int x, int z, uint32_t ss)
+{
+    switch (simd)
+    {
+    case SIMD_AVX512:
+        return mapSmoothRow_avx512(vz0, vz1, vz2, out, n, x, z, ss);
+    case SIMD_AVX2:
+        return mapSmoothRow_avx2(vz0, vz1, vz2, out, n, x, z, ss);
+    }
+    return 0;
+}
+#endif // USE_X86_SIMD
+
+int mapRiver(const Layer * l, int * out, int x, int z, int w, int h)
+{
+    int pX = x - 1;
+    int pZ = z - 1;
+    int64_t pW = w + 2;
+    int64_t pH = h + 2;
+    int64_t i, j;
+
+    int err = l->p->getMap(l->p, out, pX, pZ, pW, pH);
+    if unlikely(err != 0)
+        return err;
+
+    int mc = l->mc;
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+#endif
+
+    for (j = 0; j < h; j++)
+    {
+        int *vz0 = out + (j+0)*pW;
+        int *vz1 = out + (j+1)*pW;
+        int *vz2 = out + (j+2)*pW;
+
+        i = 0;
+#if USE_X86_SIMD
+        i = mapRiverRow(simd, vz0, vz1, vz2, out + j*w, w, mc >= MC_1_7);
+#endif
+        for (; i < w; i++)
+        {
+            int v01 = vz1[i+0];
+            int v11 = vz1[i+1];
+            int v21 = vz1[i+2];
+            int v10 = vz0[i+1];
+            int v12 = vz2[i+1];
 
             if (mc >= MC_1_7)
             {
@@ -1775,6 +2600,9 @@ int mapSmooth(const Layer * l, int * out, int x, int z, int w, int h)
 
     uint64_t ss = l->startSeed;
     uint64_t cs;
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+#endif
 
     for (j = 0; j < h; j++)
     {
@@ -1782,7 +2610,11 @@ int mapSmooth(const Layer * l, int * out, int x, int z, int w, int h)
         int *vz1 = out + (j+1)*pW;
         int *vz2 = out + (j+2)*pW;
 
-        for (i = 0; i < w; i++)
+        i = 0;
+#if USE_X86_SIMD
+        i = mapSmoothRow(simd, vz0, vz1, vz2, out + j*w, w, x, j+z, ss);
+#endif
+        for (; i < w; i++)
         {
             int v11 = vz1[i+1];
             int v01 = vz1[i+0];
@@ -2634,3 +3466,769 @@ void voronoiAccess3D(uint64_t sha, int x, int y, int z, int *x4, int *y4, int *z
 
 
 
+
+//==============================================================================
+// Seed Lanes
+//==============================================================================
+
+/* The lane variants of the layers mirror the scalar layers, with the cells of
+ * the area holding SEED_LANES interleaved values. The lanes are independent
+ * and the loops over them are innermost, so that the compiler can vectorize
+ * them where the layer is branch free.
+ */
+
+static int getMapLanes(const Layer *l, int *out, const uint64_t *ws,
+        int x, int z, int w, int h);
+
+static inline void getLaneStart(const Layer *l, const uint64_t *ws,
+        uint64_t *st, uint64_t *ss)
+{
+    int k;
+    for (k = 0; k < SEED_LANES; k++)
+    {
+        // as in setLayerSeed(), a zero salt keeps the layer unseeded
+        st[k] = l->layerSalt ? getStartSalt(ws[k], l->layerSalt) : 0;
+        ss[k] = l->layerSalt ? mcStepSeed(st[k], 0) : 0;
+    }
+}
+
+#if USE_X86_SIMD
+/* Vector variants of the land and zoom lanes, which take the lanes of a cell
+ * as vectors, using the same kernels as the row-wise layers. The zoom works
+ * on 32-bit seeds, so an AVX-512 vector holds all 16 lanes, while the land
+ * needs the 64-bit seeds and two vectors.
+ */
+
+ATTR_TARGET("avx2")
+static void mapZoomLanes_avx2(const int *out, int *buf, int64_t pW, int64_t pH,
+        int pX, int pZ, const uint32_t *ss, const uint32_t *st, int fuzzy)
+{
+    int64_t newW = pW * 2;
+    int64_t i, j;
+    int k;
+
+    for (j = 0; j < pH; j++)
+    {
+        __m256i cz = _mm256_set1_epi32((j + pZ) * 2);
+        for (i = 0; i < pW; i++)
+        {
+            const int *p0 = out + (i + j*pW) * SEED_LANES;
+            const int *p1 = p0 + pW * SEED_LANES;
+            int *b0 = buf + (j*2*newW + i*2) * SEED_LANES;
+            int *b1 = b0 + newW * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k += 8)
+            {
+                __m256i v00 = _mm256_loadu_si256((const __m256i*)(p0 + k));
+                __m256i v10 = _mm256_loadu_si256((const __m256i*)(p0 + k + SEED_LANES));
+                __m256i v01 = _mm256_loadu_si256((const __m256i*)(p1 + k));
+                __m256i v11 = _mm256_loadu_si256((const __m256i*)(p1 + k + SEED_LANES));
+                __m256i e0001 = _mm256_cmpeq_epi32(v00, v01);
+                __m256i e0010 = _mm256_cmpeq_epi32(v00, v10);
+                __m256i e0011 = _mm256_cmpeq_epi32(v00, v11);
+                __m256i vt = v00, vl = v00, vr = v00;
+
+                __m256i uni = _mm256_and_si256(_mm256_and_si256(e0001, e0010), e0011);
+                if (_mm256_movemask_epi8(uni) != -1)
+                {
+                    __m256i vss = _mm256_loadu_si256((const __m256i*)(ss + k));
+                    __m256i salt = _mm256_loadu_si256((const __m256i*)(st + k));
+                    __m256i cx = _mm256_set1_epi32((i + pX) * 2);
+                    __m256i cs = getChunkSeed32_avx2(vss, cx, cz);
+                    zoomCells_avx2(cs, salt, fuzzy, v00, v01, v10, v11,
+                        e0001, e0010, e0011, &vt, &vl, &vr);
+                }
+                _mm256_storeu_si256((__m256i*)(b0 + k), v00);
+                _mm256_storeu_si256((__m256i*)(b0 + k + SEED_LANES), vt);
+                _mm256_storeu_si256((__m256i*)(b1 + k), vl);
+                _mm256_storeu_si256((__m256i*)(b1 + k + SEED_LANES), vr);
+            }
+        }
+    }
+}
+
+/// one vector holds the SEED_LANES = 16 lanes
+ATTR_TARGET("avx512f")
+static void mapZoomLanes_avx512(const int *out, int *buf, int64_t pW, int64_t pH,
+        int pX, int pZ, const uint32_t *ss, const uint32_t *st, int fuzzy)
+{
+    const __m512i vss = _mm512_loadu_si512((const void*) ss);
+    const __m512i salt = _mm512_loadu_si512((const void*) st);
+    int64_t newW = pW * 2;
+    int64_t i, j;
+
+    for (j = 0; j < pH; j++)
+    {
+        __m512i cz = _mm512_set1_epi32((j + pZ) * 2);
+        for (i = 0; i < pW; i++)
+        {
+            const int *p0 = out + (i + j*pW) * SEED_LANES;
+            const int *p1 = p0 + pW * SEED_LANES;
+            int *b0 = buf + (j*2*newW + i*2) * SEED_LANES;
+            int *b1 = b0 + newW * SEED_LANES;
+            __m512i v00 = _mm512_loadu_si512((const void*)(p0));
+            __m512i v10 = _mm512_loadu_si512((const void*)(p0 + SEED_LANES));
+            __m512i v01 = _mm512_loadu_si512((const void*)(p1));
+            __m512i v11 = _mm512_loadu_si512((const void*)(p1 + SEED_LANES));
+            __mmask16 e0001 = _mm512_cmpeq_epi32_mask(v00, v01);
+            __mmask16 e0010 = _mm512_cmpeq_epi32_mask(v00, v10);
+            __mmask16 e0011 = _mm512_cmpeq_epi32_mask(v00, v11);
+            __m512i vt = v00, vl = v00, vr = v00;
+
+            if ((__mmask16)(e0001 & e0010 & e0011) != 0xffff)
+            {
+                __m512i cx = _mm512_set1_epi32((i + pX) * 2);
+                __m512i cs = getChunkSeed32_avx512(vss, cx, cz);
+                zoomCells_avx512(cs, salt, fuzzy, v00, v01, v10, v11,
+                    e0001, e0010, e0011, &vt, &vl, &vr);
+            }
+            _mm512_storeu_si512((void*)(b0), v00);
+            _mm512_storeu_si512((void*)(b0 + SEED_LANES), vt);
+            _mm512_storeu_si512((void*)(b1), vl);
+            _mm512_storeu_si512((void*)(b1 + SEED_LANES), vr);
+        }
+    }
+}
+
+ATTR_TARGET("avx2")
+static void mapLandLanes_avx2(int *out, int64_t pW, int x, int z, int w, int h,
+        const uint64_t *ss, const uint64_t *st)
+{
+    int64_t i, j;
+    int k;
+
+    for (j = 0; j < h; j++)
+    {
+        __m256i cz = _mm256_set1_epi64x(j + z);
+        for (i = 0; i < w; i++)
+        {
+            __m256i cx = _mm256_set1_epi64x((int)(i + x));
+            const int *p = out + (i + j*pW) * SEED_LANES;
+            const int *q = p + 2*pW * SEED_LANES;
+            __m128i v[SEED_LANES / 4];
+            for (k = 0; k < SEED_LANES / 4; k++, p += 4, q += 4)
+            {
+                __m256i vss = _mm256_loadu_si256((const __m256i*)(ss + 4*k));
+                __m256i salt = _mm256_loadu_si256((const __m256i*)(st + 4*k));
+                v[k] = packEpi64_avx2(landCells_avx2(vss, salt, cx, cz,
+                    loadEpi64_avx2(p), loadEpi64_avx2(p + 2*SEED_LANES),
+                    loadEpi64_avx2(q), loadEpi64_avx2(q + 2*SEED_LANES),
+                    loadEpi64_avx2(p + (pW+1) * SEED_LANES)));
+            }
+            // store once all groups are read, as 'o' can alias 'p'
+            int *o = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES / 4; k++)
+                _mm_storeu_si128((__m128i*)(o + 4*k), v[k]);
+        }
+    }
+}
+
+ATTR_TARGET("avx512f")
+static void mapLandLanes_avx512(int *out, int64_t pW, int x, int z, int w, int h,
+        const uint64_t *ss, const uint64_t *st)
+{
+    int64_t i, j;
+    int k;
+
+    for (j = 0; j < h; j++)
+    {
+        __m512i cz = _mm512_set1_epi64(j + z);
+        for (i = 0; i < w; i++)
+        {
+            __m512i cx = _mm512_set1_epi64((int)(i + x));
+            const int *p = out + (i + j*pW) * SEED_LANES;
+            const int *q = p + 2*pW * SEED_LANES;
+            __m256i v[SEED_LANES / 8];
+            for (k = 0; k < SEED_LANES / 8; k++, p += 8, q += 8)
+            {
+                __m512i vss = _mm512_loadu_si512((const void*)(ss + 8*k));
+                __m512i salt = _mm512_loadu_si512((const void*)(st + 8*k));
+                v[k] = _mm512_cvtepi64_epi32(landCells_avx512(vss, salt, cx, cz,
+                    loadEpi64_avx512(p), loadEpi64_avx512(p + 2*SEED_LANES),
+                    loadEpi64_avx512(q), loadEpi64_avx512(q + 2*SEED_LANES),
+                    loadEpi64_avx512(p + (pW+1) * SEED_LANES)));
+            }
+            int *o = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES / 8; k++)
+                _mm256_storeu_si256((__m256i*)(o + 8*k), v[k]);
+        }
+    }
+}
+#endif // USE_X86_SIMD
+
+static int mapContinentLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            int *v = out + (j*w + i) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+                v[k] = mcFirstIsZero(getChunkSeed(ss[k], i + x, j + z), 10);
+        }
+    }
+
+    if (x > -w && x <= 0 && z > -h && z <= 0)
+    {
+        for (k = 0; k < SEED_LANES; k++)
+            out[(-z * (int64_t)w - x) * SEED_LANES + k] = 1;
+    }
+
+    return 0;
+}
+
+static int mapZoomLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h, int fuzzy)
+{
+    int pX = x >> 1;
+    int pZ = z >> 1;
+    int64_t pW = ((x + w) >> 1) - pX + 1;
+    int64_t pH = ((z + h) >> 1) - pZ + 1;
+    int64_t i, j;
+    int k;
+
+    int err = getMapLanes(l->p, out, ws, pX, pZ, pW, pH);
+    if unlikely(err != 0)
+        return err;
+
+    uint64_t st64[SEED_LANES], ss64[SEED_LANES];
+    uint32_t st[SEED_LANES], ss[SEED_LANES];
+    getLaneStart(l, ws, st64, ss64);
+    for (k = 0; k < SEED_LANES; k++)
+    {
+        st[k] = (uint32_t) st64[k];
+        ss[k] = (uint32_t) ss64[k];
+    }
+
+    int64_t newW = pW * 2;
+    int *buf = out + pW * pH * SEED_LANES;
+
+#if USE_X86_SIMD
+    int simd = getSimdLevel();
+    if (simd == SIMD_AVX512 && SEED_LANES == 16)
+        mapZoomLanes_avx512(out, buf, pW, pH, pX, pZ, ss, st, fuzzy);
+    else if (simd == SIMD_AVX2)
+        mapZoomLanes_avx2(out, buf, pW, pH, pX, pZ, ss, st, fuzzy);
+    else
+#endif
+    for (j = 0; j < pH; j++)
+    {
+        int chunkZ = (j + pZ) * 2;
+        for (i = 0; i < pW; i++)
+        {
+            int chunkX = (i + pX) * 2;
+            const int *p0 = out + (i + j*pW) * SEED_LANES;
+            const int *p1 = p0 + pW * SEED_LANES;
+            int *b0 = buf + (j*2*newW + i*2) * SEED_LANES;
+            int *b1 = b0 + newW * SEED_LANES;
+
+            // uniform neighbourhoods yield v00 on all paths, which keeps the
+            // lanes free of branches
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v00 = p0[k], v10 = p0[k + SEED_LANES];
+                int v01 = p1[k], v11 = p1[k + SEED_LANES];
+
+                uint32_t cs = ss[k];
+                cs += chunkX;
+                cs *= cs * 1284865837 + 4150755663;
+                cs += chunkZ;
+                cs *= cs * 1284865837 + 4150755663;
+                cs += chunkX;
+                cs *= cs * 1284865837 + 4150755663;
+                cs += chunkZ;
+                int vl = (cs >> 24) & 1 ? v01 : v00;
+
+                cs *= cs * 1284865837 + 4150755663;
+                cs += st[k];
+                int vt = (cs >> 24) & 1 ? v10 : v00;
+                int vr;
+
+                if (fuzzy)
+                {
+                    cs *= cs * 1284865837 + 4150755663;
+                    cs += st[k];
+                    int r = (cs >> 24) & 3;
+                    vr = r==0 ? v00 : r==1 ? v10 : r==2 ? v01 : v11;
+                }
+                else
+                {
+                    vr = select4(cs, st[k], v00, v01, v10, v11);
+                }
+
+                b0[k] = v00;
+                b0[k + SEED_LANES] = vt;
+                b1[k] = vl;
+                b1[k + SEED_LANES] = vr;
+            }
+        }
+    }
+
+    for (j = 0; j < h; j++)
+    {
+        memmove(&out[j*w * SEED_LANES],
+            &buf[((j + (z & 1))*newW + (x & 1)) * SEED_LANES],
+            w * SEED_LANES * sizeof(int));
+    }
+
+    return 0;
+}
+
+static int mapLandLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+#if USE_X86_SIMD
+    switch (getSimdLevel())
+    {
+    case SIMD_AVX512:
+        mapLandLanes_avx512(out, pW, x, z, w, h, ss, st);
+        return 0;
+    case SIMD_AVX2:
+        mapLandLanes_avx2(out, pW, x, z, w, h, ss, st);
+        return 0;
+    }
+#endif
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *p = out + (i + j*pW) * SEED_LANES;
+            const int *q = p + 2*pW * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                v[k] = landCell(ss[k], st[k], i+x, j+z,
+                    p[k], p[k + 2*SEED_LANES], q[k], q[k + 2*SEED_LANES],
+                    p[k + (pW+1)*SEED_LANES]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapIslandLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *p = out + (i+1 + j*pW) * SEED_LANES;
+            const int *c = p + pW * SEED_LANES;
+            const int *q = c + pW * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v11 = c[k];
+                if (v11 == Oceanic && p[k] == Oceanic && q[k] == Oceanic &&
+                    c[k - SEED_LANES] == Oceanic && c[k + SEED_LANES] == Oceanic)
+                {
+                    if (mcFirstIsZero(getChunkSeed(ss[k], i+x, j+z), 2))
+                        v11 = 1;
+                }
+                v[k] = v11;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapSnowLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *c = out + (i+1 + (j+1)*pW) * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v11 = c[k];
+                if (!isShallowOcean(v11))
+                {
+                    int r = mcFirstInt(getChunkSeed(ss[k], i+x, j+z), 6);
+                    if      (r == 0) v11 = Freezing;
+                    else if (r <= 1) v11 = Cold;
+                    else             v11 = Warm;
+                }
+                v[k] = v11;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/// mapCool() and mapHeat() replace 'id' next to one of 'a' or 'b' with 'r'
+static int mapClimateEdgeLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h, int id, int a, int b, int r)
+{
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *p = out + (i+1 + j*pW) * SEED_LANES;
+            const int *c = p + pW * SEED_LANES;
+            const int *q = c + pW * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v11 = c[k];
+                int v10 = p[k], v12 = q[k];
+                int v01 = c[k - SEED_LANES], v21 = c[k + SEED_LANES];
+                if (v11 == id && (isAny4(a, v10, v21, v01, v12) ||
+                    isAny4(b, v10, v21, v01, v12)))
+                {
+                    v11 = r;
+                }
+                v[k] = v11;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapSpecialLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int err = getMapLanes(l->p, out, ws, x, z, w, h);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                if (v[k] == Oceanic)
+                    continue;
+                uint64_t cs = getChunkSeed(ss[k], i+x, j+z);
+                if (mcFirstIsZero(cs, 13))
+                {
+                    cs = mcStepSeed(cs, st[k]);
+                    v[k] |= (uint32_t)(1 + mcFirstInt(cs, 15)) << 8 & 0xf00;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapMushroomLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *p = out + (i + j*pW) * SEED_LANES;
+            const int *q = p + 2*pW * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v11 = p[k + (pW+1)*SEED_LANES];
+                if (v11 == 0 && !p[k] && !p[k + 2*SEED_LANES] &&
+                    !q[k] && !q[k + 2*SEED_LANES])
+                {
+                    if (mcFirstIsZero(getChunkSeed(ss[k], i+x, j+z), 100))
+                        v11 = mushroom_fields;
+                }
+                v[k] = v11;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapDeepOceanLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    int64_t i, j;
+    int k;
+
+    int64_t pW = w + 2;
+    int err = getMapLanes(l->p, out, ws, x - 1, z - 1, pW, h + 2);
+    if unlikely(err != 0)
+        return err;
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            const int *p = out + (i+1 + j*pW) * SEED_LANES;
+            const int *c = p + pW * SEED_LANES;
+            const int *q = c + pW * SEED_LANES;
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int v11 = c[k];
+                if (isShallowOcean(v11) &&
+                    isShallowOcean(p[k]) && isShallowOcean(q[k]) &&
+                    isShallowOcean(c[k - SEED_LANES]) &&
+                    isShallowOcean(c[k + SEED_LANES]))
+                {
+                    switch (v11)
+                    {
+                    case warm_ocean:        v11 = deep_warm_ocean; break;
+                    case lukewarm_ocean:    v11 = deep_lukewarm_ocean; break;
+                    case cold_ocean:        v11 = deep_cold_ocean; break;
+                    case frozen_ocean:      v11 = deep_frozen_ocean; break;
+                    default:                v11 = deep_ocean;
+                    }
+                }
+                v[k] = v11;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapBiomeLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int err = getMapLanes(l->p, out, ws, x, z, w, h);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                int id = v[k];
+                int hasHighBit = (id & 0xf00);
+                id &= ~0xf00;
+
+                if (isOceanic(id) || id == mushroom_fields)
+                {
+                    v[k] = id;
+                    continue;
+                }
+
+                uint64_t cs = getChunkSeed(ss[k], i + x, j + z);
+
+                switch (id)
+                {
+                case Warm:
+                    if (hasHighBit) id = mcFirstIsZero(cs, 3) ? badlands_plateau : wooded_badlands_plateau;
+                    else id = warmBiomes[mcFirstInt(cs, 6)];
+                    break;
+                case Lush:
+                    if (hasHighBit) id = jungle;
+                    else id = lushBiomes[mcFirstInt(cs, 6)];
+                    break;
+                case Cold:
+                    if (hasHighBit) id = giant_tree_taiga;
+                    else id = coldBiomes[mcFirstInt(cs, 4)];
+                    break;
+                case Freezing:
+                    id = snowBiomes[mcFirstInt(cs, 4)];
+                    break;
+                default:
+                    id = mushroom_fields;
+                }
+                v[k] = id;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int mapBambooLanes(const Layer * l, int * out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    uint64_t st[SEED_LANES], ss[SEED_LANES];
+    int64_t i, j;
+    int k;
+
+    int err = getMapLanes(l->p, out, ws, x, z, w, h);
+    if unlikely(err != 0)
+        return err;
+    getLaneStart(l, ws, st, ss);
+
+    for (j = 0; j < h; j++)
+    {
+        for (i = 0; i < w; i++)
+        {
+            int *v = out + (i + j*w) * SEED_LANES;
+            for (k = 0; k < SEED_LANES; k++)
+            {
+                if (v[k] == jungle &&
+                    mcFirstIsZero(getChunkSeed(ss[k], i + x, j + z), 10))
+                {
+                    v[k] = bamboo_jungle;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static int getMapLanes(const Layer *l, int *out, const uint64_t *ws,
+        int x, int z, int w, int h)
+{
+    mapfunc_t *f = l->getMap;
+
+    if (f == mapContinent)
+        return mapContinentLanes(l, out, ws, x, z, w, h);
+    if (f == mapZoomFuzzy)
+        return mapZoomLanes(l, out, ws, x, z, w, h, 1);
+    if (f == mapZoom)
+        return mapZoomLanes(l, out, ws, x, z, w, h, 0);
+    if (f == mapLand)
+        return mapLandLanes(l, out, ws, x, z, w, h);
+    if (f == mapIsland)
+        return mapIslandLanes(l, out, ws, x, z, w, h);
+    if (f == mapSnow)
+        return mapSnowLanes(l, out, ws, x, z, w, h);
+    if (f == mapCool)
+        return mapClimateEdgeLanes(l, out, ws, x, z, w, h, Warm, Cold, Freezing, Lush);
+    if (f == mapHeat)
+        return mapClimateEdgeLanes(l, out, ws, x, z, w, h, Freezing, Warm, Lush, Cold);
+    if (f == mapSpecial)
+        return mapSpecialLanes(l, out, ws, x, z, w, h);
+    if (f == mapMushroom)
+        return mapMushroomLanes(l, out, ws, x, z, w, h);
+    if (f == mapDeepOcean)
+        return mapDeepOceanLanes(l, out, ws, x, z, w, h);
+    if (f == mapBiome && l->mc >= MC_1_7)
+        return mapBiomeLanes(l, out, ws, x, z, w, h);
+    if (f == mapBamboo)
+        return mapBambooLanes(l, out, ws, x, z, w, h);
+    return 1; // no lane variant for this layer
+}
+
+static int hasLanes(const Layer *l)
+{
+    mapfunc_t *f = l->getMap;
+    if (f == mapBiome)
+        return l->mc >= MC_1_7;
+    return f == mapContinent || f == mapZoomFuzzy || f == mapZoom ||
+        f == mapLand || f == mapIsland || f == mapSnow || f == mapCool ||
+        f == mapHeat || f == mapSpecial || f == mapMushroom ||
+        f == mapDeepOcean || f == mapBamboo;
+}
+
+/* Copies the layer and its parents into the 'n' entries that remain in 'buf',
+ * provided that they all have a lane variant.
+ */
+static Layer *copyLaneLayers(const Layer *l, Layer *buf, int *n)
+{
+    if (!hasLanes(l) || *n <= 0)
+        return NULL;
+    Layer *c = &buf[--*n];
+    *c = *l;
+    if (l->p && !(c->p = copyLaneLayers(l->p, buf, n)))
+        return NULL;
+    if (l->p2 && !(c->p2 = copyLaneLayers(l->p2, buf, n)))
+        return NULL;
+    return c;
+}
+
+int genSeedLanes(const Layer *layer, int *out, const uint64_t *seeds,
+        int x, int z, int w, int h)
+{
+#if USE_X86_SIMD
+    if (getSimdLevel() != SIMD_NONE)
+        return getMapLanes(layer, out, seeds, x, z, w, h);
+#endif
+    // Without vector instructions the interleaved lanes are slower than
+    // generating the seeds one by one, on a copy of the layers.
+    Layer buf[L_NUM];
+    int n = L_NUM;
+    Layer *l = copyLaneLayers(layer, buf, &n);
+    if (l == NULL)
+        return 1;
+    int *area = (int*) malloc(getMinLayerCacheSize(l, w, h) * sizeof(int));
+    if (area == NULL)
+        return 1;
+    int64_t i;
+    int k, err = 0;
+    for (k = 0; k < SEED_LANES && !err; k++)
+    {
+        setLayerSeed(l, seeds[k]);
+        err = genArea(l, area, x, z, w, h);
+        for (i = 0; i < (int64_t)w*h; i++)
+            out[i*SEED_LANES + k] = area[i];
+    }
+    free(area);
+    return err;
+}
@@ -87,6 +87,7 @@ enum LayerId
 
 
 struct Layer;
+struct LayerCache;
 typedef int (mapfunc_t)(const struct Layer *, int *, int, int, int, int);
 
 STRUCT(Layer)
@@ -96,16 +97,19 @@ STRUCT(Layer)
     int8_t mc;          // minecraft version
     int8_t zoom;        // zoom factor of layer
     int8_t edge;        // maximum border required from parent layer
+    int8_t seeded;      // layer has been seeded with 'seed'
     int scale;          // scale of this layer (cell = scale x scale blocks)
 
     uint64_t layerSalt; // processed salt or initialization mode
     uint64_t startSalt; // (depends on world seed) used to step PRNG forward
     uint64_t startSeed; // (depends on world seed) start for chunk seeds
+    uint64_t seed;      // world seed of the start values
 
     void *noise;        // (depends on world seed) noise map data
     void *data;         // generic data for custom layers
 
     Layer *p, *p2;      // parent layers
+    struct LayerCache *cache; // optional cache of the output (see initLayerCache())
 };
 
 // Overworld biome generator up to 1.17
@@ -121,6 +125,35 @@ STRUCT(LayerStack)
     PerlinNoise oceanRnd;
 };
 
+// Layer cache (see initLayerCache())
+enum { LAYER_CACHE_BLOCK = 32 }; // width of the cached blocks in cells
+
+STRUCT(LayerCacheBlock)
+{
+    uint64_t seed;      // world seed of the layer
+    uint64_t epoch;     // request in which the block was last used
+    int id;             // LayerId
+    int bx, bz;         // block position
+    int next;           // next block in the same hash bucket
+    int newer, older;   // neighbours in the order of use
+};
+
+STRUCT(LayerCache)
+{
+    Layer *layers;          // cached layer stack
+    mapfunc_t *map[L_NUM];  // generator functions of the cached layers
+    int *scratch[L_NUM];    // buffers to generate a block of each layer
+    LayerCacheBlock *blocks;
+    int *cells;             // cells of the blocks
+    int *bucket;            // hash table of the blocks
+    int cap, len, mask;
+    int newest, oldest;
+    int depth;              // nesting of the cached layers being generated
+    uint64_t epoch;         // counter of the outermost requests
+    uint64_t hits[L_NUM];
+    uint64_t misses[L_NUM];
+};
+
 
 #ifdef __cplusplus
 extern "C"
@@ -151,6 +184,12 @@ int getBiomeDepthAndScale(int id, double *depth, double *scale, int *grass);
 /* Applies the given world seed to the layer and all dependent layers. */
 void setLayerSeed(Layer *layer, uint64_t worldSeed);
 
+/* Applies the given world seed to the layer and those dependent layers which
+ * are not already seeded with it, so repeated calls cost only a walk over the
+ * layers.
+ */
+void updateLayerSeed(Layer *layer, uint64_t worldSeed);
+
 //==============================================================================
 // Layers
 //==============================================================================
@@ -201,6 +240,28 @@ void voronoiAccess3D(uint64_t sha, int x, int y, int z, int *x4, int *y4, int *z
 void mapVoronoiPlane(uint64_t sha, int *out, int *src,
     int x, int z, int w, int h, int y, int px, int pz, int pw, int ph);
 
+//==============================================================================
+// Seed Lanes
+//==============================================================================
+
+enum { SEED_LANES = 16 };
+
+/* Generates the area (x,z,w,h) of a layer for SEED_LANES world seeds at once,
+ * for filters that test many seeds on a few cells of an early layer. This is
+ * independent of the seed that was applied to the layer with setLayerSeed().
+ * The lanes are interleaved, such that out[(j*w + i)*SEED_LANES + k] is the
+ * cell (x+i, z+j) for seeds[k], and the buffer has to hold
+ * getMinLayerCacheSize(layer, w, h) * SEED_LANES elements.
+ * Only the layers of 1.7 - 1.17 up to L_BIOME_256 and L_BAMBOO_256 have a
+ * lane variant; for other layers the function returns non-zero.
+ * The lanes pay off with AVX2 or AVX-512 (see getSimdLevel()), otherwise the
+ * seeds are generated one after another. The biome filters of finders.h work
+ * on a single seed and replace layers with filter variants, so they do not
+ * use the lanes.
+ */
+int genSeedLanes(const Layer *layer, int *out, const uint64_t *seeds,
+        int x, int z, int w, int h);
+
 
 #ifdef __cplusplus
 }
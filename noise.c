@@ -4,6 +4,12 @@
 #include <math.h>
 #include <stdio.h>
 
+#if USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+int g_simd_limit = SIMD_AVX512;
+
 // grad()
 #if 0
 static double indexedLerp(int idx, double d1, double d2, double d3)
@@ -207,6 +213,807 @@ double samplePerlin(const PerlinNoise *noise, double d1, double d2, double d3,
     return lerp(t3, l1, l5);
 }
 
+
+/// Maximum number of points that the batched samplers process at once.
+enum { BATCH_LEN = 64 };
+
+/// Lattice state of a row of samples (x[i], y, z) that only varies along x.
+STRUCT(PerlinRow)
+{
+    double d2, d3, t2, t3;
+    uint8_t h2, h3;
+};
+
+static void initPerlinRow(const PerlinNoise *noise, PerlinRow *pr,
+        double d2, double d3)
+{
+    if (d2 == 0.0)
+    {
+        pr->d2 = noise->d2;
+        pr->h2 = noise->h2;
+        pr->t2 = noise->t2;
+    }
+    else
+    {
+        d2 += noise->b;
+        double i2 = floor(d2);
+        d2 -= i2;
+        pr->h2 = (int) i2;
+        pr->d2 = d2;
+        pr->t2 = d2*d2*d2 * (d2 * (d2*6.0-15.0) + 10.0);
+    }
+
+    d3 += noise->c;
+    double i3 = floor(d3);
+    d3 -= i3;
+    pr->h3 = (int) i3;
+    pr->d3 = d3;
+    pr->t3 = d3*d3*d3 * (d3 * (d3*6.0-15.0) + 10.0);
+}
+
+/// Gradient indices of the eight cell corners, in the order l1..l8 of
+/// samplePerlin().
+static inline void getCellGradients(const uint8_t *idx,
+        uint8_t h1, uint8_t h2, uint8_t h3, uint8_t g[8])
+{
+    uint8_t a1 = idx[h1]   + h2;
+    uint8_t b1 = idx[h1+1] + h2;
+    uint8_t a2 = idx[a1]   + h3;
+    uint8_t b2 = idx[b1]   + h3;
+    uint8_t a3 = idx[a1+1] + h3;
+    uint8_t b3 = idx[b1+1] + h3;
+    g[0] = idx[a2];   g[1] = idx[b2];
+    g[2] = idx[a3];   g[3] = idx[b3];
+    g[4] = idx[a2+1]; g[5] = idx[b2+1];
+    g[6] = idx[a3+1]; g[7] = idx[b3+1];
+}
+
+/* Samples a row of points (x[i], y, z), equivalent to samplePerlin() with
+ * yamp = 0. The permutation chain is reused for as long as consecutive
+ * samples stay within the same lattice cell.
+ */
+static void samplePerlinRowX(const PerlinNoise *noise, double *out,
+        const double *x, int n, const PerlinRow *pr)
+{
+    const double d2 = pr->d2, d3 = pr->d3, t2 = pr->t2, t3 = pr->t3;
+    uint8_t g[8] = {0};
+    int i, hprev = -1;
+
+    for (i = 0; i < n; i++)
+    {
+        double d1 = x[i] + noise->a;
+        double i1 = floor(d1);
+        d1 -= i1;
+        uint8_t h1 = (int) i1;
+        double t1 = d1*d1*d1 * (d1 * (d1*6.0-15.0) + 10.0);
+
+        if (h1 != hprev)
+        {
+            getCellGradients(noise->d, h1, pr->h2, pr->h3, g);
+            hprev = h1;
+        }
+
+        double l1 = indexedLerp(g[0], d1,   d2,   d3);
+        double l2 = indexedLerp(g[1], d1-1, d2,   d3);
+        double l3 = indexedLerp(g[2], d1,   d2-1, d3);
+        double l4 = indexedLerp(g[3], d1-1, d2-1, d3);
+        double l5 = indexedLerp(g[4], d1,   d2,   d3-1);
+        double l6 = indexedLerp(g[5], d1-1, d2,   d3-1);
+        double l7 = indexedLerp(g[6], d1,   d2-1, d3-1);
+        double l8 = indexedLerp(g[7], d1-1, d2-1, d3-1);
+
+        l1 = lerp(t1, l1, l2);
+        l3 = lerp(t1, l3, l4);
+        l5 = lerp(t1, l5, l6);
+        l7 = lerp(t1, l7, l8);
+
+        l1 = lerp(t2, l1, l3);
+        l5 = lerp(t2, l5, l7);
+
+        out[i] = lerp(t3, l1, l5);
+    }
+}
+
+#if USE_X86_SIMD
+// The gradients of indexedLerp() can all be written as (+-u) + (+-v), where
+// u is one of {a,b} and v is one of {b,c}. These masks hold the respective
+// choice for each of the 16 gradient indices.
+enum {
+    GRAD_U_IS_B = 0xAF00,
+    GRAD_V_IS_C = 0xAFF0,
+    GRAD_NEG_U  = 0xEAAA,
+    GRAD_NEG_V  = 0x8CCC,
+};
+
+ATTR_TARGET("avx2")
+static inline __m256d indexedLerp_avx2(__m128i idx, __m256d a, __m256d b, __m256d c)
+{
+    // shift the mask bit for each gradient index into the sign bit
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i sh = _mm256_sub_epi64(_mm256_set1_epi64x(63),
+        _mm256_cvtepu32_epi64(_mm_and_si128(idx, _mm_set1_epi32(0xf))));
+    __m256i mu = _mm256_sllv_epi64(_mm256_set1_epi64x(GRAD_U_IS_B), sh);
+    __m256i mv = _mm256_sllv_epi64(_mm256_set1_epi64x(GRAD_V_IS_C), sh);
+    __m256i nu = _mm256_sllv_epi64(_mm256_set1_epi64x(GRAD_NEG_U), sh);
+    __m256i nv = _mm256_sllv_epi64(_mm256_set1_epi64x(GRAD_NEG_V), sh);
+    __m256d u = _mm256_blendv_pd(a, b, _mm256_castsi256_pd(mu));
+    __m256d v = _mm256_blendv_pd(b, c, _mm256_castsi256_pd(mv));
+    u = _mm256_xor_pd(u, _mm256_castsi256_pd(_mm256_and_si256(nu, sign)));
+    v = _mm256_xor_pd(v, _mm256_castsi256_pd(_mm256_and_si256(nv, sign)));
+    return _mm256_add_pd(u, v);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256d smooth_avx2(__m256d d)
+{   // d*d*d * (d * (d*6.0-15.0) + 10.0)
+    __m256d t = _mm256_sub_pd(_mm256_mul_pd(d, _mm256_set1_pd(6.0)),
+        _mm256_set1_pd(15.0));
+    t = _mm256_add_pd(_mm256_mul_pd(d, t), _mm256_set1_pd(10.0));
+    return _mm256_mul_pd(_mm256_mul_pd(_mm256_mul_pd(d, d), d), t);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256d lerp_avx2(__m256d part, __m256d from, __m256d to)
+{
+    return _mm256_add_pd(from, _mm256_mul_pd(part, _mm256_sub_pd(to, from)));
+}
+
+// Looks up the pair {idx[h], idx[h+1]} for each lane as the lower two bytes.
+// The permutations have padding after idx[256], so the 4-byte reads stay
+// inside the PerlinNoise object.
+#define GATHER_IDX_AVX2(IDX, H) \
+    _mm_i32gather_epi32((const int*)(IDX), (H), 1)
+#define GATHER_IDX_AVX2X8(IDX, H) \
+    _mm256_i32gather_epi32((const int*)(IDX), (H), 1)
+
+ATTR_TARGET("avx2")
+static void samplePerlinBatch_avx2(const PerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n)
+{
+    const uint8_t *idx = noise->d;
+    const __m128i m8 = _mm_set1_epi32(0xff);
+    const __m256d one = _mm256_set1_pd(1.0);
+    int i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m256d d1 = _mm256_add_pd(_mm256_loadu_pd(x+i), _mm256_set1_pd(noise->a));
+        __m256d d2 = _mm256_add_pd(_mm256_loadu_pd(y+i), _mm256_set1_pd(noise->b));
+        __m256d d3 = _mm256_add_pd(_mm256_loadu_pd(z+i), _mm256_set1_pd(noise->c));
+        __m256d i1 = _mm256_floor_pd(d1);
+        __m256d i2 = _mm256_floor_pd(d2);
+        __m256d i3 = _mm256_floor_pd(d3);
+        d1 = _mm256_sub_pd(d1, i1);
+        d2 = _mm256_sub_pd(d2, i2);
+        d3 = _mm256_sub_pd(d3, i3);
+        __m128i h1 = _mm_and_si128(_mm256_cvttpd_epi32(i1), m8);
+        __m128i h2 = _mm_and_si128(_mm256_cvttpd_epi32(i2), m8);
+        __m128i h3 = _mm_and_si128(_mm256_cvttpd_epi32(i3), m8);
+        __m256d t1 = smooth_avx2(d1);
+        __m256d t2 = smooth_avx2(d2);
+        __m256d t3 = smooth_avx2(d3);
+
+        __m128i g1 = GATHER_IDX_AVX2(idx, h1);
+        __m128i a1 = _mm_and_si128(_mm_add_epi32(g1, h2), m8);
+        __m128i b1 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g1, 8), h2), m8);
+        __m128i g2 = GATHER_IDX_AVX2(idx, a1);
+        __m128i g3 = GATHER_IDX_AVX2(idx, b1);
+        __m128i a2 = _mm_and_si128(_mm_add_epi32(g2, h3), m8);
+        __m128i b2 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g2, 8), h3), m8);
+        __m128i a3 = _mm_and_si128(_mm_add_epi32(g3, h3), m8);
+        __m128i b3 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g3, 8), h3), m8);
+        __m128i g4 = GATHER_IDX_AVX2(idx, a2);
+        __m128i g5 = GATHER_IDX_AVX2(idx, b2);
+        __m128i g6 = GATHER_IDX_AVX2(idx, a3);
+        __m128i g7 = GATHER_IDX_AVX2(idx, b3);
+
+        __m256d e1 = _mm256_sub_pd(d1, one);
+        __m256d e2 = _mm256_sub_pd(d2, one);
+        __m256d e3 = _mm256_sub_pd(d3, one);
+        __m256d l1 = indexedLerp_avx2(g4, d1, d2, d3);
+        __m256d l5 = indexedLerp_avx2(_mm_srli_epi32(g4, 8), d1, d2, e3);
+        __m256d l2 = indexedLerp_avx2(g6, e1, d2, d3);
+        __m256d l6 = indexedLerp_avx2(_mm_srli_epi32(g6, 8), e1, d2, e3);
+        __m256d l3 = indexedLerp_avx2(g5, d1, e2, d3);
+        __m256d l7 = indexedLerp_avx2(_mm_srli_epi32(g5, 8), d1, e2, e3);
+        __m256d l4 = indexedLerp_avx2(g7, e1, e2, d3);
+        __m256d l8 = indexedLerp_avx2(_mm_srli_epi32(g7, 8), e1, e2, e3);
+
+        l1 = lerp_avx2(t1, l1, l2);
+        l3 = lerp_avx2(t1, l3, l4);
+        l5 = lerp_avx2(t1, l5, l6);
+        l7 = lerp_avx2(t1, l7, l8);
+        l1 = lerp_avx2(t2, l1, l3);
+        l5 = lerp_avx2(t2, l5, l7);
+        _mm256_storeu_pd(out+i, lerp_avx2(t3, l1, l5));
+    }
+    for (; i < n; i++)
+        out[i] = samplePerlin(noise, x[i], y[i], z[i], 0, 0);
+}
+
+/* Row variant: the y/z state is broadcast, and when all lanes fall into the
+ * same x-cell the gradients are looked up once (and kept for the next
+ * lanes), instead of gathering the permutation chain per lane.
+ */
+ATTR_TARGET("avx2")
+static void samplePerlinRow_avx2(const PerlinNoise *noise, double *out,
+        const double *x, int n, const PerlinRow *pr)
+{
+    const uint8_t *idx = noise->d;
+    const __m128i m8 = _mm_set1_epi32(0xff);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m128i h2 = _mm_set1_epi32(pr->h2);
+    const __m128i h3 = _mm_set1_epi32(pr->h3);
+    const __m256d d2 = _mm256_set1_pd(pr->d2), e2 = _mm256_set1_pd(pr->d2-1);
+    const __m256d d3 = _mm256_set1_pd(pr->d3), e3 = _mm256_set1_pd(pr->d3-1);
+    const __m256d t2 = _mm256_set1_pd(pr->t2), t3 = _mm256_set1_pd(pr->t3);
+    __m128i gc[8] = {0}, gv[8];
+    const __m128i *g;
+    int i, k, hprev = -1;
+
+    for (i = 0; i + 4 <= n; i += 4)
+    {
+        __m256d d1 = _mm256_add_pd(_mm256_loadu_pd(x+i), _mm256_set1_pd(noise->a));
+        __m256d i1 = _mm256_floor_pd(d1);
+        d1 = _mm256_sub_pd(d1, i1);
+        __m128i h1 = _mm_and_si128(_mm256_cvttpd_epi32(i1), m8);
+        __m256d t1 = smooth_avx2(d1);
+        int h10 = _mm_cvtsi128_si32(h1);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(h1, _mm_set1_epi32(h10))) == 0xffff)
+        {
+            if (h10 != hprev)
+            {
+                uint8_t gs[8];
+                getCellGradients(idx, h10, pr->h2, pr->h3, gs);
+                for (k = 0; k < 8; k++)
+                    gc[k] = _mm_set1_epi32(gs[k]);
+                hprev = h10;
+            }
+            g = gc;
+        }
+        else
+        {
+            __m128i g1 = GATHER_IDX_AVX2(idx, h1);
+            __m128i a1 = _mm_and_si128(_mm_add_epi32(g1, h2), m8);
+            __m128i b1 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g1, 8), h2), m8);
+            __m128i g2 = GATHER_IDX_AVX2(idx, a1);
+            __m128i g3 = GATHER_IDX_AVX2(idx, b1);
+            __m128i a2 = _mm_and_si128(_mm_add_epi32(g2, h3), m8);
+            __m128i a3 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g2, 8), h3), m8);
+            __m128i b2 = _mm_and_si128(_mm_add_epi32(g3, h3), m8);
+            __m128i b3 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(g3, 8), h3), m8);
+            gv[0] = GATHER_IDX_AVX2(idx, a2);
+            gv[1] = GATHER_IDX_AVX2(idx, b2);
+            gv[2] = GATHER_IDX_AVX2(idx, a3);
+            gv[3] = GATHER_IDX_AVX2(idx, b3);
+            gv[4] = _mm_srli_epi32(gv[0], 8);
+            gv[5] = _mm_srli_epi32(gv[1], 8);
+            gv[6] = _mm_srli_epi32(gv[2], 8);
+            gv[7] = _mm_srli_epi32(gv[3], 8);
+            g = gv;
+        }
+
+        __m256d e1 = _mm256_sub_pd(d1, one);
+        __m256d l1 = indexedLerp_avx2(g[0], d1, d2, d3);
+        __m256d l2 = indexedLerp_avx2(g[1], e1, d2, d3);
+        __m256d l3 = indexedLerp_avx2(g[2], d1, e2, d3);
+        __m256d l4 = indexedLerp_avx2(g[3], e1, e2, d3);
+        __m256d l5 = indexedLerp_avx2(g[4], d1, d2, e3);
+        __m256d l6 = indexedLerp_avx2(g[5], e1, d2, e3);
+        __m256d l7 = indexedLerp_avx2(g[6], d1, e2, e3);
+        __m256d l8 = indexedLerp_avx2(g[7], e1, e2, e3);
+
+        l1 = lerp_avx2(t1, l1, l2);
+        l3 = lerp_avx2(t1, l3, l4);
+        l5 = lerp_avx2(t1, l5, l6);
+        l7 = lerp_avx2(t1, l7, l8);
+        l1 = lerp_avx2(t2, l1, l3);
+        l5 = lerp_avx2(t2, l5, l7);
+        _mm256_storeu_pd(out+i, lerp_avx2(t3, l1, l5));
+    }
+    if (i < n)
+        samplePerlinRowX(noise, out+i, x+i, n-i, pr);
+}
+
+/* Single precision variants, with eight lanes per AVX2 register (and sixteen
+ * for AVX-512). The lattice
+ * position and the cell fraction are still determined in double precision,
+ * since the coordinates can be far larger than the float mantissa.
+ */
+ATTR_TARGET("avx2")
+static inline __m256 indexedLerp_avx2f(__m256i idx, __m256 a, __m256 b, __m256 c)
+{
+    const __m256i sign = _mm256_set1_epi32(INT32_MIN);
+    __m256i sh = _mm256_sub_epi32(_mm256_set1_epi32(31),
+        _mm256_and_si256(idx, _mm256_set1_epi32(0xf)));
+    __m256i mu = _mm256_sllv_epi32(_mm256_set1_epi32(GRAD_U_IS_B), sh);
+    __m256i mv = _mm256_sllv_epi32(_mm256_set1_epi32(GRAD_V_IS_C), sh);
+    __m256i nu = _mm256_sllv_epi32(_mm256_set1_epi32(GRAD_NEG_U), sh);
+    __m256i nv = _mm256_sllv_epi32(_mm256_set1_epi32(GRAD_NEG_V), sh);
+    __m256 u = _mm256_blendv_ps(a, b, _mm256_castsi256_ps(mu));
+    __m256 v = _mm256_blendv_ps(b, c, _mm256_castsi256_ps(mv));
+    u = _mm256_xor_ps(u, _mm256_castsi256_ps(_mm256_and_si256(nu, sign)));
+    v = _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_and_si256(nv, sign)));
+    return _mm256_add_ps(u, v);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256 smooth_avx2f(__m256 d)
+{
+    __m256 t = _mm256_sub_ps(_mm256_mul_ps(d, _mm256_set1_ps(6.0f)),
+        _mm256_set1_ps(15.0f));
+    t = _mm256_add_ps(_mm256_mul_ps(d, t), _mm256_set1_ps(10.0f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(d, d), d), t);
+}
+
+ATTR_TARGET("avx2")
+static inline __m256 lerp_avx2f(__m256 part, __m256 from, __m256 to)
+{
+    return _mm256_add_ps(from, _mm256_mul_ps(part, _mm256_sub_ps(to, from)));
+}
+
+ATTR_TARGET("avx2")
+static int samplePerlinRowFloat_avx2(const PerlinNoise *noise, float *out,
+        const double *x, int n, const PerlinRow *pr)
+{
+    const uint8_t *idx = noise->d;
+    const __m256i m8 = _mm256_set1_epi32(0xff);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256d a = _mm256_set1_pd(noise->a);
+    const __m256i h2 = _mm256_set1_epi32(pr->h2);
+    const __m256i h3 = _mm256_set1_epi32(pr->h3);
+    const __m256 d2 = _mm256_set1_ps(pr->d2), e2 = _mm256_set1_ps(pr->d2-1);
+    const __m256 d3 = _mm256_set1_ps(pr->d3), e3 = _mm256_set1_ps(pr->d3-1);
+    const __m256 t2 = _mm256_set1_ps(pr->t2), t3 = _mm256_set1_ps(pr->t3);
+    __m256i gc[8] = {0}, gv[8];
+    const __m256i *g;
+    int i, k, hprev = -1;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m256d xl = _mm256_add_pd(_mm256_loadu_pd(x+i), a);
+        __m256d xh = _mm256_add_pd(_mm256_loadu_pd(x+i+4), a);
+        __m256d il = _mm256_floor_pd(xl);
+        __m256d ih = _mm256_floor_pd(xh);
+        __m256 d1 = _mm256_set_m128(
+            _mm256_cvtpd_ps(_mm256_sub_pd(xh, ih)),
+            _mm256_cvtpd_ps(_mm256_sub_pd(xl, il)));
+        __m256i h1 = _mm256_and_si256(_mm256_set_m128i(
+            _mm256_cvttpd_epi32(ih), _mm256_cvttpd_epi32(il)), m8);
+        __m256 t1 = smooth_avx2f(d1);
+        int h10 = _mm256_cvtsi256_si32(h1);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(h1, _mm256_set1_epi32(h10))) == -1)
+        {
+            if (h10 != hprev)
+            {
+                uint8_t gs[8];
+                getCellGradients(idx, h10, pr->h2, pr->h3, gs);
+                for (k = 0; k < 8; k++)
+                    gc[k] = _mm256_set1_epi32(gs[k]);
+                hprev = h10;
+            }
+            g = gc;
+        }
+        else
+        {
+            __m256i g1 = GATHER_IDX_AVX2X8(idx, h1);
+            __m256i a1 = _mm256_and_si256(_mm256_add_epi32(g1, h2), m8);
+            __m256i b1 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g1, 8), h2), m8);
+            __m256i g2 = GATHER_IDX_AVX2X8(idx, a1);
+            __m256i g3 = GATHER_IDX_AVX2X8(idx, b1);
+            __m256i a2 = _mm256_and_si256(_mm256_add_epi32(g2, h3), m8);
+            __m256i a3 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g2, 8), h3), m8);
+            __m256i b2 = _mm256_and_si256(_mm256_add_epi32(g3, h3), m8);
+            __m256i b3 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g3, 8), h3), m8);
+            gv[0] = GATHER_IDX_AVX2X8(idx, a2);
+            gv[1] = GATHER_IDX_AVX2X8(idx, b2);
+            gv[2] = GATHER_IDX_AVX2X8(idx, a3);
+            gv[3] = GATHER_IDX_AVX2X8(idx, b3);
+            gv[4] = _mm256_srli_epi32(gv[0], 8);
+            gv[5] = _mm256_srli_epi32(gv[1], 8);
+            gv[6] = _mm256_srli_epi32(gv[2], 8);
+            gv[7] = _mm256_srli_epi32(gv[3], 8);
+            g = gv;
+        }
+
+        __m256 e1 = _mm256_sub_ps(d1, one);
+        __m256 l1 = indexedLerp_avx2f(g[0], d1, d2, d3);
+        __m256 l2 = indexedLerp_avx2f(g[1], e1, d2, d3);
+        __m256 l3 = indexedLerp_avx2f(g[2], d1, e2, d3);
+        __m256 l4 = indexedLerp_avx2f(g[3], e1, e2, d3);
+        __m256 l5 = indexedLerp_avx2f(g[4], d1, d2, e3);
+        __m256 l6 = indexedLerp_avx2f(g[5], e1, d2, e3);
+        __m256 l7 = indexedLerp_avx2f(g[6], d1, e2, e3);
+        __m256 l8 = indexedLerp_avx2f(g[7], e1, e2, e3);
+
+        l1 = lerp_avx2f(t1, l1, l2);
+        l3 = lerp_avx2f(t1, l3, l4);
+        l5 = lerp_avx2f(t1, l5, l6);
+        l7 = lerp_avx2f(t1, l7, l8);
+        l1 = lerp_avx2f(t2, l1, l3);
+        l5 = lerp_avx2f(t2, l5, l7);
+        _mm256_storeu_ps(out+i, lerp_avx2f(t3, l1, l5));
+    }
+    return i;
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512d indexedLerp_avx512(__m256i idx, __m512d a, __m512d b, __m512d c)
+{
+    const __m512i sign = _mm512_set1_epi64(INT64_MIN);
+    __m512i sh = _mm512_sub_epi64(_mm512_set1_epi64(63),
+        _mm512_cvtepu32_epi64(_mm256_and_si256(idx, _mm256_set1_epi32(0xf))));
+    __m512i mu = _mm512_sllv_epi64(_mm512_set1_epi64(GRAD_U_IS_B), sh);
+    __m512i mv = _mm512_sllv_epi64(_mm512_set1_epi64(GRAD_V_IS_C), sh);
+    __m512i nu = _mm512_sllv_epi64(_mm512_set1_epi64(GRAD_NEG_U), sh);
+    __m512i nv = _mm512_sllv_epi64(_mm512_set1_epi64(GRAD_NEG_V), sh);
+    __m512d u = _mm512_mask_blend_pd(_mm512_test_epi64_mask(mu, sign), a, b);
+    __m512d v = _mm512_mask_blend_pd(_mm512_test_epi64_mask(mv, sign), b, c);
+    u = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(u),
+        _mm512_and_si512(nu, sign)));
+    v = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(v),
+        _mm512_and_si512(nv, sign)));
+    return _mm512_add_pd(u, v);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512d smooth_avx512(__m512d d)
+{
+    __m512d t = _mm512_sub_pd(_mm512_mul_pd(d, _mm512_set1_pd(6.0)),
+        _mm512_set1_pd(15.0));
+    t = _mm512_add_pd(_mm512_mul_pd(d, t), _mm512_set1_pd(10.0));
+    return _mm512_mul_pd(_mm512_mul_pd(_mm512_mul_pd(d, d), d), t);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512d lerp_avx512(__m512d part, __m512d from, __m512d to)
+{
+    return _mm512_add_pd(from, _mm512_mul_pd(part, _mm512_sub_pd(to, from)));
+}
+
+#define GATHER_IDX_AVX512(IDX, H) \
+    _mm256_i32gather_epi32((const int*)(IDX), (H), 1)
+#define FLOOR_AVX512 (_MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC)
+
+ATTR_TARGET("avx512f")
+static void samplePerlinBatch_avx512(const PerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n)
+{
+    const uint8_t *idx = noise->d;
+    const __m256i m8 = _mm256_set1_epi32(0xff);
+    const __m512d one = _mm512_set1_pd(1.0);
+    int i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m512d d1 = _mm512_add_pd(_mm512_loadu_pd(x+i), _mm512_set1_pd(noise->a));
+        __m512d d2 = _mm512_add_pd(_mm512_loadu_pd(y+i), _mm512_set1_pd(noise->b));
+        __m512d d3 = _mm512_add_pd(_mm512_loadu_pd(z+i), _mm512_set1_pd(noise->c));
+        __m512d i1 = _mm512_roundscale_pd(d1, FLOOR_AVX512);
+        __m512d i2 = _mm512_roundscale_pd(d2, FLOOR_AVX512);
+        __m512d i3 = _mm512_roundscale_pd(d3, FLOOR_AVX512);
+        d1 = _mm512_sub_pd(d1, i1);
+        d2 = _mm512_sub_pd(d2, i2);
+        d3 = _mm512_sub_pd(d3, i3);
+        __m256i h1 = _mm256_and_si256(_mm512_cvttpd_epi32(i1), m8);
+        __m256i h2 = _mm256_and_si256(_mm512_cvttpd_epi32(i2), m8);
+        __m256i h3 = _mm256_and_si256(_mm512_cvttpd_epi32(i3), m8);
+        __m512d t1 = smooth_avx512(d1);
+        __m512d t2 = smooth_avx512(d2);
+        __m512d t3 = smooth_avx512(d3);
+
+        __m256i g1 = GATHER_IDX_AVX512(idx, h1);
+        __m256i a1 = _mm256_and_si256(_mm256_add_epi32(g1, h2), m8);
+        __m256i b1 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g1, 8), h2), m8);
+        __m256i g2 = GATHER_IDX_AVX512(idx, a1);
+        __m256i g3 = GATHER_IDX_AVX512(idx, b1);
+        __m256i a2 = _mm256_and_si256(_mm256_add_epi32(g2, h3), m8);
+        __m256i b2 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g2, 8), h3), m8);
+        __m256i a3 = _mm256_and_si256(_mm256_add_epi32(g3, h3), m8);
+        __m256i b3 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g3, 8), h3), m8);
+        __m256i g4 = GATHER_IDX_AVX512(idx, a2);
+        __m256i g5 = GATHER_IDX_AVX512(idx, b2);
+        __m256i g6 = GATHER_IDX_AVX512(idx, a3);
+        __m256i g7 = GATHER_IDX_AVX512(idx, b3);
+
+        __m512d e1 = _mm512_sub_pd(d1, one);
+        __m512d e2 = _mm512_sub_pd(d2, one);
+        __m512d e3 = _mm512_sub_pd(d3, one);
+        __m512d l1 = indexedLerp_avx512(g4, d1, d2, d3);
+        __m512d l5 = indexedLerp_avx512(_mm256_srli_epi32(g4, 8), d1, d2, e3);
+        __m512d l2 = indexedLerp_avx512(g6, e1, d2, d3);
+        __m512d l6 = indexedLerp_avx512(_mm256_srli_epi32(g6, 8), e1, d2, e3);
+        __m512d l3 = indexedLerp_avx512(g5, d1, e2, d3);
+        __m512d l7 = indexedLerp_avx512(_mm256_srli_epi32(g5, 8), d1, e2, e3);
+        __m512d l4 = indexedLerp_avx512(g7, e1, e2, d3);
+        __m512d l8 = indexedLerp_avx512(_mm256_srli_epi32(g7, 8), e1, e2, e3);
+
+        l1 = lerp_avx512(t1, l1, l2);
+        l3 = lerp_avx512(t1, l3, l4);
+        l5 = lerp_avx512(t1, l5, l6);
+        l7 = lerp_avx512(t1, l7, l8);
+        l1 = lerp_avx512(t2, l1, l3);
+        l5 = lerp_avx512(t2, l5, l7);
+        _mm512_storeu_pd(out+i, lerp_avx512(t3, l1, l5));
+    }
+    if (i < n)
+        samplePerlinBatch_avx2(noise, x+i, y+i, z+i, out+i, n-i);
+}
+
+ATTR_TARGET("avx512f")
+static void samplePerlinRow_avx512(const PerlinNoise *noise, double *out,
+        const double *x, int n, const PerlinRow *pr)
+{
+    const uint8_t *idx = noise->d;
+    const __m256i m8 = _mm256_set1_epi32(0xff);
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m256i h2 = _mm256_set1_epi32(pr->h2);
+    const __m256i h3 = _mm256_set1_epi32(pr->h3);
+    const __m512d d2 = _mm512_set1_pd(pr->d2), e2 = _mm512_set1_pd(pr->d2-1);
+    const __m512d d3 = _mm512_set1_pd(pr->d3), e3 = _mm512_set1_pd(pr->d3-1);
+    const __m512d t2 = _mm512_set1_pd(pr->t2), t3 = _mm512_set1_pd(pr->t3);
+    __m256i gc[8] = {0}, gv[8];
+    const __m256i *g;
+    int i, k, hprev = -1;
+
+    for (i = 0; i + 8 <= n; i += 8)
+    {
+        __m512d d1 = _mm512_add_pd(_mm512_loadu_pd(x+i), _mm512_set1_pd(noise->a));
+        __m512d i1 = _mm512_roundscale_pd(d1, FLOOR_AVX512);
+        d1 = _mm512_sub_pd(d1, i1);
+        __m256i h1 = _mm256_and_si256(_mm512_cvttpd_epi32(i1), m8);
+        __m512d t1 = smooth_avx512(d1);
+        int h10 = _mm256_cvtsi256_si32(h1);
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(h1, _mm256_set1_epi32(h10))) == -1)
+        {
+            if (h10 != hprev)
+            {
+                uint8_t gs[8];
+                getCellGradients(idx, h10, pr->h2, pr->h3, gs);
+                for (k = 0; k < 8; k++)
+                    gc[k] = _mm256_set1_epi32(gs[k]);
+                hprev = h10;
+            }
+            g = gc;
+        }
+        else
+        {
+            __m256i g1 = GATHER_IDX_AVX512(idx, h1);
+            __m256i a1 = _mm256_and_si256(_mm256_add_epi32(g1, h2), m8);
+            __m256i b1 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g1, 8), h2), m8);
+            __m256i g2 = GATHER_IDX_AVX512(idx, a1);
+            __m256i g3 = GATHER_IDX_AVX512(idx, b1);
+            __m256i a2 = _mm256_and_si256(_mm256_add_epi32(g2, h3), m8);
+            __m256i a3 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g2, 8), h3), m8);
+            __m256i b2 = _mm256_and_si256(_mm256_add_epi32(g3, h3), m8);
+            __m256i b3 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(g3, 8), h3), m8);
+            gv[0] = GATHER_IDX_AVX512(idx, a2);
+            gv[1] = GATHER_IDX_AVX512(idx, b2);
+            gv[2] = GATHER_IDX_AVX512(idx, a3);
+            gv[3] = GATHER_IDX_AVX512(idx, b3);
+            gv[4] = _mm256_srli_epi32(gv[0], 8);
+            gv[5] = _mm256_srli_epi32(gv[1], 8);
+            gv[6] = _mm256_srli_epi32(gv[2], 8);
+            gv[7] = _mm256_srli_epi32(gv[3], 8);
+            g = gv;
+        }
+
+        __m512d e1 = _mm512_sub_pd(d1, one);
+        __m512d l1 = indexedLerp_avx512(g[0], d1, d2, d3);
+        __m512d l2 = indexedLerp_avx512(g[1], e1, d2, d3);
+        __m512d l3 = indexedLerp_avx512(g[2], d1, e2, d3);
+        __m512d l4 = indexedLerp_avx512(g[3], e1, e2, d3);
+        __m512d l5 = indexedLerp_avx512(g[4], d1, d2, e3);
+        __m512d l6 = indexedLerp_avx512(g[5], e1, d2, e3);
+        __m512d l7 = indexedLerp_avx512(g[6], d1, e2, e3);
+        __m512d l8 = indexedLerp_avx512(g[7], e1, e2, e3);
+
+        l1 = lerp_avx512(t1, l1, l2);
+        l3 = lerp_avx512(t1, l3, l4);
+        l5 = lerp_avx512(t1, l5, l6);
+        l7 = lerp_avx512(t1, l7, l8);
+        l1 = lerp_avx512(t2, l1, l3);
+        l5 = lerp_avx512(t2, l5, l7);
+        _mm512_storeu_pd(out+i, lerp_avx512(t3, l1, l5));
+    }
+    if (i < n)
+        samplePerlinRow_avx2(noise, out+i, x+i, n-i, pr);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512 indexedLerp_avx512f(__m512i idx, __m512 a, __m512 b, __m512 c)
+{
+    const __m512i sign = _mm512_set1_epi32(INT32_MIN);
+    __m512i sh = _mm512_sub_epi32(_mm512_set1_epi32(31),
+        _mm512_and_si512(idx, _mm512_set1_epi32(0xf)));
+    __m512i mu = _mm512_sllv_epi32(_mm512_set1_epi32(GRAD_U_IS_B), sh);
+    __m512i mv = _mm512_sllv_epi32(_mm512_set1_epi32(GRAD_V_IS_C), sh);
+    __m512i nu = _mm512_sllv_epi32(_mm512_set1_epi32(GRAD_NEG_U), sh);
+    __m512i nv = _mm512_sllv_epi32(_mm512_set1_epi32(GRAD_NEG_V), sh);
+    __m512 u = _mm512_mask_blend_ps(_mm512_test_epi32_mask(mu, sign), a, b);
+    __m512 v = _mm512_mask_blend_ps(_mm512_test_epi32_mask(mv, sign), b, c);
+    u = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(u),
+        _mm512_and_si512(nu, sign)));
+    v = _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v),
+        _mm512_and_si512(nv, sign)));
+    return _mm512_add_ps(u, v);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512 smooth_avx512f(__m512 d)
+{
+    __m512 t = _mm512_sub_ps(_mm512_mul_ps(d, _mm512_set1_ps(6.0f)),
+        _mm512_set1_ps(15.0f));
+    t = _mm512_add_ps(_mm512_mul_ps(d, t), _mm512_set1_ps(10.0f));
+    return _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(d, d), d), t);
+}
+
+ATTR_TARGET("avx512f")
+static inline __m512 lerp_avx512f(__m512 part, __m512 from, __m512 to)
+{
+    return _mm512_add_ps(from, _mm512_mul_ps(part, _mm512_sub_ps(to, from)));
+}
+
+#define GATHER_IDX_AVX512X16(IDX, H) \
+    _mm512_i32gather_epi32((H), (const int*)(IDX), 1)
+
+ATTR_TARGET("avx512f")
+static int samplePerlinRowFloat_avx512(const PerlinNoise *noise, float *out,
+        const double *x, int n, const PerlinRow *pr)
+{
+    const uint8_t *idx = noise->d;
+    const __m512i m8 = _mm512_set1_epi32(0xff);
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512d a = _mm512_set1_pd(noise->a);
+    const __m512i h2 = _mm512_set1_epi32(pr->h2);
+    const __m512i h3 = _mm512_set1_epi32(pr->h3);
+    const __m512 d2 = _mm512_set1_ps(pr->d2), e2 = _mm512_set1_ps(pr->d2-1);
+    const __m512 d3 = _mm512_set1_ps(pr->d3), e3 = _mm512_set1_ps(pr->d3-1);
+    const __m512 t2 = _mm512_set1_ps(pr->t2), t3 = _mm512_set1_ps(pr->t3);
+    __m512i gc[8] = {0}, gv[8];
+    const __m512i *g;
+    int i, k, hprev = -1;
+
+    for (i = 0; i + 16 <= n; i += 16)
+    {
+        __m512d xl = _mm512_add_pd(_mm512_loadu_pd(x+i), a);
+        __m512d xh = _mm512_add_pd(_mm512_loadu_pd(x+i+8), a);
+        __m512d il = _mm512_roundscale_pd(xl, FLOOR_AVX512);
+        __m512d ih = _mm512_roundscale_pd(xh, FLOOR_AVX512);
+        __m512d dl = _mm512_castps_pd(_mm512_castps256_ps512(
+            _mm512_cvtpd_ps(_mm512_sub_pd(xl, il))));
+        __m512 d1 = _mm512_castpd_ps(_mm512_insertf64x4(dl, _mm256_castps_pd(
+            _mm512_cvtpd_ps(_mm512_sub_pd(xh, ih))), 1));
+        __m512i h1 = _mm512_inserti64x4(
+            _mm512_castsi256_si512(_mm512_cvttpd_epi32(il)),
+            _mm512_cvttpd_epi32(ih), 1);
+        h1 = _mm512_and_si512(h1, m8);
+        __m512 t1 = smooth_avx512f(d1);
+        int h10 = _mm_cvtsi128_si32(_mm512_castsi512_si128(h1));
+
+        if (_mm512_cmpeq_epi32_mask(h1, _mm512_set1_epi32(h10)) == 0xffff)
+        {
+            if (h10 != hprev)
+            {
+                uint8_t gs[8];
+                getCellGradients(idx, h10, pr->h2, pr->h3, gs);
+                for (k = 0; k < 8; k++)
+                    gc[k] = _mm512_set1_epi32(gs[k]);
+                hprev = h10;
+            }
+            g = gc;
+        }
+        else
+        {
+            __m512i g1 = GATHER_IDX_AVX512X16(idx, h1);
+            __m512i a1 = _mm512_and_si512(_mm512_add_epi32(g1, h2), m8);
+            __m512i b1 = _mm512_and_si512(_mm512_add_epi32(_mm512_srli_epi32(g1, 8), h2), m8);
+            __m512i g2 = GATHER_IDX_AVX512X16(idx, a1);
+            __m512i g3 = GATHER_IDX_AVX512X16(idx, b1);
+            __m512i a2 = _mm512_and_si512(_mm512_add_epi32(g2, h3), m8);
+            __m512i a3 = _mm512_and_si512(_mm512_add_epi32(_mm512_srli_epi32(g2, 8), h3), m8);
+            __m512i b2 = _mm512_and_si512(_mm512_add_epi32(g3, h3), m8);
+            __m512i b3 = _mm512_and_si512(_mm512_add_epi32(_mm512_srli_epi32(g3, 8), h3), m8);
+            gv[0] = GATHER_IDX_AVX512X16(idx, a2);
+            gv[1] = GATHER_IDX_AVX512X16(idx, b2);
+            gv[2] = GATHER_IDX_AVX512X16(idx, a3);
+            gv[3] = GATHER_IDX_AVX512X16(idx, b3);
+            gv[4] = _mm512_srli_epi32(gv[0], 8);
+            gv[5] = _mm512_srli_epi32(gv[1], 8);
+            gv[6] = _mm512_srli_epi32(gv[2], 8);
+            gv[7] = _mm512_srli_epi32(gv[3], 8);
+            g = gv;
+        }
+
+        __m512 e1 = _mm512_sub_ps(d1, one);
+        __m512 l1 = indexedLerp_avx512f(g[0], d1, d2, d3);
+        __m512 l2 = indexedLerp_avx512f(g[1], e1, d2, d3);
+        __m512 l3 = indexedLerp_avx512f(g[2], d1, e2, d3);
+        __m512 l4 = indexedLerp_avx512f(g[3], e1, e2, d3);
+        __m512 l5 = indexedLerp_avx512f(g[4], d1, d2, e3);
+        __m512 l6 = indexedLerp_avx512f(g[5], e1, d2, e3);
+        __m512 l7 = indexedLerp_avx512f(g[6], d1, e2, e3);
+        __m512 l8 = indexedLerp_avx512f(g[7], e1, e2, e3);
+
+        l1 = lerp_avx512f(t1, l1, l2);
+        l3 = lerp_avx512f(t1, l3, l4);
+        l5 = lerp_avx512f(t1, l5, l6);
+        l7 = lerp_avx512f(t1, l7, l8);
+        l1 = lerp_avx512f(t2, l1, l3);
+        l5 = lerp_avx512f(t2, l5, l7);
+        _mm512_storeu_ps(out+i, lerp_avx512f(t3, l1, l5));
+    }
+    return i + samplePerlinRowFloat_avx2(noise, out+i, x+i, n-i, pr);
+}
+#endif // USE_X86_SIMD
+
+void samplePerlinBatch(const PerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n)
+{
+#if USE_X86_SIMD
+    switch (getSimdLevel())
+    {
+    case SIMD_AVX512:
+        samplePerlinBatch_avx512(noise, x, y, z, out, n);
+        return;
+    case SIMD_AVX2:
+        samplePerlinBatch_avx2(noise, x, y, z, out, n);
+        return;
+    }
+#endif
+    int i;
+    for (i = 0; i < n; i++)
+        out[i] = samplePerlin(noise, x[i], y[i], z[i], 0, 0);
+}
+
+static void samplePerlinRow(const PerlinNoise *noise, double *out,
+        const double *x, int n, double y, double z)
+{
+    PerlinRow pr;
+    initPerlinRow(noise, &pr, y, z);
+#if USE_X86_SIMD
+    switch (getSimdLevel())
+    {
+    case SIMD_AVX512:
+        samplePerlinRow_avx512(noise, out, x, n, &pr);
+        return;
+    case SIMD_AVX2:
+        samplePerlinRow_avx2(noise, out, x, n, &pr);
+        return;
+    }
+#endif
+    samplePerlinRowX(noise, out, x, n, &pr);
+}
+
+/* Single precision variant of samplePerlinRow(). Points that are not covered
+ * by the vector kernel are sampled in double precision and rounded.
+ */
+static void samplePerlinRowFloat(const PerlinNoise *noise, float *out,
+        const double *x, int n, double y, double z)
+{
+    double v[BATCH_LEN];
+    PerlinRow pr;
+    int i = 0, j;
+    initPerlinRow(noise, &pr, y, z);
+#if USE_X86_SIMD
+    switch (getSimdLevel())
+    {
+    case SIMD_AVX512:
+        i = samplePerlinRowFloat_avx512(noise, out, x, n, &pr);
+        break;
+    case SIMD_AVX2:
+        i = samplePerlinRowFloat_avx2(noise, out, x, n, &pr);
+        break;
+    }
+#endif
+    samplePerlinRowX(noise, v, x+i, n-i, &pr);
+    for (j = i; j < n; j++)
+        out[j] = (float) v[j-i];
+}
+
 static
 void samplePerlinBeta17Terrain(const PerlinNoise *noise, double *v,
         double d1, double d3, double yLacAmp)
@@ -258,13 +1065,13 @@ void samplePerlinBeta17Terrain(const PerlinNoise *noise, double *v,
         if (yi == 0 || i2 != genFlag)
         {
             genFlag = i2;
-            int a1 = idx[i1]   + i2;
-            int b1 = idx[i1+1] + i2;
+            uint8_t a1 = idx[i1]   + i2;
+            uint8_t b1 = idx[i1+1] + i2;
 
-            int a2 = idx[a1]   + i3;
-            int a3 = idx[a1+1] + i3;
-            int b2 = idx[b1]   + i3;
-            int b3 = idx[b1+1] + i3;
+            uint8_t a2 = idx[a1]   + i3;
+            uint8_t a3 = idx[a1+1] + i3;
+            uint8_t b2 = idx[b1]   + i3;
+            uint8_t b3 = idx[b1+1] + i3;
 
             double m1 = indexedLerp(idx[a2],   d1,   d2,   d3);
             double l2 = indexedLerp(idx[b2],   d1-1, d2,   d3);
@@ -481,6 +1288,96 @@ double sampleOctave(const OctaveNoise *noise, double x, double y, double z)
     return v;
 }
 
+
+/* Octave row sampler at the positions x = (x0 + (i0+i)*dx) * f, y*f, z*f,
+ * such that it matches sampleOctave() on the pre-scaled coordinates.
+ */
+static void sampleOctaveRowF(const OctaveNoise *noise, double *out,
+        double x0, double dx, int i0, int n, double y, double z, double f)
+{
+    double ax[BATCH_LEN], pv[BATCH_LEN];
+    int i, j, k, m;
+
+    y *= f;
+    z *= f;
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < BATCH_LEN ? n - k : BATCH_LEN;
+        for (j = 0; j < m; j++)
+            out[k+j] = 0;
+        for (i = 0; i < noise->octcnt; i++)
+        {
+            PerlinNoise *p = noise->octaves + i;
+            double lf = p->lacunarity;
+            double ay = maintainPrecision(y * lf);
+            double az = maintainPrecision(z * lf);
+            for (j = 0; j < m; j++)
+                ax[j] = maintainPrecision((x0 + (i0+k+j)*dx) * f * lf);
+            samplePerlinRow(p, pv, ax, m, ay, az);
+            for (j = 0; j < m; j++)
+                out[k+j] += p->amplitude * pv[j];
+        }
+    }
+}
+
+void sampleOctaveRow(const OctaveNoise *noise, double *out,
+        double x0, double dx, int n, double y, double z)
+{
+    sampleOctaveRowF(noise, out, x0, dx, 0, n, y, z, 1.0);
+}
+
+static void sampleOctaveRowFloat(const OctaveNoise *noise, float *out,
+        double x0, double dx, int i0, int n, double y, double z, double f)
+{
+    double ax[BATCH_LEN];
+    float pv[BATCH_LEN];
+    int i, j;
+
+    y *= f;
+    z *= f;
+    for (j = 0; j < n; j++)
+        out[j] = 0;
+    for (i = 0; i < noise->octcnt; i++)
+    {
+        PerlinNoise *p = noise->octaves + i;
+        double lf = p->lacunarity;
+        float amp = (float) p->amplitude;
+        for (j = 0; j < n; j++)
+            ax[j] = (x0 + (i0+j)*dx) * f * lf;
+        samplePerlinRowFloat(p, pv, ax, n, y * lf, z * lf);
+        for (j = 0; j < n; j++)
+            out[j] += amp * pv[j];
+    }
+}
+
+void sampleOctaveBatch(const OctaveNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n)
+{
+    double ax[BATCH_LEN], ay[BATCH_LEN], az[BATCH_LEN], pv[BATCH_LEN];
+    int i, j, k, m;
+
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < BATCH_LEN ? n - k : BATCH_LEN;
+        for (j = 0; j < m; j++)
+            out[k+j] = 0;
+        for (i = 0; i < noise->octcnt; i++)
+        {
+            PerlinNoise *p = noise->octaves + i;
+            double lf = p->lacunarity;
+            for (j = 0; j < m; j++)
+            {
+                ax[j] = maintainPrecision(x[k+j] * lf);
+                ay[j] = maintainPrecision(y[k+j] * lf);
+                az[j] = maintainPrecision(z[k+j] * lf);
+            }
+            samplePerlinBatch(p, ax, ay, az, pv, m);
+            for (j = 0; j < m; j++)
+                out[k+j] += p->amplitude * pv[j];
+        }
+    }
+}
+
 double sampleOctaveBeta17Biome(const OctaveNoise *noise, double x, double z)
 {
     double v = 0;
@@ -571,3 +1468,136 @@ double sampleDoublePerlin(const DoublePerlinNoise *noise,
     return v * noise->amplitude;
 }
 
+int sampleDoublePerlinBounded(const DoublePerlinNoise *noise,
+        double x, double y, double z, double lo, double hi, double *result)
+{
+    // Bound for the magnitude of the improved Perlin noise: the largest sum
+    // of the corner contributions over a cell is about 1.0364.
+    const double perlin_max = 1.04;
+    const double f = 337.0 / 331.0;
+    const OctaveNoise *oct[] = { &noise->octA, &noise->octB };
+    double contrib[2][32];
+    int i, k, n;
+    double rem = 0, v = 0;
+
+    n = noise->octA.octcnt > noise->octB.octcnt ?
+        noise->octA.octcnt : noise->octB.octcnt;
+    if (n > 32)
+    {
+        v = sampleDoublePerlin(noise, x, y, z);
+        if (result)
+            *result = v;
+        return v < lo ? -1 : v > hi ? +1 : 0;
+    }
+
+    for (k = 0; k < 2; k++)
+        for (i = 0; i < oct[k]->octcnt; i++)
+            rem += fabs(oct[k]->octaves[i].amplitude);
+
+    // The octaves are stored with decreasing amplitudes, so the two halves
+    // are interleaved to evaluate the largest contributions first.
+    double scale = fabs(noise->amplitude);
+    for (i = 0; i < n; i++)
+    {
+        for (k = 0; k < 2; k++)
+        {
+            if (i >= oct[k]->octcnt)
+                continue;
+            const PerlinNoise *p = oct[k]->octaves + i;
+            double lf = p->lacunarity;
+            double px = k ? x*f : x, py = k ? y*f : y, pz = k ? z*f : z;
+            double c = p->amplitude * samplePerlin(p, px*lf, py*lf, pz*lf, 0, 0);
+            contrib[k][i] = c;
+            v += c;
+            rem -= fabs(p->amplitude);
+        }
+
+        double r = (rem * perlin_max + 1e-12) * scale;
+        double est = v * noise->amplitude;
+        if (est + r < lo || est - r > hi)
+        {
+            if (result)
+                *result = est;
+            return est < lo ? -1 : +1;
+        }
+    }
+
+    // undecided: add the contributions in the order of sampleDoublePerlin()
+    double va = 0, vb = 0;
+    for (i = 0; i < noise->octA.octcnt; i++)
+        va += contrib[0][i];
+    for (i = 0; i < noise->octB.octcnt; i++)
+        vb += contrib[1][i];
+    v = (va + vb) * noise->amplitude;
+    if (result)
+        *result = v;
+    return v < lo ? -1 : v > hi ? +1 : 0;
+}
+
+void sampleDoublePerlinBatch(const DoublePerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n)
+{
+    const double f = 337.0 / 331.0;
+    double fx[BATCH_LEN], fy[BATCH_LEN], fz[BATCH_LEN], vb[BATCH_LEN];
+    int j, k, m;
+
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < BATCH_LEN ? n - k : BATCH_LEN;
+        for (j = 0; j < m; j++)
+        {
+            fx[j] = x[k+j] * f;
+            fy[j] = y[k+j] * f;
+            fz[j] = z[k+j] * f;
+        }
+        sampleOctaveBatch(&noise->octA, x+k, y+k, z+k, out+k, m);
+        sampleOctaveBatch(&noise->octB, fx, fy, fz, vb, m);
+        for (j = 0; j < m; j++)
+        {
+            double v = 0;
+            v += out[k+j];
+            v += vb[j];
+            out[k+j] = v * noise->amplitude;
+        }
+    }
+}
+
+void sampleDoublePerlinRow(const DoublePerlinNoise *noise, double *out,
+        double x0, double dx, int n, double y, double z)
+{
+    const double f = 337.0 / 331.0;
+    double vb[BATCH_LEN];
+    int j, k, m;
+
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < BATCH_LEN ? n - k : BATCH_LEN;
+        sampleOctaveRowF(&noise->octA, out+k, x0, dx, k, m, y, z, 1.0);
+        sampleOctaveRowF(&noise->octB, vb, x0, dx, k, m, y, z, f);
+        for (j = 0; j < m; j++)
+        {
+            double v = 0;
+            v += out[k+j];
+            v += vb[j];
+            out[k+j] = v * noise->amplitude;
+        }
+    }
+}
+
+void sampleDoublePerlinRowFloat(const DoublePerlinNoise *noise, float *out,
+        double x0, double dx, int n, double y, double z)
+{
+    const double f = 337.0 / 331.0;
+    const float amp = (float) noise->amplitude;
+    float vb[BATCH_LEN];
+    int j, k, m;
+
+    for (k = 0; k < n; k += m)
+    {
+        m = n - k < BATCH_LEN ? n - k : BATCH_LEN;
+        sampleOctaveRowFloat(&noise->octA, out+k, x0, dx, k, m, y, z, 1.0);
+        sampleOctaveRowFloat(&noise->octB, vb, x0, dx, k, m, y, z, f);
+        for (j = 0; j < m; j++)
+            out[k+j] = (out[k+j] + vb[j]) * amp;
+    }
+}
@@ -52,6 +52,14 @@ double samplePerlin(const PerlinNoise *noise, double x, double y, double z,
         double yamp, double ymin);
 double sampleSimplex2D(const PerlinNoise *noise, double x, double y);
 
+/**
+ * Samples 'n' points (x[i], y[i], z[i]) into out[i]. The results are
+ * bit-identical to samplePerlin(noise, x[i], y[i], z[i], 0, 0), but make use
+ * of AVX2 or AVX-512 kernels when the CPU supports them.
+ */
+void samplePerlinBatch(const PerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n);
+
 /// Perlin Octaves
 void octaveInit(OctaveNoise *noise, uint64_t *seed, PerlinNoise *octaves,
         int omin, int len);
@@ -61,6 +69,16 @@ int xOctaveInit(OctaveNoise *noise, Xoroshiro *xr, PerlinNoise *octaves,
         const double *amplitudes, int omin, int len, int nmax);
 
 double sampleOctave(const OctaveNoise *noise, double x, double y, double z);
+void sampleOctaveBatch(const OctaveNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n);
+/**
+ * Samples a row of 'n' points at (x0 + i*dx, y, z) into out[i]. The y and z
+ * dependent state is only computed once per octave, and the lattice hashes
+ * are reused while the samples stay within the same cell. The results are
+ * identical to the corresponding point-wise samplers.
+ */
+void sampleOctaveRow(const OctaveNoise *noise, double *out,
+        double x0, double dx, int n, double y, double z);
 double sampleOctaveAmp(const OctaveNoise *noise, double x, double y, double z,
         double yamp, double ymin, int ydefault);
 double sampleOctave2D(const OctaveNoise *noise, double x, double z);
@@ -76,6 +94,27 @@ int xDoublePerlinInit(DoublePerlinNoise *noise, Xoroshiro *xr,
 
 double sampleDoublePerlin(const DoublePerlinNoise *noise,
         double x, double y, double z);
+void sampleDoublePerlinBatch(const DoublePerlinNoise *noise, const double *x,
+        const double *y, const double *z, double *out, int n);
+/**
+ * Determines whether sampleDoublePerlin() is below 'lo' (returns -1), above
+ * 'hi' (returns +1), or within the bounds (returns 0). The octaves are added
+ * starting with the largest amplitudes, and the evaluation stops as soon as
+ * the remaining octaves can no longer move the value across the bounds. The
+ * 'result' (nullable) receives the exact value if all octaves were needed,
+ * and otherwise the partial sum.
+ */
+int sampleDoublePerlinBounded(const DoublePerlinNoise *noise,
+        double x, double y, double z, double lo, double hi, double *result);
+void sampleDoublePerlinRow(const DoublePerlinNoise *noise, double *out,
+        double x0, double dx, int n, double y, double z);
+/**
+ * Single precision version of sampleDoublePerlinRow(), which processes twice
+ * as many points per vector instruction. The results are NOT exact and are
+ * intended for previews where small deviations are acceptable.
+ */
+void sampleDoublePerlinRowFloat(const DoublePerlinNoise *noise, float *out,
+        double x0, double dx, int n, double y, double z);
 
 
 #ifdef __cplusplus
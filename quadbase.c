@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -225,20 +226,20 @@ Pos getOptimalAfk(Pos p[4], int ax, int ay, int az, int *spcnt)
 
 #define MAX_PATHLEN 4096
 
-STRUCT(linked_seeds_t)
-{
-    uint64_t seeds[100];
-    size_t len;
-    linked_seeds_t *next;
-};
+// The seeds are searched in chunks of 2^32 (or 2^lowBitN if that is larger),
+// which the threads claim one after another. This keeps all threads busy until
+// the end, even if the checks reject some parts of the seed space much faster
+// than others.
+#define SEARCH_CHUNK_BITS 32
 
-STRUCT(threadinfo_t)
+STRUCT(search48_t)
 {
     // seed range
-    uint64_t start, end;
+    uint64_t nchunks;
+    int chunkBits;
     const uint64_t *lowBits;
     int lowBitN;
-    char skipStart;
+    int lowBitCnt;
 
     // testing function
     int (*check)(uint64_t, void*);
@@ -247,10 +248,26 @@ STRUCT(threadinfo_t)
     // abort check
     volatile char *stop;
 
-    // output
+    // progress
+    uint64_t next;      // next chunk to claim
+    uint64_t finished;  // number of completed chunks
+    char *done;         // chunks completed in a previous run (nullable)
+};
+
+STRUCT(threadinfo_t)
+{
+    search48_t *search;
+
+    // output, either a buffered file or a seed buffer of this thread only, so
+    // that the results are collected without any locks
     char path[MAX_PATHLEN];
     FILE *fp;
-    linked_seeds_t ls;
+    uint64_t *seeds;
+    size_t len, cap;
+
+    // statistics
+    uint64_t tested;
+    int running;
 };
 
 
@@ -286,109 +303,116 @@ static int mkdirp(char *path)
 }
 
 
-#ifdef USE_PTHREAD
-static void *searchAll48Thread(void *data)
+#if defined(_WIN32)
+static double getTime(void) { return GetTickCount64() * 1e-3; }
+static void sleepMs(int ms) { Sleep(ms); }
 #else
-static DWORD WINAPI searchAll48Thread(LPVOID data)
+static double getTime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+static void sleepMs(int ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
 #endif
+
+static uint64_t claimChunk(search48_t *s)
 {
-// TODO TEST:
-// lower bits with various ranges
+    uint64_t c;
+    do
+        c = ATOMIC_ADD(&s->next, 1);
+    while (c < s->nchunks && s->done && s->done[c]);
+    return c;
+}
 
-    threadinfo_t *info = (threadinfo_t*)data;
+static void addSeed(threadinfo_t *info, uint64_t seed)
+{
+    if (info->fp)
+    {   // not flushed, a chunk only counts once its marker is written
+        fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
+        return;
+    }
+    if (info->len == info->cap)
+    {
+        info->cap = info->cap ? 2 * info->cap : 1024;
+        info->seeds = (uint64_t*) realloc(info->seeds,
+            info->cap * sizeof(uint64_t));
+        if (info->seeds == NULL)
+            exit(1);
+    }
+    info->seeds[info->len++] = seed;
+}
 
-    uint64_t seed = info->start;
-    uint64_t end = info->end;
-    linked_seeds_t *lp = &info->ls;
-    lp->len = 0;
-    lp->next = NULL;
+/* Tests the seeds [start, end] and returns non-zero if the search was aborted.
+ */
+static int searchChunk(threadinfo_t *info, uint64_t start, uint64_t end)
+{
+    const search48_t *s = info->search;
+    uint64_t seed, tested = info->tested;
 
-    if (info->lowBits)
+    if (s->lowBits)
     {
-        uint64_t hstep = 1ULL << info->lowBitN;
-        uint64_t hmask = ~(hstep - 1);
+        uint64_t hstep = 1ULL << s->lowBitN;
         uint64_t mid;
-        int idx, cnt;
+        int idx;
 
-        for (cnt = 0; info->lowBits[cnt]; cnt++);
-
-        mid = info->start & hmask;
-        for (idx = 0; (seed = mid | info->lowBits[idx]) < info->start; idx++);
-
-        while (seed <= end)
+        for (mid = start; mid <= end; mid += hstep)
         {
-            if unlikely(info->check(seed, info->data))
-            {
-                if (seed == info->start && info->skipStart) {} // skip
-                else if (info->fp)
-                {
-                    fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
-                    fflush(info->fp);
-                }
-                else
-                {
-                    lp->seeds[lp->len] = seed;
-                    lp->len++;
-                    if (lp->len >= sizeof(lp->seeds)/sizeof(uint64_t))
-                    {
-                        linked_seeds_t *n =
-                            (linked_seeds_t*) malloc(sizeof(linked_seeds_t));
-                        if (n == NULL)
-                            exit(1);
-                        lp->next = n;
-                        lp = n;
-                        lp->len = 0;
-                        lp->next = NULL;
-                    }
-                }
-            }
-
-            idx++;
-            if (idx >= cnt)
+            for (idx = 0; idx < s->lowBitCnt; idx++)
             {
-                idx = 0;
-                mid += hstep;
-                if (info->stop && *info->stop)
-                    break;
+                seed = mid | s->lowBits[idx];
+                if unlikely(s->check(seed, s->data))
+                    addSeed(info, seed);
             }
-
-            seed = mid | info->lowBits[idx];
+            tested += s->lowBitCnt;
+            ATOMIC_STORE(&info->tested, tested);
+            if (s->stop && *s->stop)
+                return 1;
         }
     }
     else
     {
-        while (seed <= end)
+        for (seed = start; seed <= end; seed++)
         {
-            if unlikely(info->check(seed, info->data))
+            if unlikely(s->check(seed, s->data))
+                addSeed(info, seed);
+            if ((seed & 0xfff) == 0xfff)
             {
-                if (seed == info->start && info->skipStart) {} // skip
-                else if (info->fp)
-                {
-                    fprintf(info->fp, "%" PRId64"\n", (int64_t)seed);
-                    fflush(info->fp);
-                }
-                else
-                {
-                    lp->seeds[lp->len] = seed;
-                    lp->len++;
-                    if (lp->len >= sizeof(lp->seeds)/sizeof(uint64_t))
-                    {
-                        linked_seeds_t *n =
-                            (linked_seeds_t*) malloc(sizeof(linked_seeds_t));
-                        if (n == NULL)
-                            exit(1);
-                        lp->next = n;
-                        lp = n;
-                        lp->len = 0;
-                        lp->next = NULL;
-                    }
-                }
+                ATOMIC_STORE(&info->tested, tested + (seed - start + 1));
+                if (s->stop && *s->stop)
+                    return 1;
             }
-            seed++;
-            if ((seed & 0xfff) == 0 && info->stop && *info->stop)
-                break;
         }
+        ATOMIC_STORE(&info->tested, tested + (end - start + 1));
     }
+    return 0;
+}
+
+#ifdef USE_PTHREAD
+static void *searchAll48Thread(void *data)
+#else
+static DWORD WINAPI searchAll48Thread(LPVOID data)
+#endif
+{
+    threadinfo_t *info = (threadinfo_t*)data;
+    search48_t *s = info->search;
+    uint64_t chunk;
+
+    while ((chunk = claimChunk(s)) < s->nchunks)
+    {
+        uint64_t start = chunk << s->chunkBits;
+        if (searchChunk(info, start, start + (1ULL << s->chunkBits) - 1))
+            break;
+        // mark the chunk as complete for a resumed search
+        if (info->fp)
+            fprintf(info->fp, "#%" PRIu64 "\n", chunk);
+        ATOMIC_ADD(&s->finished, 1);
+    }
+    ATOMIC_STORE(&info->running, 0);
 
 #ifdef USE_PTHREAD
     pthread_exit(NULL);
@@ -396,6 +420,128 @@ static DWORD WINAPI searchAll48Thread(LPVOID data)
     return 0;
 }
 
+/* Reads the completed chunks from a partial file of a previous run and
+ * truncates the file after the last completed chunk, which drops the seeds of
+ * an interrupted chunk (and a line that was cut off). A file with seeds but
+ * without any chunk markers may be from an older version, which searched
+ * fixed ranges that cannot be resumed. Such a file is renamed aside to
+ * '<path>.old' untouched, and the search starts over without it. Returns -1
+ * if the file does not exist and non-zero upon failure.
+ */
+static int loadProgress(const char *path, search48_t *s)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    char *buf = NULL;
+    long len = 0, keep = 0, i, l;
+    if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) > 0)
+    {
+        buf = (char*) malloc(len);
+        rewind(fp);
+        if (buf == NULL || fread(buf, 1, len, fp) != (size_t)len)
+        {
+            free(buf);
+            fclose(fp);
+            return 1;
+        }
+    }
+    fclose(fp);
+
+    for (l = i = 0; i < len; i++)
+    {
+        if (buf[i] != '\n')
+            continue;
+        if (buf[l] == '#')
+        {
+            uint64_t chunk = strtoull(buf + l + 1, NULL, 10);
+            if (chunk < s->nchunks && !s->done[chunk])
+            {
+                s->done[chunk] = 1;
+                s->finished++;
+            }
+            keep = i + 1;
+        }
+        l = i + 1;
+    }
+
+    int err = 0;
+    if (keep == 0 && len > 0)
+    {
+        char opath[MAX_PATHLEN + 8];
+        snprintf(opath, sizeof(opath), "%s.old", path);
+        FILE *fo = fopen(opath, "rb");
+        if (fo != NULL)
+        {   // never overwrite seeds that were already kept aside
+            fclose(fo);
+            err = 1;
+        }
+        else
+        {
+            err = rename(path, opath) != 0;
+        }
+        if (err)
+            fprintf(stderr, "Cannot resume over %s, which has no chunk "
+                "markers: move it away first.\n", path);
+        else
+            fprintf(stderr, "Moved %s without chunk markers to %s, "
+                "its seeds are not part of the result.\n", path, opath);
+    }
+    else if (keep < len)
+    {
+        fp = fopen(path, "wb");
+        err = fp == NULL || (keep && fwrite(buf, keep, 1, fp) != 1);
+        if (fp)
+            err |= fclose(fp) != 0;
+    }
+    free(buf);
+    return err;
+}
+
+static void monitorSearch(threadinfo_t *info, int threads, search48_t *s,
+        void (*report)(const double *, int, double, void *), void *rdata,
+        double interval)
+{
+    double *rate = (double*) malloc(threads * sizeof(double));
+    uint64_t *last = (uint64_t*) calloc(threads, sizeof(uint64_t));
+    double t0 = getTime(), t1;
+    int t, running = 1;
+
+    if (rate == NULL || last == NULL)
+        goto L_end;
+
+    while (running)
+    {
+        sleepMs(interval < 1 ? 10 : 100);
+        running = 0;
+        for (t = 0; t < threads; t++)
+            running |= ATOMIC_LOAD(&info[t].running);
+        t1 = getTime();
+        if (running && t1 - t0 < interval)
+            continue;
+        for (t = 0; t < threads; t++)
+        {
+            uint64_t cur = ATOMIC_LOAD(&info[t].tested);
+            rate[t] = (cur - last[t]) / (t1 > t0 ? t1 - t0 : 1e-9);
+            last[t] = cur;
+        }
+        report(rate, threads, ATOMIC_LOAD(&s->finished) / (double) s->nchunks,
+            rdata);
+        t0 = t1;
+    }
+
+L_end:
+    free(rate);
+    free(last);
+}
+
+static int cmpSeed(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
 
 int searchAll48(
         uint64_t **         seedbuf,
@@ -409,18 +555,56 @@ int searchAll48(
         volatile char *     stop
         )
 {
-    threadinfo_t *info = (threadinfo_t*) malloc(threads* sizeof(*info));
+    return searchAll48Report(seedbuf, buflen, path, threads, lowBits, lowBitN,
+        check, data, stop, NULL, NULL, 0);
+}
+
+int searchAll48Report(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const uint64_t *    lowBits,
+        int                 lowBitN,
+        int (*check)(uint64_t s48, void *data),
+        void *              data,
+        volatile char *     stop,
+        void (*report)(const double *rate, int threads, double done, void *rdata),
+        void *              rdata,
+        double              interval
+        )
+{
+    threadinfo_t *info = (threadinfo_t*) calloc(threads, sizeof(*info));
     thread_id_t *tids = (thread_id_t*) malloc(threads* sizeof(*tids));
-    int i, t;
+    search48_t s;
+    int i, t, nparts = 0;
     int err = 0;
 
+    memset(&s, 0, sizeof(s));
+    if (info == NULL || tids == NULL)
+        goto L_err;
+
+    s.chunkBits = SEARCH_CHUNK_BITS;
+    if (lowBits)
+    {
+        if (lowBitN > s.chunkBits)
+            s.chunkBits = lowBitN;
+        for (s.lowBitCnt = 0; lowBits[s.lowBitCnt]; s.lowBitCnt++);
+    }
+    s.nchunks = (MASK48+1) >> s.chunkBits;
+    s.lowBits = lowBits;
+    s.lowBitN = lowBitN;
+    s.check = check;
+    s.data = data;
+    s.stop = stop;
+
     if (path)
     {
         size_t pathlen = strlen(path);
         char dpath[MAX_PATHLEN];
 
         // split path into directory and file and create missing directories
-        if (pathlen + 8 >= sizeof(dpath))
+        if (pathlen + 16 >= sizeof(dpath))
             goto L_err;
         strcpy(dpath, path);
 
@@ -434,6 +618,28 @@ int searchAll48(
                 break;
             }
         }
+
+        // load the progress of a previous run, which may have had a different
+        // number of threads
+        s.done = (char*) calloc(s.nchunks, 1);
+        if (s.done == NULL)
+            goto L_err;
+        for (t = 0; ; t++)
+        {
+            char ppath[MAX_PATHLEN];
+            snprintf(ppath, sizeof(ppath), "%s.part%d", path, t);
+            int r = loadProgress(ppath, &s);
+            if (r < 0 && t >= threads)
+                break;
+            if (r > 0)
+                goto L_err;
+        }
+        nparts = t;
+        if (s.finished)
+        {
+            printf("Continuing search with %" PRIu64 " of %" PRIu64
+                " chunks done\n", s.finished, s.nchunks);
+        }
     }
     else if (seedbuf == NULL || buflen == NULL)
     {
@@ -441,59 +647,22 @@ int searchAll48(
         goto L_err;
     }
 
-    // prepare the thread info and load progress if present
+    // prepare the thread info
     for (t = 0; t < threads; t++)
     {
-        info[t].start = (t * (MASK48+1) / threads);
-        info[t].end = ((t+1) * (MASK48+1) / threads - 1);
-        info[t].lowBits = lowBits;
-        info[t].lowBitN = lowBitN;
-        info[t].skipStart = 0;
-        info[t].check = check;
-        info[t].data = data;
-        info[t].stop = stop;
+        info[t].search = &s;
+        info[t].running = 1;
 
         if (path)
         {
-            // progress file of this thread
+            // partial file of this thread
             snprintf(info[t].path, sizeof(info[t].path), "%s.part%d", path, t);
-            FILE *fp = fopen(info[t].path, "a+");
+            FILE *fp = fopen(info[t].path, "a");
             if (fp == NULL)
                 goto L_err;
-
-            int c, nnl = 0;
-            char buf[32];
-
-            // find the last newline
-            for (i = 1; i < 32; i++)
-            {
-                if (fseek(fp, -i, SEEK_END)) break;
-                c = fgetc(fp);
-                if (c <= 0 || (nnl && c == '\n')) break;
-                nnl |= (c != '\n');
-            }
-
-            if (i < 32 && !fseek(fp, 1-i, SEEK_END) && fread(buf, i-1, 1, fp) > 0)
-            {
-                // read the last entry, and replace the start seed accordingly
-                int64_t lentry;
-                if (sscanf(buf, "%" PRId64, &lentry) == 1)
-                {
-                    info[t].start = lentry;
-                    info[t].skipStart = 1;
-                    printf("Continuing thread %d at seed %" PRId64 "\n",
-                        t, lentry);
-                }
-            }
-
-            fseek(fp, 0, SEEK_END);
+            setvbuf(fp, NULL, _IOFBF, 1 << 16);
             info[t].fp = fp;
         }
-        else
-        {
-            info[t].path[0] = 0;
-            info[t].fp = NULL;
-        }
     }
 
 
@@ -505,6 +674,9 @@ int searchAll48(
         pthread_create(&tids[t], NULL, searchAll48Thread, (void*)&info[t]);
     }
 
+    if (report)
+        monitorSearch(info, threads, &s, report, rdata, interval);
+
     for (t = 0; t < threads; t++)
     {
         pthread_join(tids[t], NULL);
@@ -518,6 +690,9 @@ int searchAll48(
             (LPVOID)&info[t], 0, NULL);
     }
 
+    if (report)
+        monitorSearch(info, threads, &s, report, rdata, interval);
+
     WaitForMultipleObjects(threads, tids, TRUE, INFINITE);
 
 #endif
@@ -527,78 +702,104 @@ int searchAll48(
 
     if (path)
     {
-        // merge partial files
-        FILE *fp = fopen(path, "w");
-        if (fp == NULL)
-            goto L_err;
+        // merge the partial files in order
+        uint64_t *seeds = NULL;
+        uint64_t len = 0, n;
 
         for (t = 0; t < threads; t++)
         {
-            rewind(info[t].fp);
-
-            char buffer[4097];
-            size_t n;
-            while ((n = fread(buffer, sizeof(char), 4096, info[t].fp)))
-            {
-                if (!fwrite(buffer, sizeof(char), n, fp))
-                {
-                    fclose(fp);
-                    goto L_err;
-                }
-            }
+            if (fclose(info[t].fp) != 0)
+                err = 1;
+            info[t].fp = NULL;
+        }
+        for (t = 0; t < nparts && !err; t++)
+        {
+            char ppath[MAX_PATHLEN];
+            n = 0;
+            snprintf(ppath, sizeof(ppath), "%s.part%d", path, t);
+            uint64_t *p = loadSavedSeeds(ppath, &n);
+            if (n == 0)
+                continue;
+            uint64_t *tmp = (uint64_t*) realloc(seeds, (len+n) * sizeof(*seeds));
+            if (p == NULL || tmp == NULL)
+                exit(1);
+            seeds = tmp;
+            memcpy(seeds + len, p, n * sizeof(*seeds));
+            len += n;
+            free(p);
+        }
+        if (err)
+        {
+            free(seeds);
+            goto L_err;
+        }
+        qsort(seeds, len, sizeof(*seeds), cmpSeed);
 
-            fclose(info[t].fp);
-            remove(info[t].path);
+        FILE *fp = fopen(path, "w");
+        if (fp == NULL)
+        {
+            free(seeds);
+            goto L_err;
+        }
+        for (n = 0; n < len; n++)
+            fprintf(fp, "%" PRId64"\n", (int64_t)seeds[n]);
+        if (fclose(fp) != 0)
+        {
+            free(seeds);
+            goto L_err;
         }
 
-        fclose(fp);
+        for (t = 0; t < nparts; t++)
+        {
+            char ppath[MAX_PATHLEN];
+            snprintf(ppath, sizeof(ppath), "%s.part%d", path, t);
+            remove(ppath);
+        }
 
         if (seedbuf && buflen)
         {
-            *seedbuf = loadSavedSeeds(path, buflen);
+            *seedbuf = seeds;
+            *buflen = len;
+        }
+        else
+        {
+            free(seeds);
         }
     }
     else
     {
-        // merge linked seed buffers
+        // merge the seed buffers of the threads in order
         *buflen = 0;
-
         for (t = 0; t < threads; t++)
-        {
-            linked_seeds_t *lp = &info[t].ls;
-            do
-            {
-                *buflen += lp->len;
-                lp = lp->next;
-            }
-            while (lp);
-        }
+            *buflen += info[t].len;
 
-        *seedbuf = (uint64_t*) malloc((*buflen) * sizeof(uint64_t));
+        *seedbuf = (uint64_t*) malloc((*buflen) * sizeof(uint64_t) + 1);
         if (*seedbuf == NULL)
             exit(1);
 
-        i = 0;
+        uint64_t n = 0;
         for (t = 0; t < threads; t++)
         {
-            linked_seeds_t *lp = &info[t].ls;
-            do
-            {
-                memcpy(*seedbuf + i, lp->seeds, lp->len * sizeof(uint64_t));
-                i += lp->len;
-                linked_seeds_t *tmp = lp;
-                lp = lp->next;
-                if (tmp != &info[t].ls)
-                    free(tmp);
-            }
-            while (lp);
+            memcpy(*seedbuf + n, info[t].seeds, info[t].len * sizeof(uint64_t));
+            n += info[t].len;
         }
+        qsort(*seedbuf, *buflen, sizeof(uint64_t), cmpSeed);
     }
 
     if (0)
 L_err:
         err = 1;
 
+    if (info)
+    {
+        for (t = 0; t < threads; t++)
+        {
+            if (info[t].fp)
+                fclose(info[t].fp);
+            free(info[t].seeds);
+        }
+    }
+    free(s.done);
     free(tids);
     free(info);
 
@@ -143,6 +143,11 @@ float isQuadBaseLarge (const StructureConfig sconf, uint64_t seed,
  * 'data' argument. The output can be a dynamically allocated seed buffer
  * and/or a destination file [which can be loaded using loadSavedSeeds()].
  * Optionally, only a subset of the lower 20 bits are searched.
+ * The threads claim chunks of 2^32 seeds one at a time, so the work stays
+ * balanced when the checks are faster in some parts of the seed space. The
+ * temporary files record the completed chunks, and an interrupted search
+ * continues with the chunks that are left (also with a different number of
+ * threads). The output seeds are in ascending order.
  *
  * @seedbuf     output seed buffer (nullable for file only)
  * @buflen      length of output buffer (nullable)
@@ -168,6 +173,30 @@ int searchAll48(
         volatile char *     stop // should be atomic, but is fine as stop flag
         );
 
+/* Variant of searchAll48() that calls 'report' from the calling thread about
+ * every 'interval' seconds, and once more at the end. The report receives the
+ * number of seeds per second that each thread tested since the last report,
+ * and the fraction of the seed space that has been completed.
+ *
+ * @report      throughput callback (nullable)
+ * @rdata       custom data argument passed to 'report'
+ * @interval    time between reports in seconds
+ */
+int searchAll48Report(
+        uint64_t **         seedbuf,
+        uint64_t *          buflen,
+        const char *        path,
+        int                 threads,
+        const uint64_t *    lowBits,
+        int                 lowBitN,
+        int (*check)(uint64_t s48, void *data),
+        void *              data,
+        volatile char *     stop,
+        void (*report)(const double *rate, int threads, double done, void *rdata),
+        void *              rdata,
+        double              interval
+        );
+
 /* Finds the optimal AFK location for four structures of size (ax,ay,az),
  * located at the positions of 'p'. The AFK position is determined by looking
  * for whole block coordinates which offer the maximum number of spawning
@@ -0,0 +1,155 @@
+#include "biome_grid.h"
+#include "tile_pack.h"
+#include "image_utils.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Redraws the tiles from the biome grids that generate_map keeps in a grid
+// pack (GRID_PACK), e.g. with the colors of a different color file, without
+// generating the biomes again. The tiles are written to <outputDir>, or to the
+// tile pack TILE_PACK if it is set.
+
+#define PIX4CELL 4
+
+int createDir(const char *path) {
+    char tmp[4096];
+    char *p;
+    snprintf(tmp, sizeof(tmp), "%s", path);
+
+    // Handle absolute and relative paths consistently
+    p = (tmp[0] == '/') ? tmp + 1 : tmp;
+
+    for (; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0777) && errno != EEXIST) {
+                fprintf(stderr, "Error creating directory %s: %s\n", tmp, strerror(errno));
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+
+    if (mkdir(tmp, 0777) && errno != EEXIST) {
+        fprintf(stderr, "Error creating directory %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Loads a color file for parseBiomeColors() on top of the default colors.
+int loadBiomeColors(unsigned char biomeColors[256][3], const char *path) {
+    initBiomeColors(biomeColors);
+    if (!path)
+        return 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = (char *)malloc(len + 1);
+    int err = -1;
+    if (buf && fread(buf, 1, len, fp) == (size_t)len) {
+        buf[len] = '\0';
+        printf("Mapped %d biome colors from %s\n", parseBiomeColors(biomeColors, buf), path);
+        err = 0;
+    }
+    free(buf);
+    fclose(fp);
+    return err;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <gridPack> <outputDir> [colorFile]\n", argv[0]);
+        return 1;
+    }
+    const char *outputDir = argv[2];
+    unsigned char biomeColors[256][3];
+    if (loadBiomeColors(biomeColors, argc > 3 ? argv[3] : NULL) != 0)
+        return 1;
+
+    TilePack grids, tiles;
+    if (tilePackOpen(&grids, argv[1], 0) != 0)
+        return 1;
+
+    // The grids are used in place, straight from a mapping of the pack
+    void *map = grids.end ? mmap(NULL, grids.end, PROT_READ, MAP_SHARED, grids.fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error mapping %s: %s\n", argv[1], strerror(errno));
+        tilePackClose(&grids);
+        return 1;
+    }
+
+    const char *packPath = getenv("TILE_PACK");
+    int usePack = packPath != NULL;
+    if (usePack && tilePackOpen(&tiles, packPath, 1) != 0)
+        return 1;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    int *biomeIds = NULL;
+    size_t idCap = 0;
+    uint64_t i, done = 0, failed = 0;
+    for (i = 0; i < grids.cap; i++) {
+        const TilePackEntry *e = &grids.table[i];
+        BiomeGrid bg;
+        if (!e->offset)
+            continue;
+        if (e->offset + e->size > grids.end ||
+                initBiomeGrid(&bg, (const unsigned char *)map + e->offset, e->size) != 0) {
+            fprintf(stderr, "Invalid biome grid for tile %d_%d at zoom level %d\n", e->x, e->y, e->zoom);
+            failed++;
+            continue;
+        }
+
+        int err;
+        if (usePack) {
+            size_t n = (size_t)bg.info.r.sx * bg.info.r.sz * bg.info.r.sy;
+            if (n > idCap) {
+                free(biomeIds);
+                idCap = n;
+                biomeIds = (int *)malloc(idCap * sizeof(int));
+            }
+            size_t size;
+            unsigned char *png = NULL;
+            if (biomeIds && decodeBiomeGrid(&bg, biomeIds) == 0)
+                png = encodePNGIndexed(biomeIds, bg.info.r.sx, bg.info.r.sz, PIX4CELL, biomeColors, &size);
+            err = !png || tilePackPut(&tiles, e->seed, e->zoom, e->x, e->y, png, size) != 0;
+            free(png);
+        } else {
+            char tileDir[2048], outputFile[4096];
+            snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir, (unsigned long)e->seed, e->zoom, e->x);
+            snprintf(outputFile, sizeof(outputFile), "%s/%d.png", tileDir, e->y);
+            err = createDir(tileDir) != 0 || recolorBiomeGrid(&bg, outputFile, PIX4CELL, biomeColors) != 0;
+        }
+        if (err) {
+            fprintf(stderr, "Error saving image file for tile %d_%d at zoom level %d\n", e->x, e->y, e->zoom);
+            failed++;
+        } else {
+            done++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("Recolored %lu tiles in %.2f seconds (%lu failed)\n", (unsigned long)done,
+            (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9, (unsigned long)failed);
+
+    free(biomeIds);
+    munmap(map, grids.end);
+    tilePackClose(&grids);
+    if (usePack && tilePackClose(&tiles) != 0)
+        return 1;
+    return failed != 0;
+}
@@ -35,6 +35,12 @@ typedef double      f64;
 #define ATTR(...)               __attribute__((__VA_ARGS__))
 #define BSWAP32(X)              __builtin_bswap32(X)
 #define UNREACHABLE()           __builtin_unreachable()
+#define ATOMIC_LOAD(P)          __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define ATOMIC_CAS(P,E,D)       __atomic_compare_exchange_n(P, E, D, 0, \
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(P,V)       __atomic_store_n(P, V, __ATOMIC_RELEASE)
+#define ATOMIC_ADD(P,V)         __atomic_fetch_add(P, V, __ATOMIC_ACQ_REL)
+#define THREAD_LOCAL            __thread
 
 #else
 
@@ -50,12 +56,54 @@ static inline uint32_t BSWAP32(uint32_t x) {
 }
 #if _MSC_VER
 #define UNREACHABLE()           __assume(0)
+#define THREAD_LOCAL            __declspec(thread)
 #else
 #define UNREACHABLE()           exit(1) // [[noreturn]]
 #endif
+// no atomics: lazily initialized globals are not thread-safe
+#define ATOMIC_LOAD(P)          (*(P))
+#define ATOMIC_CAS(P,E,D)       (*(P) == *(E) ? (*(P) = (D), 1) : (*(E) = *(P), 0))
+#define ATOMIC_STORE(P,V)       (*(P) = (V))
+#define ATOMIC_ADD(P,V)         ((*(P) += (V)) - (V))
 
 #endif
 
+/// Optional x86 SIMD kernels, compiled per function and selected at runtime.
+/// Kernels must not be contracted into FMA instructions (which AVX-512
+/// implies), otherwise they would not be bit-identical to the scalar code.
+/// The scalar code is built likewise without contraction or reassociation
+/// (NOISE_CFLAGS in the makefile), which -march=native or -ffast-math enable.
+#if __GNUC__ && (__x86_64__ || __i386__) && !defined(NO_SIMD)
+#define USE_X86_SIMD            1
+#if __clang__
+#define ATTR_TARGET(ISA)        __attribute__((target(ISA)))
+#else
+#define ATTR_TARGET(ISA)        __attribute__((target(ISA), optimize("fp-contract=off")))
+#endif
+#endif
+
+enum { SIMD_NONE, SIMD_AVX2, SIMD_AVX512 };
+
+/// Caps the level that getSimdLevel() reports, so that the kernels of lower
+/// levels can be tested or compared on the same machine. (defined in noise.c)
+#ifdef __cplusplus
+extern "C" int g_simd_limit;
+#else
+extern int g_simd_limit;
+#endif
+
+static inline int getSimdLevel(void)
+{
+    int level = SIMD_NONE;
+#if USE_X86_SIMD
+    if (__builtin_cpu_supports("avx512f"))
+        level = SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2"))
+        level = SIMD_AVX2;
+#endif
+    return level < g_simd_limit ? level : g_simd_limit;
+}
+
 /// imitate amd64/x64 rotate instructions
 
 static inline ATTR(const, always_inline, artificial)
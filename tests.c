@@ -1,4 +1,5 @@
 #include "finders.h"
+#include "quadbase.h"
 #include "util.h"
 
 #include <sys/time.h>
@@ -209,6 +210,716 @@ int testGeneration()
     return 0;
 }
 
+// Beta 1.7 terrain noise as in the game, with a 512-entry permutation table
+static void refBeta17Terrain(const PerlinNoise *p, double *v,
+    double d1, double d3, double yLacAmp)
+{
+    static const double g[16][3] = {
+        {1,1,0}, {-1,1,0}, {1,-1,0}, {-1,-1,0}, {1,0,1}, {-1,0,1}, {1,0,-1},
+        {-1,0,-1}, {0,1,1}, {0,-1,1}, {0,1,-1}, {0,-1,-1}, {1,1,0}, {0,-1,1},
+        {-1,1,0}, {0,-1,-1},
+    };
+    #define G(H,X,Y,Z) \
+        (g[(H)&15][0]*(X) + g[(H)&15][1]*(Y) + g[(H)&15][2]*(Z))
+    int t[512], i, yi, flag = -1;
+    double l1 = 0, l3 = 0, l5 = 0, l7 = 0;
+    for (i = 0; i < 512; i++)
+        t[i] = p->d[i & 255];
+
+    d1 += p->a;
+    d3 += p->c;
+    int i1 = (int) floor(d1) & 0xff, i3 = (int) floor(d3) & 0xff;
+    d1 -= floor(d1);
+    d3 -= floor(d3);
+    double t1 = d1*d1*d1 * (d1 * (d1*6.0-15.0) + 10.0);
+    double t3 = d3*d3*d3 * (d3 * (d3*6.0-15.0) + 10.0);
+
+    // the game samples y = 0..8 and only keeps 7 and 8, reusing the corners
+    // while the integer part of y stays the same
+    for (yi = 0; yi <= 8; yi++)
+    {
+        double d2 = yi*p->lacunarity*yLacAmp + p->b;
+        int i2 = (int) floor(d2);
+        d2 -= i2;
+        double t2 = d2*d2*d2 * (d2 * (d2*6.0-15.0) + 10.0);
+        i2 &= 0xff;
+        if (yi == 0 || i2 != flag)
+        {
+            flag = i2;
+            int a1 = t[i1] + i2, b1 = t[i1+1] + i2;
+            int a2 = t[a1] + i3, a3 = t[a1+1] + i3;
+            int b2 = t[b1] + i3, b3 = t[b1+1] + i3;
+            l1 = lerp(t1, G(t[a2], d1, d2, d3), G(t[b2], d1-1, d2, d3));
+            l3 = lerp(t1, G(t[a3], d1, d2-1, d3), G(t[b3], d1-1, d2-1, d3));
+            l5 = lerp(t1, G(t[a2+1], d1, d2, d3-1), G(t[b2+1], d1-1, d2, d3-1));
+            l7 = lerp(t1, G(t[a3+1], d1, d2-1, d3-1),
+                G(t[b3+1], d1-1, d2-1, d3-1));
+        }
+        if (yi >= 7)
+        {
+            double n = lerp(t3, lerp(t2, l1, l3), lerp(t2, l5, l7));
+            v[yi-7] += n * p->amplitude;
+        }
+    }
+    #undef G
+}
+
+int testBeta17Terrain()
+{
+    PerlinNoise p;
+    OctaveNoise oct = { 1, &p };
+    uint64_t s;
+    int seed, i, bad = 0;
+
+    for (seed = 0; seed < 100; seed++)
+    {
+        setSeed(&s, seed);
+        perlinInit(&p, &s);
+        p.amplitude = 1;
+        p.lacunarity = 1.0 / (1 + seed % 16);
+        for (i = 0; i < 100; i++)
+        {
+            double x = (int)(hash32(seed*100+i) % 20000) - 10000;
+            double z = (int)(hash32(~(seed*100+i)) % 20000) - 10000;
+            double v[2], r[2] = {0, 0};
+            sampleOctaveBeta17Terrain(&oct, v, x, z, i & 1, 0);
+            refBeta17Terrain(&p, r, x * p.lacunarity, z * p.lacunarity,
+                i & 1 ? 0.5 : 1.0);
+            bad += v[0] != r[0] || v[1] != r[1];
+        }
+    }
+    printf("Beta 1.7 terrain noise: %s\e[0m\n",
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+
+int testNoiseBatch()
+{
+    enum { N = 1000 };
+    double x[N], y[N], z[N], v[N];
+    PerlinNoise oct[2*9];
+    DoublePerlinNoise dpn;
+    Xoroshiro xr;
+    int i, seed, bad = 0;
+
+    static const double amp[] = {1, 1, 2, 2, 2, 1, 1, 1, 1};
+    for (seed = 0; seed < 100; seed++)
+    {
+        xSetSeed(&xr, seed);
+        xDoublePerlinInit(&dpn, &xr, oct, amp, -9, 9, -1);
+        for (i = 0; i < N; i++)
+        {
+            double s = (1 + (hash32(seed*N+i) & 0xffff)) * (i & 1 ? 1e-1 : 1e+3);
+            x[i] = (int)hash32(i ^ (seed << 16)) / s;
+            y[i] = (i % 3 == 0) ? 0 : (int)hash32(~i) / s;
+            z[i] = (int)hash32(i * 7919 + seed) / s;
+        }
+        samplePerlinBatch(&oct[seed % 18], x, y, z, v, N - seed);
+        for (i = 0; i < N - seed; i++)
+        {
+            double r = samplePerlin(&oct[seed % 18], x[i], y[i], z[i], 0, 0);
+            bad += memcmp(&r, &v[i], sizeof(r)) != 0;
+        }
+        sampleDoublePerlinBatch(&dpn, x, y, z, v, N);
+        for (i = 0; i < N; i++)
+        {
+            double r = sampleDoublePerlin(&dpn, x[i], y[i], z[i]);
+            bad += memcmp(&r, &v[i], sizeof(r)) != 0;
+        }
+        // rows at the spacings used by the scaled biome generation
+        int dx = 1 << 2*(seed % 5);
+        double x0 = (int)hash32(seed) / 256 + dx/2;
+        sampleDoublePerlinRow(&dpn, v, x0, dx, N, seed % 2 ? 0 : y[1], z[0]);
+        for (i = 0; i < N; i++)
+        {
+            double r = sampleDoublePerlin(&dpn, x0 + i*dx,
+                seed % 2 ? 0 : y[1], z[0]);
+            bad += memcmp(&r, &v[i], sizeof(r)) != 0;
+        }
+        // threshold queries with early termination
+        for (i = 0; i < N; i++)
+        {
+            double lo = ((int)(hash32(seed+i) % 400) - 200) * 0.005, r;
+            double hi = lo + (hash32(i) % 100) * 0.002;
+            double e = sampleDoublePerlin(&dpn, x[i], y[i], z[i]);
+            int c = sampleDoublePerlinBounded(&dpn, x[i], y[i], z[i], lo, hi, &r);
+            bad += c != (e < lo ? -1 : e > hi ? +1 : 0);
+            bad += c == 0 && memcmp(&r, &e, sizeof(r)) != 0;
+        }
+    }
+    printf("Batched noise sampling (simd level %d): %s\e[0m\n",
+        getSimdLevel(), bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testClimateToBiomeBatch()
+{
+    enum { N = 4096 };
+    static int64_t np[N][6];
+    static int ids[N];
+    int mc, i, j, bad = 0;
+
+    for (mc = MC_1_18; mc <= MC_NEWEST; mc++)
+    {
+        for (i = 0; i < N; i++)
+        {
+            for (j = 0; j < 6; j++)
+                np[i][j] = (int32_t) hash32(mc*N*6 + i*6 + j) % 12000;
+            if (i % 1000 == 999) // outside the range of the 32-bit kernel
+                np[i][i % 6] *= 1 << 20;
+        }
+        uint64_t dat0 = 0, dat1 = 0;
+        climateToBiomeBatch(mc, (const int64_t (*)[6]) np, ids, &dat1, N);
+        for (i = 0; i < N; i++)
+            bad += ids[i] != climateToBiome(mc, (const uint64_t*) np[i], &dat0);
+        climateToBiomeBatch(mc, (const int64_t (*)[6]) np, ids, NULL, N);
+        for (i = 0; i < N; i++)
+            bad += ids[i] != climateToBiome(mc, (const uint64_t*) np[i], NULL);
+    }
+    printf("Batched climate to biome mapping: %s\e[0m\n",
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testClimateIndex()
+{
+    enum { N = 4096 };
+    static int64_t np[N][6];
+    static int ids[N];
+    BiomeNoise bn;
+    int mc, i, j, bad = 0;
+
+    for (mc = MC_1_18; mc <= MC_NEWEST; mc++)
+    {
+        const ClimateIndex *ci = getClimateIndex(mc);
+        initBiomeNoise(&bn, mc);
+        setBiomeSeed(&bn, mc, 0);
+        for (i = 0; i < N; i++)
+        {
+            if (i & 1)
+            {   // realistic noise points with a varying depth
+                int x = (int)(hash32(i) % 8192) - 4096;
+                int z = (int)(hash32(i+N) % 8192) - 4096;
+                sampleBiomeNoise(&bn, np[i], x, (i>>1) % 80 - 16, z, NULL,
+                    SAMPLE_NO_BIOME);
+            }
+            else
+            {
+                for (j = 0; j < 6; j++)
+                    np[i][j] = (int32_t) hash32(mc*N*6 + i*6 + j) % 14000;
+            }
+        }
+        uint64_t dat0 = 0, dat1 = 0, dat2 = 0;
+        climateToBiomeBatch(mc, (const int64_t (*)[6]) np, ids, &dat2, N);
+        for (i = 0; i < N; i++)
+        {
+            int id = climateToBiome(mc, (const uint64_t*) np[i], &dat0);
+            bad += id != climateToBiomeIndexed(ci, (const uint64_t*) np[i], &dat1);
+            bad += id != ids[i];
+            bad += climateToBiome(mc, (const uint64_t*) np[i], NULL) !=
+                climateToBiomeIndexed(ci, (const uint64_t*) np[i], NULL);
+        }
+        printf("Climate index %s: %u cells, %.1f KiB, built in %.1f ms\n",
+            mc2str(mc), ci->ncells, ci->bytes / 1024.0, ci->buildms);
+    }
+    printf("Indexed climate to biome mapping: %s\e[0m\n",
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testFloatNoise()
+{
+    enum { W = 64, H = 64 };
+    static const int scales[] = { 16, 64, 256 };
+    Generator ge, gf;
+    int *exact = (int*) malloc(W*H*sizeof(int));
+    int *approx = (int*) malloc(W*H*sizeof(int));
+    long tot = 0, bad = 0;
+    uint64_t seed;
+    int i, k;
+
+    setupGenerator(&ge, MC_NEWEST, 0);
+    setupGenerator(&gf, MC_NEWEST, FLOAT_NOISE);
+    for (seed = 0; seed < 32; seed++)
+    {
+        applySeed(&ge, DIM_OVERWORLD, seed);
+        applySeed(&gf, DIM_OVERWORLD, seed);
+        for (k = 0; k < 3; k++)
+        {
+            int s = scales[k];
+            Range r = {s, -W/2 + (int)seed*W, -H/2, W, H, 256/s, 1};
+            genBiomes(&ge, exact, r);
+            genBiomes(&gf, approx, r);
+            for (i = 0; i < W*H; i++)
+                bad += exact[i] != approx[i];
+            tot += W*H;
+        }
+    }
+    free(exact);
+    free(approx);
+
+    double rate = bad / (double) tot;
+    printf("Single precision noise: %ld of %ld biomes differ (%.4f%%) %s\e[0m\n",
+        bad, tot, 100 * rate, rate < 1e-3 ? "\e[1;92mOK" : "\e[1;91mFAILED");
+    return rate < 1e-3 ? 0 : -1;
+}
+
+int testCoarseClimate()
+{
+    // Every second cell is interpolated, so the error grows with the scale.
+    // The bounds leave a margin over the 2%, 17% and 47% that are typical.
+    enum { W = 128, H = 128 };
+    static const int scales[] = { 16, 64, 256 };
+    static const double bound[] = { 0.03, 0.20, 0.55 };
+    Generator ge, gc;
+    int *exact = (int*) malloc(W*H*sizeof(int));
+    int *approx = (int*) malloc(W*H*sizeof(int));
+    uint64_t seed;
+    int i, k, err = 0;
+
+    setupGenerator(&ge, MC_NEWEST, 0);
+    setupGenerator(&gc, MC_NEWEST, COARSE_CLIMATE);
+    for (k = 0; k < 3; k++)
+    {
+        int s = scales[k];
+        long bad = 0, tot = 0;
+        double te = 0, tc = 0, t, rate;
+        for (seed = 0; seed < 8; seed++)
+        {
+            applySeed(&ge, DIM_OVERWORLD, seed);
+            applySeed(&gc, DIM_OVERWORLD, seed);
+            Range r = {s, -W/2 + (int)seed*W, -H/2, W, H, 15, 1};
+            t = now();
+            genBiomes(&ge, exact, r);
+            te += now() - t;
+            t = now();
+            genBiomes(&gc, approx, r);
+            tc += now() - t;
+            for (i = 0; i < W*H; i++)
+                bad += exact[i] != approx[i];
+            tot += W*H;
+        }
+        rate = (double) bad / tot;
+        printf("Coarse climate @1:%d: %.1f ms vs %.1f ms exact, "
+            "%.2f%% of biomes differ (max %.0f%%) %s\e[0m\n",
+            s, tc*1e3, te*1e3, 100 * rate, 100 * bound[k],
+            rate <= bound[k] ? "\e[1;92mOK" : "\e[1;91mFAILED");
+        if (rate > bound[k])
+            err = -1;
+    }
+    free(exact);
+    free(approx);
+    return err;
+}
+
+int testGeneratorCache()
+{
+    enum { W = 64, H = 64 };
+    static const struct { int mc, dim; uint32_t flags; } cfg[] = {
+        { MC_B1_7, DIM_OVERWORLD, 0 },
+        { MC_1_12, DIM_OVERWORLD, FORCE_OCEAN_VARIANTS },
+        { MC_1_16_1, DIM_NETHER, 0 },
+        { MC_NEWEST, DIM_OVERWORLD, LARGE_BIOMES },
+    };
+    GeneratorCache gc;
+    Generator ga, gb;
+    int *a, *b;
+    int i, j, k, bad = 0;
+    double tseed = 0, tcopy = 0, t;
+
+    if (initGeneratorCache(&gc, 4))
+        return -1;
+    for (k = 0; k < 3; k++)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            uint64_t seed = 1000 + (k == 2);
+            Range r = {16, -W/2, -H/2, W, H, 0, 1};
+            setupGenerator(&ga, cfg[i].mc, cfg[i].flags);
+            t = now();
+            applySeed(&ga, cfg[i].dim, seed);
+            tseed += now() - t;
+            t = now();
+            if (acquireGenerator(&gc, &gb, cfg[i].mc, cfg[i].flags,
+                cfg[i].dim, seed))
+                tcopy += now() - t;
+            a = allocCache(&ga, r);
+            b = allocCache(&gb, r);
+            genBiomes(&ga, a, r);
+            genBiomes(&gb, b, r);
+            for (j = 0; j < W*H; j++)
+                bad += a[j] != b[j];
+            free(a);
+            free(b);
+        }
+    }
+    // the second seed evicts the first, which has to be seeded again
+    acquireGenerator(&gc, &gb, cfg[0].mc, cfg[0].flags, cfg[0].dim, 1000);
+    int ok = !bad && gc.hits == 4 && gc.misses == 9;
+    printf("Generator cache: seeding %.1f us, cached %.1f us %s\e[0m\n",
+        tseed*1e6/12, tcopy*1e6/4, ok ? "\e[1;92mOK" : "\e[1;91mFAILED");
+    freeGeneratorCache(&gc);
+    return ok ? 0 : -1;
+}
+
+
+int testLazyLayerSeed()
+{
+    enum { W = 16, H = 16, N = 200 };
+    static const int mc_vers[] = { MC_1_6, MC_1_12, MC_1_13, MC_1_17 };
+    static const int scales[] = { 1, 4, 16, 64, 256 };
+    Generator ga, gb;
+    int *a, *b;
+    int i, j, k, n, bad = 0;
+    double teager = 0, tlazy = 0, t;
+
+    for (i = 0; i < 4; i++)
+    {
+        setupGenerator(&ga, mc_vers[i], 0);
+        setupGenerator(&gb, mc_vers[i], LAZY_LAYER_SEED);
+        size_t len = 0;
+        applySeed(&ga, DIM_OVERWORLD, 0);
+        for (k = 0; k < 5; k++)
+        {
+            size_t l = getMinCacheSize(&ga, scales[k], W, 1, H);
+            if (l > len) len = l;
+        }
+        a = (int*) malloc(len * sizeof(int));
+        b = (int*) malloc(len * sizeof(int));
+        for (n = 0; n < N; n++)
+        {
+            uint64_t seed = hash32(n) * 0x100000001ULL;
+            // a cheap filter that looks at 1:256 most of the time
+            k = n % 10 ? 4 : n % 5;
+            Range r = {scales[k], -W/2, -H/2, W, H, 15, 1};
+            t = now();
+            applySeed(&ga, DIM_OVERWORLD, seed);
+            bad += genBiomes(&ga, a, r) != 0;
+            teager += now() - t;
+            t = now();
+            applySeed(&gb, DIM_OVERWORLD, seed);
+            bad += genBiomes(&gb, b, r) != 0;
+            tlazy += now() - t;
+            bad += ga.sha != gb.sha;
+            for (j = 0; j < W*H; j++)
+                bad += a[j] != b[j];
+        }
+        // a layer that was seeded separately is updated as well
+        setLayerSeed(&gb.ls.layers[L_LAND_1024_A], 0);
+        Range r = {4, 0, 0, W, H, 15, 1};
+        genBiomes(&ga, a, r);
+        genBiomes(&gb, b, r);
+        for (j = 0; j < W*H; j++)
+            bad += a[j] != b[j];
+        free(a);
+        free(b);
+    }
+    printf("Lazy layer seeding: %.1f ms vs %.1f ms eager %s\e[0m\n",
+        tlazy*1e3, teager*1e3, bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testLayerCache()
+{
+    enum { T = 128, N = 6 };
+    static const int mc_vers[] = { MC_1_12, MC_1_17 };
+    static const size_t maxBytes[] = { 16 << 20, 256 << 10 };
+    Generator ga, gb, gc;
+    LayerCache lc;
+    int *a, *b;
+    int i, j, k, m, tx, tz, bad = 0;
+    double tplain = 0, tcache = 0, t, t1;
+    uint64_t hits = 0, misses = 0;
+
+    for (i = 0; i < 2; i++)
+    {
+        for (m = 0; m < 2; m++)
+        {
+            setupGenerator(&ga, mc_vers[i], 0);
+            setupGenerator(&gb, mc_vers[i], 0);
+            if (initLayerCache(&lc, &gb, 64, maxBytes[m]) != 0)
+            {
+                bad++;
+                continue;
+            }
+            for (k = 0; k < 2; k++)
+            {   // the blocks of the previous seed must not be reused
+                uint64_t seed = 1000 * i + k;
+                applySeed(&ga, DIM_OVERWORLD, seed);
+                applySeed(&gb, DIM_OVERWORLD, seed);
+                Range r = {4, 0, 0, T, T, 15, 1};
+                a = allocCache(&ga, r);
+                b = allocCache(&gb, r);
+                // tiles in scanline order
+                for (tz = -N/2; tz < N/2; tz++)
+                {
+                    for (tx = -N/2; tx < N/2; tx++)
+                    {
+                        r.x = tx * T;
+                        r.z = tz * T;
+                        t = now();
+                        bad += genBiomes(&ga, a, r) != 0;
+                        t1 = now();
+                        bad += genBiomes(&gb, b, r) != 0;
+                        if (m == 0)
+                        {   // the second cache is too small for a speed up
+                            tplain += t1 - t;
+                            tcache += now() - t1;
+                        }
+                        for (j = 0; j < T*T; j++)
+                            bad += a[j] != b[j];
+                    }
+                }
+                free(a);
+                free(b);
+            }
+            if (m == 0)
+            {
+                hits += lc.hits[L_BIOME_256];
+                misses += lc.misses[L_BIOME_256];
+            }
+            // copies do not use the cache, and freeing detaches it
+            copyGenerator(&gc, &gb);
+            bad += gc.ls.layers[L_BIOME_256].cache != NULL;
+            freeLayerCache(&lc);
+            bad += gb.ls.layers[L_BIOME_256].cache != NULL;
+            bad += gb.ls.layers[L_BIOME_256].getMap != ga.ls.layers[L_BIOME_256].getMap;
+        }
+    }
+    printf("Layer cache: %.1f%% of 1:256 blocks hit, %.1f ms vs %.1f ms uncached %s\e[0m\n",
+        100.0 * hits / (hits + misses + !(hits + misses)), tcache*1e3, tplain*1e3,
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testBiomeAt()
+{
+    static const struct { int mc, dim; uint32_t flags; } cfg[] = {
+        { MC_B1_7, DIM_OVERWORLD, 0 },
+        { MC_1_12, DIM_OVERWORLD, 0 },
+        { MC_1_17, DIM_OVERWORLD, FORCE_OCEAN_VARIANTS | LARGE_BIOMES },
+        { MC_1_18, DIM_OVERWORLD, 0 },
+        { MC_NEWEST, DIM_OVERWORLD, FLOAT_NOISE },
+        { MC_1_15, DIM_NETHER, 0 },
+        { MC_NEWEST, DIM_NETHER, 0 },
+        { MC_1_13, DIM_END, 0 },
+        { MC_NEWEST, DIM_END, 0 },
+    };
+    static const int scales[] = { 1, 2, 4, 16, 64, 256 };
+    Generator g;
+    int i, j, k, bad = 0;
+    uint64_t s = 0;
+
+    for (i = 0; i < (int)(sizeof(cfg)/sizeof(*cfg)); i++)
+    {
+        setupGenerator(&g, cfg[i].mc, cfg[i].flags);
+        applySeed(&g, cfg[i].dim, 12345 + i);
+        for (k = 0; k < (int)(sizeof(scales)/sizeof(*scales)); k++)
+        {
+            if (cfg[i].mc <= MC_B1_7 && scales[k] > 4)
+                continue;
+            if (cfg[i].dim == DIM_NETHER && scales[k] == 2)
+                continue; // unsupported, and reported on every call
+            int sc = scales[k];
+            // the layer stacks have no 1:2 entry to size the buffer from,
+            // and 1:4 needs at least as much for all generators
+            int *ids = allocCache(&g, (Range){sc == 2 ? 4 : sc, 0,0, 1,1, 0,1});
+            for (j = 0; j < 20; j++)
+            {
+                int x = (int)(nextLong(&s) % 20000) - 10000;
+                int z = (int)(nextLong(&s) % 20000) - 10000;
+                int y = sc == 1 ? 63 : 15;
+                Range r = {sc, x/sc, z/sc, 1, 1, y, 1};
+                // unsupported scales (such as 1:2 for most versions) fail
+                int id = genBiomes(&g, ids, r) ? none : ids[0];
+                bad += getBiomeAt(&g, sc, r.x, y, r.z) != id;
+                bad += getBiomeAtBuf(&g, ids, sc, r.x, y, r.z) != id;
+            }
+            free(ids);
+        }
+    }
+    printf("Single biome sampling: %s\e[0m\n",
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testBiomesToImage()
+{
+    unsigned char biomeColors[256][3];
+    initBiomeColors(biomeColors);
+    uint64_t s = 0;
+    int t, bad = 0;
+
+    for (t = 0; t < 20; t++)
+    {
+        unsigned int sx = 1 + nextInt(&s, 40), sy = 1 + nextInt(&s, 30);
+        unsigned int pixscale = 1 + nextInt(&s, 4);
+        int flip = t & 1, threads = 1 + (t % 5);
+        unsigned int i, j, w = sx * pixscale, h = sy * pixscale;
+        int *ids = (int*) malloc(sx * sy * sizeof(int));
+        unsigned char *pix = (unsigned char*) malloc(3 * w * h);
+        int invalid = 0;
+
+        for (i = 0; i < sx * sy; i++)
+        {
+            ids[i] = nextInt(&s, 300) - 20;
+            invalid |= ids[i] < 0 || ids[i] >= 256;
+        }
+        bad += biomesToImageParallel(pix, biomeColors, ids, sx, sy, pixscale,
+            flip, threads) != invalid;
+
+        for (j = 0; j < h; j++)
+        {
+            for (i = 0; i < w; i++)
+            {
+                unsigned int row = flip ? j / pixscale : sy-1 - j / pixscale;
+                int id = ids[row * sx + i / pixscale];
+                const unsigned char *c = biomeColors[id & 0x7f];
+                int k, dark = id < 0 || id >= 256;
+                if (!dark)
+                    c = biomeColors[id];
+                for (k = 0; k < 3; k++)
+                {
+                    int v = dark ? (c[k] < 40 ? 0 : c[k] - 40) : c[k];
+                    bad += pix[3*(j*w + i) + k] != v;
+                }
+            }
+        }
+        free(ids);
+        free(pix);
+    }
+    printf("Biomes to image: %s\e[0m\n",
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testLayerKernels()
+{
+    enum { W = 53, H = 7, N = 1024 };
+    Generator g;
+    uint64_t s = 0;
+    int mc, i, k, level, bad = 0;
+    int top = getSimdLevel();
+    double t[SIMD_AVX512 + 1];
+
+    // compare the kernels of each level against single cells, which are too
+    // narrow for the vector kernels
+    for (level = SIMD_NONE; level <= top; level++)
+    {
+        g_simd_limit = level;
+        for (mc = MC_B1_8; mc <= MC_1_17; mc++)
+        {
+            setupGenerator(&g, mc, mc == MC_1_17 ? LARGE_BIOMES : 0);
+            applySeed(&g, DIM_OVERWORLD, nextLong(&s));
+            for (k = 0; k < L_NUM; k++)
+            {
+                const Layer *l = &g.ls.layers[k];
+                if (l->getMap != mapZoom && l->getMap != mapZoomFuzzy &&
+                    l->getMap != mapLand && l->getMap != mapSmooth &&
+                    l->getMap != mapRiver)
+                    continue;
+                int x = (int)(nextLong(&s) % 2000) - 1000;
+                int z = (int)(nextLong(&s) % 2000) - 1000;
+                int *area = (int*) malloc(getMinLayerCacheSize(l, W, H) * sizeof(int));
+                int *cell = (int*) malloc(getMinLayerCacheSize(l, 1, 1) * sizeof(int));
+                genArea(l, area, x, z, W, H);
+                for (i = 0; i < W*H; i++)
+                {
+                    genArea(l, cell, x + i % W, z + i / W, 1, 1);
+                    bad += cell[0] != area[i];
+                }
+                free(area);
+                free(cell);
+            }
+        }
+
+        // best of a few runs of a large area at 1:4
+        setupGenerator(&g, MC_1_17, 0);
+        applySeed(&g, DIM_OVERWORLD, 1);
+        Range r = {4, -N/2, -N/2, N, N, 15, 1};
+        int *ids = allocCache(&g, r);
+        for (t[level] = 1e9, i = 0; i < 3; i++)
+        {
+            double t0 = now();
+            genBiomes(&g, ids, r);
+            if (now() - t0 < t[level])
+                t[level] = now() - t0;
+        }
+        free(ids);
+    }
+    g_simd_limit = SIMD_AVX512;
+
+    printf("Layer kernels (simd levels 0-%d): %dx%d @1:4 in", top, N, N);
+    for (level = SIMD_NONE; level <= top; level++)
+        printf(" %.1f", t[level] * 1e3);
+    printf(" ms %s\e[0m\n", bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
+
+int testSeedLanes()
+{
+    enum { W = 5, H = 3 };
+    static const int ids[] = {
+        L_CONTINENT_4096, L_ZOOM_2048, L_LAND_2048, L_ISLAND_1024,
+        L_SNOW_1024, L_COOL_1024, L_HEAT_1024, L_SPECIAL_1024,
+        L_MUSHROOM_256, L_DEEP_OCEAN_256, L_BIOME_256, L_BAMBOO_256,
+    };
+    uint64_t seeds[SEED_LANES];
+    Generator g;
+    uint64_t s = 0;
+    int mc, i, k, n, level, bad = 0;
+    int top = getSimdLevel();
+    double t0[SIMD_AVX512 + 1] = {0}, t1[SIMD_AVX512 + 1] = {0};
+
+    // without SIMD the lanes fall back to generating the seeds one by one
+    for (level = SIMD_NONE; level <= top; level++)
+    {
+        g_simd_limit = level;
+        for (mc = MC_1_7; mc <= MC_1_17; mc++)
+        {
+            setupGenerator(&g, mc, 0);
+            for (i = 0; i < (int)(sizeof(ids)/sizeof(*ids)); i++)
+            {
+                Layer *l = &g.ls.layers[ids[i]];
+                if (!l->getMap)
+                    continue;
+                int x = (int)(nextLong(&s) % 200) - 100;
+                int z = (int)(nextLong(&s) % 200) - 100;
+                size_t len = getMinLayerCacheSize(l, W, H);
+                int *lanes = (int*) malloc(len * SEED_LANES * sizeof(int));
+                int *area = (int*) malloc(len * sizeof(int));
+                for (n = 0; n < 50; n++)
+                {
+                    for (k = 0; k < SEED_LANES; k++)
+                        seeds[k] = nextLong(&s) >> (n & 1 ? 0 : 16);
+                    double t = now();
+                    bad += genSeedLanes(l, lanes, seeds, x, z, W, H) != 0;
+                    t1[level] += now() - t;
+                    for (k = 0; k < SEED_LANES; k++)
+                    {
+                        t = now();
+                        setLayerSeed(l, seeds[k]);
+                        genArea(l, area, x, z, W, H);
+                        t0[level] += now() - t;
+                        int c;
+                        for (c = 0; c < W*H; c++)
+                            bad += lanes[c*SEED_LANES + k] != area[c];
+                    }
+                }
+                free(lanes);
+                free(area);
+            }
+        }
+    }
+    g_simd_limit = SIMD_AVX512;
+
+    printf("Seed lanes vs seed by seed (simd levels 0-%d):", top);
+    for (level = SIMD_NONE; level <= top; level++)
+        printf(" %.0f/%.0f", t1[level] * 1e3, t0[level] * 1e3);
+    printf(" ms %s\e[0m\n", bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    return bad ? -1 : 0;
+}
 
 int k_tot;
 struct _f_para { double v; double *buf; int x, z, w, h; };
@@ -463,6 +1174,101 @@ void findStructures(int structureType, int mc, int dim, uint64_t seed,
     }
 }
 
+static int checkSearch(uint64_t s48, void *data)
+{
+    (void) data;
+    uint32_t h = hash32((uint32_t)(s48 >> 16) ^ hash32((uint32_t)s48));
+    return (h & 1023) == 0;
+}
+
+static void reportSearch(const double *rate, int threads, double done, void *data)
+{
+    (void) rate; (void) threads;
+    volatile char *stop = (volatile char*) data;
+    if (done >= 0.25)
+        *stop = 1; // interrupt the first run to test resuming
+}
+
+int testSearchAll48()
+{
+    const uint64_t lowBits[] = { 0x12345, 0x54321, 0xabcdef, 0 };
+    const int lowBitN = 24;
+    const char *path = "search48_test.txt";
+    uint64_t *exp = NULL, *a = NULL, *b = NULL;
+    uint64_t explen = 0, alen = 0, blen = 0, mid, i;
+    volatile char stop = 0;
+    int j, bad = 0;
+    double t;
+
+    for (mid = 0; mid <= MASK48; mid += 1ULL << lowBitN)
+    {
+        for (j = 0; lowBits[j]; j++)
+        {
+            if (!checkSearch(mid | lowBits[j], NULL))
+                continue;
+            exp = (uint64_t*) realloc(exp, (explen + 1) * sizeof(*exp));
+            exp[explen++] = mid | lowBits[j];
+        }
+    }
+
+    t = -now();
+    bad += searchAll48(&a, &alen, NULL, 4, lowBits, lowBitN,
+        checkSearch, NULL, NULL) != 0;
+    t += now();
+    bad += alen != explen;
+    for (i = 0; i < alen && i < explen; i++)
+        bad += a[i] != exp[i];
+
+    // interrupted search into a file, then continued with fewer threads
+    remove(path);
+    bad += searchAll48Report(NULL, NULL, path, 4, lowBits, lowBitN,
+        checkSearch, NULL, &stop, reportSearch, (void*)&stop, 0.01) == 0 && stop;
+    bad += searchAll48(&b, &blen, path, 3, lowBits, lowBitN,
+        checkSearch, NULL, NULL) != 0;
+    bad += blen != explen;
+    for (i = 0; i < blen && i < explen; i++)
+        bad += b[i] != exp[i];
+    free(b);
+    b = loadSavedSeeds(path, &blen);
+    bad += blen != explen;
+    for (i = 0; i < blen && i < explen; i++)
+        bad += b[i] != exp[i];
+    remove(path);
+
+    // a partial file of the older format without chunk markers is moved aside
+    // untouched, and a second one is refused rather than overwriting the first
+    char ppath[64], opath[64], line[64];
+    snprintf(ppath, sizeof(ppath), "%s.part0", path);
+    snprintf(opath, sizeof(opath), "%s.part0.old", path);
+    for (j = 0; j < 2; j++)
+    {
+        FILE *fp = fopen(ppath, "w");
+        fprintf(fp, "123\n456\n");
+        fclose(fp);
+        free(b);
+        b = NULL;
+        int r = searchAll48(&b, &blen, path, 2, lowBits, lowBitN,
+            checkSearch, NULL, NULL);
+        bad += j == 0 ? r != 0 || blen != explen : r == 0;
+        fp = fopen(j == 0 ? opath : ppath, "r");
+        bad += !fp || !fgets(line, sizeof(line), fp) || strcmp(line, "123\n");
+        bad += !fp || !fgets(line, sizeof(line), fp) || strcmp(line, "456\n");
+        if (fp)
+            fclose(fp);
+    }
+    remove(ppath);
+    remove(opath);
+    remove(path);
+
+    printf("Search all 48: %" PRIu64 " of %.1fM seeds in %.1f ms %s\e[0m\n",
+        explen, 3 * 0x1p24 / 1e6, t*1e3,
+        bad ? "\e[1;91mFAILED" : "\e[1;92mOK");
+    free(exp);
+    free(a);
+    free(b);
+    return bad ? -1 : 0;
+}
+
 int main()
 {
     //testAreas(mc, 0, 1);
@@ -471,6 +1277,20 @@ int main()
     //testAreas(mc, 0, 256);
     //testCanBiomesGenerate();
     testGeneration();
+    testNoiseBatch();
+    testBeta17Terrain();
+    testClimateToBiomeBatch();
+    testClimateIndex();
+    testFloatNoise();
+    testCoarseClimate();
+    testGeneratorCache();
+    testLazyLayerSeed();
+    testLayerCache();
+    testBiomeAt();
+    testBiomesToImage();
+    testLayerKernels();
+    testSeedLanes();
+    testSearchAll48();
     //findBiomeParaBounds();
 
     return 0;
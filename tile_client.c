@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Stub client for tile_server: sends one tile job over 'count' connections at
+// once (to exercise the coalescing of duplicate jobs) and prints the replies.
+
+int connectServer(const char *socketPath) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Error connecting to %s: %s\n", socketPath, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 7 || argc > 8) {
+        fprintf(stderr, "Usage: %s <socket> <seed> <zoom> <x> <y> <scale> [count]\n", argv[0]);
+        return 1;
+    }
+    int count = argc > 7 ? atoi(argv[7]) : 1;
+    if (count < 1)
+        count = 1;
+
+    char request[256];
+    snprintf(request, sizeof(request), "%s %s %s %s %s\n",
+            argv[2], argv[3], argv[4], argv[5], argv[6]);
+
+    int *fds = (int *)malloc(count * sizeof(int));
+    int i, err = 0;
+    for (i = 0; i < count; i++) {
+        fds[i] = connectServer(argv[1]);
+        if (fds[i] < 0 || write(fds[i], request, strlen(request)) < 0) {
+            count = i + (fds[i] >= 0);
+            err = 1;
+            break;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        char reply[4096 + 64];
+        size_t n = 0;
+        ssize_t got;
+        while (n < sizeof(reply) - 1 && (got = read(fds[i], reply + n, sizeof(reply) - 1 - n)) > 0) {
+            n += got;
+            if (reply[n-1] == '\n')
+                break;
+        }
+        reply[n] = '\0';
+        printf("%s", n ? reply : "ERR no reply\n");
+        err |= strncmp(reply, "OK", 2) != 0;
+        close(fds[i]);
+    }
+
+    free(fds);
+    return err;
+}
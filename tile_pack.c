@@ -0,0 +1,466 @@
+#include "tile_pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#define PACK_MAGIC      "TILEPACK"
+#define INDEX_MAGIC     "TILEIDX1"
+#define RECORD_MAGIC    0x454c4954 // "TILE"
+#define MIN_CAPACITY    1024
+
+typedef struct {
+    char magic[8];
+    uint64_t id;
+} PackHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;
+    uint64_t seed;
+    int32_t zoom, x, y;
+    uint32_t check;         // checksum of the fields above
+} RecordHeader;
+
+typedef struct {
+    char magic[8];
+    uint64_t id;            // must match the id of the pack
+    uint64_t end;           // end of the records covered by the index
+    uint64_t count;
+    uint64_t cap;
+    uint64_t reserved;
+} IndexHeader;
+
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashKey(uint64_t seed, int zoom, int x, int y) {
+    uint64_t h = mix64(seed);
+    h = mix64(h ^ ((uint64_t)(uint32_t)zoom << 32 | (uint32_t)x));
+    return mix64(h ^ (uint32_t)y);
+}
+
+static uint32_t recordCheck(const RecordHeader *rh) {
+    uint64_t h = hashKey(rh->seed, rh->zoom, rh->x, rh->y);
+    return (uint32_t)mix64(h ^ rh->size ^ ((uint64_t)rh->magic << 32));
+}
+
+static char *indexPath(const TilePack *tp, const char *suffix) {
+    size_t len = strlen(tp->path) + strlen(suffix) + 1;
+    char *p = (char *)malloc(len);
+    if (p)
+        snprintf(p, len, "%s%s", tp->path, suffix);
+    return p;
+}
+
+// Returns the slot of the key, or the empty slot where it would be inserted.
+static TilePackEntry *findSlot(TilePackEntry *table, uint64_t cap,
+        uint64_t seed, int zoom, int x, int y) {
+    uint64_t i = hashKey(seed, zoom, x, y) & (cap - 1);
+    for (;; i = (i + 1) & (cap - 1)) {
+        TilePackEntry *e = &table[i];
+        if (e->offset == 0 || (e->seed == seed && e->zoom == zoom && e->x == x && e->y == y))
+            return e;
+    }
+}
+
+static int growTable(TilePack *tp) {
+    uint64_t cap = 2 * tp->cap;
+    TilePackEntry *table = (TilePackEntry *)calloc(cap, sizeof(TilePackEntry));
+    if (!table) {
+        fprintf(stderr, "Error allocating memory for the tile index\n");
+        return -1;
+    }
+    for (uint64_t i = 0; i < tp->cap; i++) {
+        const TilePackEntry *e = &tp->table[i];
+        if (e->offset)
+            *findSlot(table, cap, e->seed, e->zoom, e->x, e->y) = *e;
+    }
+    free(tp->table);
+    tp->table = table;
+    tp->cap = cap;
+    return 0;
+}
+
+static int insertEntry(TilePack *tp, const RecordHeader *rh, uint64_t offset) {
+    // keep the load factor below 3/4
+    if (4 * (tp->count + 1) > 3 * tp->cap && growTable(tp) != 0)
+        return -1;
+    TilePackEntry *e = findSlot(tp->table, tp->cap, rh->seed, rh->zoom, rh->x, rh->y);
+    if (e->offset == 0)
+        tp->count++;
+    e->seed = rh->seed;
+    e->zoom = rh->zoom;
+    e->x = rh->x;
+    e->y = rh->y;
+    e->size = rh->size;
+    e->offset = offset;
+    return 0;
+}
+
+// Loads the index of a writable pack, if it is present and belongs to the pack.
+static void loadIndex(TilePack *tp, uint64_t fileSize) {
+    char *path = indexPath(tp, ".idx");
+    int fd = path ? open(path, O_RDONLY) : -1;
+    free(path);
+    if (fd < 0)
+        return;
+
+    IndexHeader ih;
+    struct stat st;
+    if (pread(fd, &ih, sizeof(ih), 0) == (ssize_t)sizeof(ih) && fstat(fd, &st) == 0 &&
+            memcmp(ih.magic, INDEX_MAGIC, 8) == 0 && ih.id == tp->id &&
+            ih.end <= fileSize && ih.cap >= MIN_CAPACITY && (ih.cap & (ih.cap - 1)) == 0 &&
+            (uint64_t)st.st_size == sizeof(ih) + ih.cap * sizeof(TilePackEntry)) {
+        size_t len = ih.cap * sizeof(TilePackEntry);
+        TilePackEntry *table = (TilePackEntry *)malloc(len);
+        if (table && pread(fd, table, len, sizeof(ih)) == (ssize_t)len) {
+            free(tp->table);
+            tp->table = table;
+            tp->cap = ih.cap;
+            tp->count = ih.count;
+            tp->end = ih.end;
+        } else {
+            free(table);
+        }
+    }
+    close(fd);
+}
+
+// Adds the records after the end of the index, and cuts off an incomplete
+// record that was left by an interrupted writer.
+static int recoverRecords(TilePack *tp, uint64_t fileSize) {
+    RecordHeader rh;
+    while (tp->end + sizeof(rh) <= fileSize) {
+        if (pread(tp->fd, &rh, sizeof(rh), tp->end) != (ssize_t)sizeof(rh) ||
+                rh.magic != RECORD_MAGIC || rh.check != recordCheck(&rh) ||
+                tp->end + sizeof(rh) + rh.size > fileSize)
+            break;
+        if (insertEntry(tp, &rh, tp->end + sizeof(rh)) != 0)
+            return -1;
+        tp->end += sizeof(rh) + rh.size;
+    }
+    if (tp->end < fileSize) {
+        fprintf(stderr, "Discarding %lu bytes of incomplete tiles at the end of %s\n",
+                (unsigned long)(fileSize - tp->end), tp->path);
+        if (ftruncate(tp->fd, tp->end) != 0) {
+            fprintf(stderr, "Error truncating %s: %s\n", tp->path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int openWriter(TilePack *tp) {
+    struct stat st;
+    PackHeader ph;
+
+    if (flock(tp->fd, LOCK_EX) != 0 || fstat(tp->fd, &st) != 0) {
+        fprintf(stderr, "Error locking %s: %s\n", tp->path, strerror(errno));
+        return -1;
+    }
+
+    tp->cap = MIN_CAPACITY;
+    tp->table = (TilePackEntry *)calloc(tp->cap, sizeof(TilePackEntry));
+    if (!tp->table) {
+        fprintf(stderr, "Error allocating memory for the tile index\n");
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        // new pack, with an id that tells its index apart from older ones
+        memcpy(ph.magic, PACK_MAGIC, 8);
+        ph.id = mix64((uint64_t)time(NULL) ^ ((uint64_t)getpid() << 32) ^ (uint64_t)(uintptr_t)tp);
+        if (pwrite(tp->fd, &ph, sizeof(ph), 0) != (ssize_t)sizeof(ph)) {
+            fprintf(stderr, "Error writing %s: %s\n", tp->path, strerror(errno));
+            return -1;
+        }
+        tp->id = ph.id;
+        tp->end = sizeof(ph);
+        return 0;
+    }
+
+    if (pread(tp->fd, &ph, sizeof(ph), 0) != (ssize_t)sizeof(ph) || memcmp(ph.magic, PACK_MAGIC, 8) != 0) {
+        fprintf(stderr, "Not a tile pack: %s\n", tp->path);
+        return -1;
+    }
+    tp->id = ph.id;
+    tp->end = sizeof(ph);
+    loadIndex(tp, st.st_size);
+    return recoverRecords(tp, st.st_size);
+}
+
+static int openReader(TilePack *tp) {
+    PackHeader ph;
+    if (pread(tp->fd, &ph, sizeof(ph), 0) != (ssize_t)sizeof(ph) || memcmp(ph.magic, PACK_MAGIC, 8) != 0) {
+        fprintf(stderr, "Not a tile pack: %s\n", tp->path);
+        return -1;
+    }
+
+    char *path = indexPath(tp, ".idx");
+    int fd = path ? open(path, O_RDONLY) : -1;
+    if (fd < 0) {
+        fprintf(stderr, "Error opening the index %s: %s\n", path ? path : tp->path, strerror(errno));
+        free(path);
+        return -1;
+    }
+
+    struct stat st;
+    const IndexHeader *ih = NULL;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(IndexHeader)) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            tp->map = map;
+            tp->mapSize = st.st_size;
+            ih = (const IndexHeader *)map;
+        }
+    }
+    close(fd);
+
+    if (!ih || memcmp(ih->magic, INDEX_MAGIC, 8) != 0 || ih->id != ph.id ||
+            ih->cap == 0 || (ih->cap & (ih->cap - 1)) != 0 ||
+            tp->mapSize != sizeof(*ih) + ih->cap * sizeof(TilePackEntry)) {
+        fprintf(stderr, "The index %s does not belong to the pack, "
+                "it is rebuilt when the pack is opened for writing\n", path);
+        free(path);
+        return -1;
+    }
+    free(path);
+
+    tp->id = ih->id;
+    tp->end = ih->end;
+    tp->count = ih->count;
+    tp->cap = ih->cap;
+    tp->table = (TilePackEntry *)(ih + 1);
+    return 0;
+}
+
+int tilePackOpen(TilePack *tp, const char *path, int writable) {
+    memset(tp, 0, sizeof(*tp));
+    tp->writable = writable;
+    tp->path = strdup(path);
+    tp->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0666);
+    if (!tp->path || tp->fd < 0) {
+        fprintf(stderr, "Error opening tile pack %s: %s\n", path, strerror(errno));
+        free(tp->path);
+        if (tp->fd >= 0)
+            close(tp->fd);
+        return -1;
+    }
+    pthread_mutex_init(&tp->mutex, NULL);
+
+    if ((writable ? openWriter(tp) : openReader(tp)) != 0) {
+        tp->writable = 0;
+        tilePackClose(tp);
+        return -1;
+    }
+    return 0;
+}
+
+int tilePackFlush(TilePack *tp) {
+    if (!tp->writable)
+        return 0;
+
+    pthread_mutex_lock(&tp->mutex);
+    int err = -1;
+    char *tmp = indexPath(tp, ".idx.tmp");
+    char *path = indexPath(tp, ".idx");
+    int fd = tmp ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666) : -1;
+
+    if (fd >= 0) {
+        // the records have to be on disk before an index refers to them
+        IndexHeader ih;
+        memset(&ih, 0, sizeof(ih));
+        memcpy(ih.magic, INDEX_MAGIC, 8);
+        ih.id = tp->id;
+        ih.end = tp->end;
+        ih.count = tp->count;
+        ih.cap = tp->cap;
+        struct iovec iov[2] = {
+            { &ih, sizeof(ih) },
+            { tp->table, tp->cap * sizeof(TilePackEntry) },
+        };
+        ssize_t len = iov[0].iov_len + iov[1].iov_len;
+        if (fdatasync(tp->fd) == 0 && writev(fd, iov, 2) == len &&
+                fdatasync(fd) == 0 && close(fd) == 0) {
+            fd = -1;
+            err = rename(tmp, path);
+        }
+    }
+    if (err != 0) {
+        fprintf(stderr, "Error writing the index of %s: %s\n", tp->path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        if (tmp)
+            unlink(tmp);
+    }
+    free(tmp);
+    free(path);
+    pthread_mutex_unlock(&tp->mutex);
+    return err;
+}
+
+int tilePackClose(TilePack *tp) {
+    int err = tilePackFlush(tp);
+    if (tp->map)
+        munmap(tp->map, tp->mapSize);
+    else
+        free(tp->table);
+    if (tp->fd >= 0)
+        close(tp->fd); // releases the lock
+    pthread_mutex_destroy(&tp->mutex);
+    free(tp->path);
+    memset(tp, 0, sizeof(*tp));
+    tp->fd = -1;
+    return err;
+}
+
+int tilePackPut(TilePack *tp, uint64_t seed, int zoom, int x, int y,
+        const void *data, size_t size) {
+    if (!tp->writable || size > UINT32_MAX)
+        return -1;
+
+    RecordHeader rh;
+    rh.magic = RECORD_MAGIC;
+    rh.size = (uint32_t)size;
+    rh.seed = seed;
+    rh.zoom = zoom;
+    rh.x = x;
+    rh.y = y;
+    rh.check = recordCheck(&rh);
+
+    pthread_mutex_lock(&tp->mutex);
+    struct iovec iov[2] = {
+        { &rh, sizeof(rh) },
+        { (void *)data, size },
+    };
+    int err = -1;
+    if (pwritev(tp->fd, iov, 2, tp->end) == (ssize_t)(sizeof(rh) + size)) {
+        err = insertEntry(tp, &rh, tp->end + sizeof(rh));
+        if (err == 0)
+            tp->end += sizeof(rh) + size;
+    } else {
+        fprintf(stderr, "Error writing to %s: %s\n", tp->path, strerror(errno));
+    }
+    pthread_mutex_unlock(&tp->mutex);
+    return err;
+}
+
+const TilePackEntry *tilePackFind(TilePack *tp, uint64_t seed, int zoom, int x, int y) {
+    if (!tp->table)
+        return NULL;
+    const TilePackEntry *e = findSlot(tp->table, tp->cap, seed, zoom, x, y);
+    return e->offset ? e : NULL;
+}
+
+ssize_t tilePackGet(TilePack *tp, uint64_t seed, int zoom, int x, int y,
+        void *buf, size_t bufsize) {
+    TilePackEntry e;
+    const TilePackEntry *p;
+
+    if (tp->writable)
+        pthread_mutex_lock(&tp->mutex);
+    p = tilePackFind(tp, seed, zoom, x, y);
+    if (p)
+        e = *p;
+    if (tp->writable)
+        pthread_mutex_unlock(&tp->mutex);
+
+    if (!p)
+        return -1;
+    if (e.size > bufsize)
+        return e.size;
+    if (pread(tp->fd, buf, e.size, e.offset) != (ssize_t)e.size)
+        return -1;
+    return e.size;
+}
+
+static int compareOffsets(const void *a, const void *b) {
+    const TilePackEntry *ea = (const TilePackEntry *)a;
+    const TilePackEntry *eb = (const TilePackEntry *)b;
+    return (ea->offset > eb->offset) - (ea->offset < eb->offset);
+}
+
+// Checks whether two paths name the same file, under whichever alias.
+static int isSameFile(const char *a, const char *b) {
+    struct stat sa, sb;
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 &&
+            sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+int tilePackCompact(const char *src, const char *dst) {
+    TilePack in, out;
+
+    // opening the source for writing completes its index and keeps writers out
+    if (tilePackOpen(&in, src, 1) != 0)
+        return -1;
+
+    // the destination files get removed, so they must not be the source
+    char idx[4096], srcIdx[4096];
+    snprintf(idx, sizeof(idx), "%s.idx", dst);
+    snprintf(srcIdx, sizeof(srcIdx), "%s.idx", src);
+    if (isSameFile(src, dst) || isSameFile(src, idx) || isSameFile(srcIdx, dst)) {
+        fprintf(stderr, "Cannot compact %s into itself\n", src);
+        tilePackClose(&in);
+        return -1;
+    }
+    unlink(dst);
+    unlink(idx);
+    if (tilePackOpen(&out, dst, 1) != 0) {
+        tilePackClose(&in);
+        return -1;
+    }
+
+    // copy the live tiles in the order of the source
+    TilePackEntry *entries = (TilePackEntry *)malloc((in.count + 1) * sizeof(TilePackEntry));
+    uint64_t i, n = 0;
+    for (i = 0; entries && i < in.cap; i++) {
+        if (in.table[i].offset)
+            entries[n++] = in.table[i];
+    }
+    qsort(entries, n, sizeof(TilePackEntry), compareOffsets);
+
+    int err = entries ? 0 : -1;
+    size_t bufsize = 1 << 16;
+    unsigned char *buf = (unsigned char *)malloc(bufsize);
+    for (i = 0; i < n && err == 0 && buf; i++) {
+        const TilePackEntry *e = &entries[i];
+        if (e->size > bufsize) {
+            free(buf);
+            bufsize = e->size;
+            buf = (unsigned char *)malloc(bufsize);
+            if (!buf)
+                break;
+        }
+        if (pread(in.fd, buf, e->size, e->offset) != (ssize_t)e->size) {
+            fprintf(stderr, "Error reading from %s: %s\n", src, strerror(errno));
+            err = -1;
+        } else {
+            err = tilePackPut(&out, e->seed, e->zoom, e->x, e->y, buf, e->size);
+        }
+    }
+    if (!buf) {
+        fprintf(stderr, "Error allocating memory for tiles\n");
+        err = -1;
+    }
+
+    free(buf);
+    free(entries);
+    if (tilePackClose(&out) != 0)
+        err = -1;
+    tilePackClose(&in);
+    return err;
+}
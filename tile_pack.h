@@ -0,0 +1,100 @@
+#ifndef TILE_PACK_H
+#define TILE_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <pthread.h>
+
+// A tile pack stores encoded tiles keyed by (seed, zoom, x, y) in a single
+// append-only data file '<path>', with a hash table index in '<path>.idx'.
+//
+// Writers append records of a header plus the tile data, where a newer record
+// replaces older ones with the same key. The index is rewritten atomically by
+// tilePackFlush() and tilePackClose(), and if a writer dies in between, the
+// next writer recovers the missing entries from the record headers. Only one
+// writer (per pack) is active at a time, others block in tilePackOpen().
+//
+// Readers map the index and look up a tile with one probe sequence in the
+// mapped table and one pread() of the data. They see the tiles as of the last
+// flush of the index.
+//
+// Files are in host byte order.
+
+typedef struct {
+    uint64_t seed;
+    int32_t zoom, x, y;
+    uint32_t size;          // size of the tile data in bytes
+    uint64_t offset;        // offset of the tile data in the pack, 0 if empty
+} TilePackEntry;
+
+typedef struct {
+    int fd;                 // pack data file
+    int writable;
+    uint64_t id;            // identifies the pack that the index belongs to
+    uint64_t end;           // end of the records (= next append position)
+    uint64_t count;         // number of tiles in the index
+    uint64_t cap;           // size of the hash table (a power of two)
+    TilePackEntry *table;   // hash table, mapped from the index for readers
+    void *map;              // mapped index file (readers only)
+    size_t mapSize;
+    char *path;
+    pthread_mutex_t mutex;  // serializes the writers of this process
+} TilePack;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * Opens the tile pack at 'path'. If 'writable' is non-zero, the pack is
+ * created if it does not exist yet, and the call waits for other writers to
+ * close it first. Returns zero upon success.
+ */
+int tilePackOpen(TilePack *tp, const char *path, int writable);
+
+/**
+ * Flushes the index of a writable pack, and closes the pack.
+ * Returns zero upon success.
+ */
+int tilePackClose(TilePack *tp);
+
+/**
+ * Appends a tile, replacing any older tile with the same key. This can be
+ * called from several threads. Returns zero upon success.
+ */
+int tilePackPut(TilePack *tp, uint64_t seed, int zoom, int x, int y,
+        const void *data, size_t size);
+
+/**
+ * Writes the index of a writable pack, so that readers see the tiles that
+ * were added so far. Returns zero upon success.
+ */
+int tilePackFlush(TilePack *tp);
+
+/**
+ * Looks up a tile and returns its index entry, or NULL if it is not present.
+ * The entry remains valid until the next tilePackPut() or tilePackClose().
+ */
+const TilePackEntry *tilePackFind(TilePack *tp, uint64_t seed, int zoom, int x, int y);
+
+/**
+ * Reads a tile into 'buf' and returns its size. If the tile is larger than
+ * 'bufsize', nothing is read and the required size is returned. Returns -1 if
+ * the tile is not present or cannot be read.
+ */
+ssize_t tilePackGet(TilePack *tp, uint64_t seed, int zoom, int x, int y,
+        void *buf, size_t bufsize);
+
+/**
+ * Copies the current tiles of the pack at 'src' into a new pack at 'dst',
+ * leaving out the replaced records. Returns zero upon success.
+ */
+int tilePackCompact(const char *src, const char *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TILE_PACK_H
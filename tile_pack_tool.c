@@ -0,0 +1,72 @@
+#include "tile_pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Inspects and maintains tile packs (see tile_pack.h):
+//   list <pack>                             prints the tiles of the pack
+//   get <pack> <seed> <zoom> <x> <y> <out>  extracts a tile to a file
+//   compact <src> <dst>                     copies the current tiles to a new pack
+
+int listTiles(const char *path) {
+    TilePack tp;
+    if (tilePackOpen(&tp, path, 0) != 0)
+        return 1;
+
+    uint64_t i, bytes = 0;
+    for (i = 0; i < tp.cap; i++) {
+        const TilePackEntry *e = &tp.table[i];
+        if (e->offset) {
+            printf("%lu %d %d %d %u\n", (unsigned long)e->seed, e->zoom, e->x, e->y, e->size);
+            bytes += e->size;
+        }
+    }
+    fprintf(stderr, "%lu tiles with %lu bytes, in %lu bytes of records\n",
+            (unsigned long)tp.count, (unsigned long)bytes, (unsigned long)tp.end);
+    tilePackClose(&tp);
+    return 0;
+}
+
+int getTile(const char *path, uint64_t seed, int zoom, int x, int y, const char *outputFile) {
+    TilePack tp;
+    if (tilePackOpen(&tp, path, 0) != 0)
+        return 1;
+
+    const TilePackEntry *e = tilePackFind(&tp, seed, zoom, x, y);
+    if (!e) {
+        fprintf(stderr, "Tile %d_%d at zoom level %d not found\n", x, y, zoom);
+        tilePackClose(&tp);
+        return 1;
+    }
+
+    size_t size = e->size;
+    unsigned char *buf = (unsigned char *)malloc(size ? size : 1);
+    FILE *fp = NULL;
+    int err = 1;
+    if (buf && tilePackGet(&tp, seed, zoom, x, y, buf, size) == (ssize_t)size &&
+            (fp = fopen(outputFile, "wb")) && fwrite(buf, 1, size, fp) == size)
+        err = 0;
+    if (fp && fclose(fp) != 0)
+        err = 1;
+    if (err)
+        fprintf(stderr, "Error extracting tile %d_%d to %s\n", x, y, outputFile);
+
+    free(buf);
+    tilePackClose(&tp);
+    return err;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 3 && !strcmp(argv[1], "list"))
+        return listTiles(argv[2]);
+    if (argc == 8 && !strcmp(argv[1], "get"))
+        return getTile(argv[2], strtoull(argv[3], NULL, 10), atoi(argv[4]),
+                atoi(argv[5]), atoi(argv[6]), argv[7]);
+    if (argc == 4 && !strcmp(argv[1], "compact"))
+        return tilePackCompact(argv[2], argv[3]) != 0;
+
+    fprintf(stderr, "Usage: %s list <pack>\n", argv[0]);
+    fprintf(stderr, "       %s get <pack> <seed> <zoom> <x> <y> <outputFile>\n", argv[0]);
+    fprintf(stderr, "       %s compact <srcPack> <dstPack>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,416 @@
+#include "generator.h"
+#include "util.h"
+#include "image_utils.h"
+#include "tile_pack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+
+// Long-running tile renderer. Jobs are read from a Unix-domain socket as lines
+//   <seed> <zoom> <x> <y> <scale>
+// and each one is answered with a line
+//   OK <total ms> <queue ms> <coalesced> <file>   or   ERR <message>
+// Identical jobs that are still in flight are rendered only once. At most
+// MAX_CONNECTIONS clients are served at a time.
+// If TILE_PACK is set, the tiles are written to that tile pack instead of the
+// output directory, and <file> is given as <pack>:<seed>/<zoom>/<x>/<y>. The
+// index of the pack is updated before the reply if no other job is queued, and
+// otherwise once per PACK_FLUSH_INTERVAL, so readers can see a tile up to that
+// long after its reply.
+
+#define TILE_SIZE 128
+#define PIX4CELL 4
+#define LINE_MAX_LEN 256
+#define PACK_FLUSH_INTERVAL 1.0 // seconds between updates of the pack index
+#define MAX_CONNECTIONS 256     // further connections are refused with ERR
+
+typedef struct Job Job;
+struct Job {
+    uint64_t seed;
+    int zoom, x, y, scale;
+    int done, err;
+    int waiters;            // connections waiting for this job
+    double tsubmit, tstart, tend;
+    char path[4096];
+    Job *next;              // queue of pending jobs
+    Job *inext;             // list of jobs in flight
+};
+
+const char *outputDir;
+unsigned char biomeColors[256][3];
+GeneratorCache genCache; // seeded generators, shared by the workers
+TilePack tilePack;
+int usePack = 0;
+int packDirty = 0;          // tiles were added since the last flush
+int connections = 0;        // open connections, each served by a thread
+
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+Job *queueHead = NULL, *queueTail = NULL;
+Job *inflight = NULL;
+
+double now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int createDir(const char *path) {
+    char tmp[4096];
+    char *p;
+    snprintf(tmp, sizeof(tmp), "%s", path);
+
+    // Handle absolute and relative paths consistently
+    p = (tmp[0] == '/') ? tmp + 1 : tmp;
+
+    for (; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(tmp, 0777) && errno != EEXIST) {
+                fprintf(stderr, "Error creating directory %s: %s\n", tmp, strerror(errno));
+                return -1;
+            }
+            *p = '/';
+        }
+    }
+
+    if (mkdir(tmp, 0777) && errno != EEXIST) {
+        fprintf(stderr, "Error creating directory %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// Renders a tile like generateTile() in generate_map.c, with a warm generator.
+int renderTile(Generator *g, int *warm, Job *job) {
+    if (!*warm || g->seed != job->seed) {
+        acquireGenerator(&genCache, g, MC_1_18, LARGE_BIOMES, DIM_OVERWORLD, job->seed);
+        *warm = 1;
+    }
+
+    Range r = {
+        .scale = job->scale,
+        .x = job->x * TILE_SIZE,
+        .z = job->y * TILE_SIZE,
+        .sx = TILE_SIZE,
+        .sz = TILE_SIZE,
+        .y = 15,
+        .sy = 1
+    };
+
+    int *biomeIds = allocCache(g, r);
+    int err = -1;
+
+    if (biomeIds && genBiomes(g, biomeIds, r) == 0) {
+        if (usePack) {
+            size_t size;
+            unsigned char *png = encodePNGIndexed(biomeIds, r.sx, r.sz, PIX4CELL, biomeColors, &size);
+            if (png && tilePackPut(&tilePack, job->seed, job->zoom, job->x, job->y, png, size) == 0)
+                err = 0;
+            free(png);
+            snprintf(job->path, sizeof(job->path), "%s:%lu/%d/%d/%d", tilePack.path,
+                    (unsigned long)job->seed, job->zoom, job->x, job->y);
+        } else {
+            char tileDir[2048];
+            snprintf(tileDir, sizeof(tileDir), "%s/%lu/%d/%d", outputDir,
+                    (unsigned long)job->seed, job->zoom, job->x);
+            snprintf(job->path, sizeof(job->path), "%s/%d.png", tileDir, job->y);
+            if (createDir(tileDir) == 0 && savePNGIndexed(job->path, biomeIds, r.sx, r.sz, PIX4CELL, biomeColors) == 0)
+                err = 0;
+        }
+    }
+
+    free(biomeIds);
+    return err;
+}
+
+// Makes the tiles written so far visible to the readers of the pack. This is
+// called with the mutex held, which is released during the flush.
+void flushPack() {
+    packDirty = 0;
+    pthread_mutex_unlock(&mutex);
+    tilePackFlush(&tilePack);
+    pthread_mutex_lock(&mutex);
+}
+
+// Flushes the tiles of busy workers once per PACK_FLUSH_INTERVAL.
+void *flusher(void *arg) {
+    struct timespec ts = {
+        .tv_sec = (time_t)PACK_FLUSH_INTERVAL,
+        .tv_nsec = (long)((PACK_FLUSH_INTERVAL - (time_t)PACK_FLUSH_INTERVAL) * 1e9)
+    };
+    (void) arg;
+
+    for (;;) {
+        nanosleep(&ts, NULL);
+        pthread_mutex_lock(&mutex);
+        if (packDirty)
+            flushPack();
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+void *worker(void *arg) {
+    Generator g;
+    int warm = 0;
+    (void) arg;
+
+    for (;;) {
+        pthread_mutex_lock(&mutex);
+        while (!queueHead)
+            pthread_cond_wait(&queueCond, &mutex);
+        Job *job = queueHead;
+        queueHead = job->next;
+        if (!queueHead)
+            queueTail = NULL;
+        job->tstart = now();
+        pthread_mutex_unlock(&mutex);
+
+        int err = renderTile(&g, &warm, job);
+
+        pthread_mutex_lock(&mutex);
+        if (usePack && !err) {
+            // without other jobs queued the tile is flushed before the reply,
+            // otherwise the flusher gets to it
+            packDirty = 1;
+            if (!queueHead)
+                flushPack();
+        }
+        job->err = err;
+        job->tend = now();
+        job->done = 1;
+        // a finished job no longer takes new waiters
+        Job **p;
+        for (p = &inflight; *p; p = &(*p)->inext) {
+            if (*p == job) {
+                *p = job->inext;
+                break;
+            }
+        }
+        printf("seed=%lu zoom=%d tile=%d,%d scale=%d: %.1f ms (queued %.1f ms, render %.1f ms), %d waiting%s\n",
+                (unsigned long)job->seed, job->zoom, job->x, job->y, job->scale,
+                (job->tend - job->tsubmit) * 1e3, (job->tstart - job->tsubmit) * 1e3,
+                (job->tend - job->tstart) * 1e3, job->waiters, err ? " FAILED" : "");
+        fflush(stdout);
+        pthread_cond_broadcast(&doneCond);
+        pthread_mutex_unlock(&mutex);
+    }
+    return NULL;
+}
+
+// Submits a job, or joins an identical one in flight, and waits for it.
+void runJob(const Job *req, char *reply, size_t len) {
+    double t0 = now();
+    int coalesced = 0;
+    Job *job;
+
+    pthread_mutex_lock(&mutex);
+    for (job = inflight; job; job = job->inext) {
+        if (job->seed == req->seed && job->zoom == req->zoom && job->x == req->x &&
+                job->y == req->y && job->scale == req->scale)
+            break;
+    }
+    if (job) {
+        coalesced = 1;
+    } else {
+        job = (Job *)calloc(1, sizeof(Job));
+        if (!job) {
+            pthread_mutex_unlock(&mutex);
+            snprintf(reply, len, "ERR out of memory\n");
+            return;
+        }
+        *job = *req;
+        job->tsubmit = t0;
+        job->inext = inflight;
+        inflight = job;
+        if (queueTail)
+            queueTail->next = job;
+        else
+            queueHead = job;
+        queueTail = job;
+        pthread_cond_signal(&queueCond);
+    }
+    job->waiters++;
+    while (!job->done)
+        pthread_cond_wait(&doneCond, &mutex);
+
+    double t1 = now();
+    if (job->err)
+        snprintf(reply, len, "ERR failed to render tile\n");
+    else
+        snprintf(reply, len, "OK %.3f %.3f %d %s\n", (t1 - t0) * 1e3,
+                coalesced ? 0.0 : (job->tstart - job->tsubmit) * 1e3, coalesced, job->path);
+    if (--job->waiters == 0)
+        free(job);
+    pthread_mutex_unlock(&mutex);
+}
+
+int parseJob(const char *line, Job *job) {
+    unsigned long long seed;
+    memset(job, 0, sizeof(*job));
+    if (sscanf(line, "%llu %d %d %d %d", &seed, &job->zoom, &job->x, &job->y, &job->scale) != 5)
+        return -1;
+    if (job->scale <= 0 || (job->scale != 1 && job->scale % 4 != 0))
+        return -1;
+    job->seed = seed;
+    return 0;
+}
+
+// Serves the requests of one connection, one line each.
+void *connection(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    char buf[LINE_MAX_LEN];
+    char reply[4096 + 64];
+    size_t n = 0;
+
+    for (;;) {
+        ssize_t got = read(fd, buf + n, sizeof(buf) - 1 - n);
+        if (got <= 0)
+            break;
+        n += got;
+        buf[n] = '\0';
+
+        char *line = buf, *eol;
+        while ((eol = strchr(line, '\n'))) {
+            *eol = '\0';
+            Job req;
+            if (parseJob(line, &req) != 0)
+                snprintf(reply, sizeof(reply), "ERR expected: <seed> <zoom> <x> <y> <scale>\n");
+            else
+                runJob(&req, reply, sizeof(reply));
+            if (write(fd, reply, strlen(reply)) < 0)
+                goto done;
+            line = eol + 1;
+        }
+        n = strlen(line);
+        if (n == sizeof(buf) - 1) {
+            const char *msg = "ERR line too long\n";
+            if (write(fd, msg, strlen(msg)) < 0)
+                break;
+            n = 0;
+        }
+        memmove(buf, line, n);
+    }
+done:
+    close(fd);
+    pthread_mutex_lock(&mutex);
+    connections--;
+    pthread_mutex_unlock(&mutex);
+    return NULL;
+}
+
+// Answers a connection that will not be served with an error, and closes it.
+void refuse(int fd, const char *msg) {
+    ssize_t n = write(fd, msg, strlen(msg));
+    (void) n;
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3 || argc > 4) {
+        fprintf(stderr, "Usage: %s <socket> <outputDir> [threads]\n", argv[0]);
+        return 1;
+    }
+    const char *socketPath = argv[1];
+    outputDir = argv[2];
+    int numThreads = argc > 3 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads < 1)
+        numThreads = 1;
+
+    const char *packPath = getenv("TILE_PACK");
+    if (packPath) {
+        if (tilePackOpen(&tilePack, packPath, 1) != 0)
+            return 1;
+        usePack = 1;
+    } else if (createDir(outputDir) != 0) {
+        return 1;
+    }
+    if (initGeneratorCache(&genCache, 2 * numThreads) != 0) {
+        fprintf(stderr, "Error allocating the generator cache\n");
+        return 1;
+    }
+    initBiomeColors(biomeColors);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return 1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    int sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sfd < 0) {
+        fprintf(stderr, "Error creating socket: %s\n", strerror(errno));
+        return 1;
+    }
+    unlink(socketPath);
+    if (bind(sfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(sfd, 64) != 0) {
+        fprintf(stderr, "Error listening on %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+
+    pthread_t tid;
+    for (int i = 0; i < numThreads; i++) {
+        if (pthread_create(&tid, NULL, worker, NULL) != 0) {
+            fprintf(stderr, "Error creating worker thread\n");
+            return 1;
+        }
+        pthread_detach(tid);
+    }
+    if (usePack) {
+        if (pthread_create(&tid, NULL, flusher, NULL) != 0) {
+            fprintf(stderr, "Error creating flusher thread\n");
+            return 1;
+        }
+        pthread_detach(tid);
+    }
+    printf("Listening on %s with %d workers\n", socketPath, numThreads);
+    fflush(stdout);
+
+    for (;;) {
+        int fd = accept(sfd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error accepting connection: %s\n", strerror(errno));
+            break;
+        }
+        pthread_mutex_lock(&mutex);
+        int full = connections >= MAX_CONNECTIONS;
+        if (!full)
+            connections++;
+        pthread_mutex_unlock(&mutex);
+        if (full) {
+            refuse(fd, "ERR too many connections\n");
+            continue;
+        }
+        if (pthread_create(&tid, NULL, connection, (void *)(intptr_t)fd) != 0) {
+            refuse(fd, "ERR out of resources\n");
+            pthread_mutex_lock(&mutex);
+            connections--;
+            pthread_mutex_unlock(&mutex);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    close(sfd);
+    unlink(socketPath);
+    if (usePack)
+        tilePackClose(&tilePack);
+    return 0;
+}
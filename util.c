@@ -5,6 +5,14 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+typedef HANDLE thread_id_t;
+#else
+#define USE_PTHREAD
+#include <pthread.h>
+typedef pthread_t       thread_id_t;
+#endif
 
 
 uint64_t *loadSavedSeeds(const char *fnam, uint64_t *scnt)
@@ -485,57 +493,180 @@ int parseBiomeColors(unsigned char biomeColors[256][3], const char *buf)
 }
 
 
-int biomesToImage(unsigned char *pixels,
-        unsigned char biomeColors[256][3], const int *biomes,
-        const unsigned int sx, const unsigned int sy,
-        const unsigned int pixscale, const int flip)
+typedef struct
 {
-    unsigned int i, j;
-    int containsInvalidBiomes = 0;
+    unsigned char *pixels;
+    unsigned char (*lut)[4];
+    const int *biomes;
+    unsigned int sx, sy, pixscale;
+    int flip;
+    unsigned int j0, j1;
+    int invalid;
+} imagerows_t;
+
+static
+#if defined(_WIN32)
+DWORD WINAPI
+#else
+void *
+#endif
+drawImageRows(void *data)
+{
+    imagerows_t *a = (imagerows_t*) data;
+    size_t rowlen = 3 * (size_t)a->sx * a->pixscale;
+    unsigned int i, j, m, n;
+
+    // Each row is expanded once into a scratch row with 4-byte stores (the
+    // last one overhanging by a byte), which is then copied to the pixscale
+    // rows of the image. Without a scratch row, the first of them is used.
+    unsigned char *row = (unsigned char*) malloc(rowlen + 1);
 
-    for (j = 0; j < sy; j++)
+    for (j = a->j0; j < a->j1; j++)
     {
-        for (i = 0; i < sx; i++)
+        const int *src = a->biomes + (size_t)j * a->sx;
+        unsigned int y = a->flip ? j : a->sy-1-j;
+        unsigned char *dst = a->pixels + rowlen * a->pixscale * y;
+        unsigned char *p = row ? row : dst;
+        for (i = 0; i < a->sx; i++)
         {
-            int id = biomes[j*sx+i];
-            unsigned int r, g, b;
-
-            if (id < 0 || id >= 256)
+            unsigned int id = (unsigned int) src[i];
+            const unsigned char *c;
+            if (id < 256)
             {
-                // This may happen for some intermediate layers
-                containsInvalidBiomes = 1;
-                r = biomeColors[id&0x7f][0]-40; r = (r>0xff) ? 0x00 : r&0xff;
-                g = biomeColors[id&0x7f][1]-40; g = (g>0xff) ? 0x00 : g&0xff;
-                b = biomeColors[id&0x7f][2]-40; b = (b>0xff) ? 0x00 : b&0xff;
+                c = a->lut[id];
             }
             else
             {
-                r = biomeColors[id][0];
-                g = biomeColors[id][1];
-                b = biomeColors[id][2];
+                a->invalid = 1;
+                c = a->lut[256 + (id & 0x7f)];
             }
-
-            unsigned int m, n;
-            for (m = 0; m < pixscale; m++) {
-                for (n = 0; n < pixscale; n++) {
-                    int idx = pixscale * i + n;
-                    if (flip)
-                        idx += (sx * pixscale) * ((pixscale * j) + m);
-                    else
-                        idx += (sx * pixscale) * ((pixscale * (sy-1-j)) + m);
-
-                    unsigned char *pix = pixels + 3*idx;
-                    pix[0] = (unsigned char)r;
-                    pix[1] = (unsigned char)g;
-                    pix[2] = (unsigned char)b;
-                }
+            for (n = 0; n < a->pixscale; n++, p += 3)
+            {
+                if (row)
+                    memcpy(p, c, 4);
+                else
+                    memcpy(p, c, 3);
             }
         }
+
+        for (m = row ? 0 : 1; m < a->pixscale; m++)
+            memcpy(dst + rowlen * m, row ? row : dst, rowlen);
     }
+    free(row);
+
+#if defined(_WIN32)
+    return 0;
+#else
+    return NULL;
+#endif
+}
+
+int biomesToImageParallel(unsigned char *pixels,
+        unsigned char biomeColors[256][3], const int *biomes,
+        const unsigned int sx, const unsigned int sy,
+        const unsigned int pixscale, const int flip, int threads)
+{
+    // colors of the valid biomes, followed by the darkened colors of 'id&0x7f'
+    // that are used for invalid biomes (which may happen for some intermediate
+    // layers)
+    unsigned char lut[256+128][4];
+    unsigned int i, k;
+    int t, containsInvalidBiomes = 0;
+
+    for (i = 0; i < 256; i++)
+    {
+        lut[i][0] = biomeColors[i][0];
+        lut[i][1] = biomeColors[i][1];
+        lut[i][2] = biomeColors[i][2];
+        lut[i][3] = 0;
+    }
+    for (i = 0; i < 128; i++)
+    {
+        for (k = 0; k < 3; k++)
+        {
+            unsigned int c = biomeColors[i][k]-40;
+            lut[256+i][k] = (c>0xff) ? 0x00 : c&0xff;
+        }
+        lut[256+i][3] = 0;
+    }
+
+    if (threads < 1)
+        threads = 1;
+    if ((unsigned int)threads > sy)
+        threads = sy ? sy : 1;
 
+    imagerows_t info1, *info = &info1;
+    thread_id_t *tids = NULL;
+    if (threads > 1)
+    {
+        info = (imagerows_t*) malloc(threads * sizeof(*info));
+        tids = (thread_id_t*) malloc(threads * sizeof(*tids));
+        if (!info || !tids)
+        {
+            free(info);
+            free(tids);
+            info = &info1;
+            tids = NULL;
+            threads = 1;
+        }
+    }
+
+    for (t = 0; t < threads; t++)
+    {
+        info[t].pixels = pixels;
+        info[t].lut = lut;
+        info[t].biomes = biomes;
+        info[t].sx = sx;
+        info[t].sy = sy;
+        info[t].pixscale = pixscale;
+        info[t].flip = flip;
+        info[t].j0 = (unsigned int)((uint64_t)sy * t / threads);
+        info[t].j1 = (unsigned int)((uint64_t)sy * (t+1) / threads);
+        info[t].invalid = 0;
+    }
+
+    if (threads == 1)
+    {
+        drawImageRows(info);
+        return info->invalid;
+    }
+
+#ifdef USE_PTHREAD
+    for (t = 0; t < threads; t++)
+    {
+        if (pthread_create(&tids[t], NULL, drawImageRows, (void*)&info[t]) != 0)
+            break;
+    }
+    // draw the rows of threads that could not be started here
+    for (i = t; i < (unsigned int)threads; i++)
+        drawImageRows(&info[i]);
+    while (t--)
+        pthread_join(tids[t], NULL);
+#else
+    for (t = 0; t < threads; t++)
+    {
+        tids[t] = CreateThread(NULL, 0, drawImageRows, (LPVOID)&info[t], 0, NULL);
+    }
+    WaitForMultipleObjects(threads, tids, TRUE, INFINITE);
+#endif
+
+    for (t = 0; t < threads; t++)
+        containsInvalidBiomes |= info[t].invalid;
+
+    free(info);
+    free(tids);
     return containsInvalidBiomes;
 }
 
+int biomesToImage(unsigned char *pixels,
+        unsigned char biomeColors[256][3], const int *biomes,
+        const unsigned int sx, const unsigned int sy,
+        const unsigned int pixscale, const int flip)
+{
+    return biomesToImageParallel(pixels, biomeColors, biomes, sx, sy,
+        pixscale, flip, 1);
+}
+
 int savePPM(const char *path, const unsigned char *pixels, const unsigned int sx, const unsigned int sy)
 {
     FILE *fp = fopen(path, "wb");
@@ -42,10 +42,20 @@ void initBiomeTypeColors(unsigned char biomeColors[256][3]);
  */
 int parseBiomeColors(unsigned char biomeColors[256][3], const char *buf);
 
+/* Draws the biomes of an sx*sy area to an RGB image with 'pixscale' pixels
+ * per biome. Rows are drawn from the bottom up, unless 'flip' is non-zero.
+ * Invalid biomes are drawn with a darkened color, and the return value
+ * indicates whether there were any.
+ * The parallel version distributes the rows over 'threads' threads.
+ */
 int biomesToImage(unsigned char *pixels,
         unsigned char biomeColors[256][3], const int *biomes,
         const unsigned int sx, const unsigned int sy,
         const unsigned int pixscale, const int flip);
+int biomesToImageParallel(unsigned char *pixels,
+        unsigned char biomeColors[256][3], const int *biomes,
+        const unsigned int sx, const unsigned int sy,
+        const unsigned int pixscale, const int flip, int threads);
 
 /* Save the pixel buffer (e.g. from biomesToImage) to the given path as an PPM
  * image file. Returns 0 if successful, or -1 if the file could not be opened,